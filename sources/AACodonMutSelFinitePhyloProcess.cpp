@@ -29,22 +29,44 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 // MPI: these two functions are responsible for broadcasting/receiving the current state of the parameter vector
 // are model dependent
 // should be implemented in .cpp file
+//
+// the parameter vector is divided into blocks (see CreateParameterStore)
+// and only the blocks that have changed since the last update are sent over the wire
+
+// layout of the parameter vector (should be the same on the master and the slaves)
+// doubles: branchalpha and branchbeta, one block per branch length, global codon parameters (nucrr, nucstat, codonprofile),
+// one block per component (profile and weight), dirweight and omega
+// ints: number of components, one block per site allocation
+void AACodonMutSelFinitePhyloProcess::CreateParameterStore()	{
+
+	int L1 = GetNmodeMax();
+	int L2 = GetDim();
+	int nstate = data->GetNstate();
+	paramstore.AddDoubleBlocks(1,2);
+	paramstore.AddDoubleBlocks(GetNbranch(),1);
+	paramstore.AddDoubleBlocks(1,GetNnucrr() + 4 + nstate);
+	paramstore.AddDoubleBlocks(L1,L2+1);
+	paramstore.AddDoubleBlocks(1,L2+1);
+	paramstore.AddIntBlocks(1,1);
+	paramstore.AddIntBlocks(ProfileProcess::GetNsite(),1);
+}
+
 void AACodonMutSelFinitePhyloProcess::SlaveUpdateParameters()	{
 
-	int i,j,L1,L2,ni,nd,nbranch = GetNbranch(),nnucrr = GetNnucrr(),nnucstat = 4;
+	int i,j,L1,L2,nbranch = GetNbranch(),nnucrr = GetNnucrr(),nnucstat = 4;
 	L1 = GetNmodeMax();
 	L2 = GetDim();
 	int nstate = data->GetNstate();
-	nd = 2+ nbranch + nnucrr + nnucstat + L2 + L1*(L2+1) + nstate + 1; // check if these last terms are correct in this context...
-	ni = 1 + ProfileProcess::GetNsite();
-	int* ivector = new int[ni];
-	double* dvector = new double[nd];
-	MPI_Bcast(ivector,ni,MPI_INT,0,MPI_COMM_WORLD);
-	MPI_Bcast(dvector,nd,MPI_DOUBLE,0,MPI_COMM_WORLD);
+	if (paramstore.IsEmpty())	{
+		CreateParameterStore();
+	}
+	paramstore.Receive();
+	const double* dvector = paramstore.GetDoubles();
+	const int* ivector = paramstore.GetInts();
 	int index = 0;
-	dvector[index] = branchalpha;
+	branchalpha = dvector[index];
 	index++;
-	dvector[index] = branchbeta;
+	branchbeta = dvector[index];
 	index++;
 	for(i=0; i<nbranch; ++i) {
 		blarray[i] = dvector[index];
@@ -81,14 +103,13 @@ void AACodonMutSelFinitePhyloProcess::SlaveUpdateParameters()	{
 		FiniteProfileProcess::alloc[i] = ivector[1+i];
 	}
 	//GetBranchLengthsFromArray();
-	delete[] dvector;
-	delete[] ivector;
 	// this one is really important
 	// in those cases where new components have appeared, or some old ones have disappeared
 	// during allocation move on the master node.
 	// 
 	// note that CreateMatrices() in fact creates only those that are not yet allocated
 	// and also deletes those that are now obsolete
+	// and UpdateMatrices() only recomputes the matrices whose parameters have changed
 	CreateMatrices();
 	UpdateMatrices();
 }
@@ -129,24 +150,25 @@ void AACodonMutSelFinitePhyloProcess::GlobalUpdateParameters() {
 	// and then call
 	// SetBranchLengthsFromArray()
 	assert(myid == 0);
-	int i,j,nnucrr,nnucstat,nbranch = GetNbranch(),ni,nd,L1,L2;
+	int i,j,nnucrr,nnucstat,nbranch = GetNbranch(),L1,L2;
 	nnucrr = GetNnucrr();
 	nnucstat = 4;	
 	L1 = GetNmodeMax();
 	L2 = GetDim();
 	int nstate = data->GetNstate();
-	nd = 2 + nbranch + nnucrr + nnucstat + L2 + L1*(L2+1) + nstate + 1;  // check if these last terms are correct in this context...
-	ni = 1 + ProfileProcess::GetNsite(); // 1 for the number of componenets, and the rest for allocations
-	int ivector[ni];
-	double dvector[nd]; 
+	if (paramstore.IsEmpty())	{
+		CreateParameterStore();
+	}
+	double* dvector = paramstore.GetDoubles();
+	int* ivector = paramstore.GetInts();
 	MESSAGE signal = PARAMETER_DIFFUSION;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 	
 	int index = 0;
-	index++;
 	dvector[index] = branchalpha;
 	index++;
 	dvector[index] = branchbeta;
+	index++;
 	// First we assemble the vector of doubles for distribution
 	for(i=0; i<nbranch; ++i) {
 		dvector[index] = blarray[i];
@@ -189,9 +211,8 @@ void AACodonMutSelFinitePhyloProcess::GlobalUpdateParameters() {
 		ivector[1+i] = FiniteProfileProcess::alloc[i];
 	}
 
-	// Now send out the doubles and ints over the wire...
-	MPI_Bcast(ivector,ni,MPI_INT,0,MPI_COMM_WORLD);
-	MPI_Bcast(dvector,nd,MPI_DOUBLE,0,MPI_COMM_WORLD);
+	// Now send out the blocks that have changed over the wire...
+	paramstore.Broadcast();
 }
 
 
@@ -423,11 +444,7 @@ void AACodonMutSelFinitePhyloProcess::CatProb(string name, int burnin, int every
 	DEBUG("entering:"<<" name="<<name<<" burnin="<<burnin<<" every="<<every<<" until="<<until);
 	
 	
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	
@@ -469,7 +486,7 @@ void AACodonMutSelFinitePhyloProcess::CatProb(string name, int burnin, int every
 	while(chainCount < until)
 	{
 		
-		FromStream(is);
+		ReadChainSample(chain);
 		chainCount++;
 		
 		if (chainCount < burnin)
@@ -567,11 +584,7 @@ void AACodonMutSelFinitePhyloProcess::CatPhobic(string name, int burnin, int eve
 	DEBUG("entering:"<<" name="<<name<<" burnin="<<burnin<<" every="<<every<<" until="<<until);
 	
 	
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	
@@ -600,7 +613,7 @@ void AACodonMutSelFinitePhyloProcess::CatPhobic(string name, int burnin, int eve
 	while(chainCount < until)
 	{
 		
-		FromStream(is);
+		ReadChainSample(chain);
 		chainCount++;
 		
 		if (chainCount < burnin)
@@ -653,18 +666,206 @@ void AACodonMutSelFinitePhyloProcess::CatPhobic(string name, int burnin, int eve
 }
 
 
-void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, int until)	{
+void AACodonMutSelFinitePhyloProcess::SiteSelectionHistogram(int site, int ncat, double min, double max, double step, double* stat, double* histo, double* total)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (! is)	{
-		cerr << "error: did not find " << name << ".chain\n";
-		exit(1);
+	double TOOSMALL = 1e-20;
+	int Nstate = AACodonMutSelFiniteSubstitutionProcess::GetNstate();
+	CodonStateSpace* statespace = AACodonMutSelProfileProcess::statespace;
+	double* aa = profile[alloc[site]];
+
+	for (int k=0; k<6*ncat; k++)	{
+		histo[k] = 0;
 	}
+	for (int k=0; k<6; k++)	{
+		total[k] = 0;
+	}
+
+	double Z = 0;
+	for (int s=0; s<Nstate; s++)	{
+		stat[s] = 	GetNucStat(statespace->GetCodonPosition(0, s)) *
+				GetNucStat(statespace->GetCodonPosition(1, s)) *
+				GetNucStat(statespace->GetCodonPosition(2, s)) *
+				codonprofile[s] *
+				aa[statespace->Translation(s)];
+		Z += stat[s];
+	}
+	for (int s=0; s<Nstate; s++)	{
+		stat[s] /= Z;
+	}
+
+	for (int codonFrom = 0; codonFrom<Nstate; codonFrom++)	{
+		for (int codonTo = 0; codonTo<Nstate; codonTo++)	{
+			int pos = statespace->GetDifferingPosition(codonFrom, codonTo);
+			if ((pos != -1) && (pos != 3))  {
+				int nucFrom = statespace->GetCodonPosition(pos, codonFrom);
+				int nucTo = statespace->GetCodonPosition(pos, codonTo);
+				int nucRRIndex;
+				if (nucFrom<nucTo)	{
+					nucRRIndex = (2 * Nnuc - nucFrom - 1) * nucFrom / 2 + nucTo - nucFrom - 1;
+				}
+				else {
+					nucRRIndex = (2 * Nnuc - nucTo - 1) * nucTo / 2 + nucFrom - nucTo - 1;
+				}
+				double statMutRate = GetNucRR(nucRRIndex) * GetNucStat(nucTo) * stat[codonFrom];
+				bool synonymous = statespace->Synonymous(codonFrom, codonTo);
+				double S;
+				if (! synonymous)	{
+					int aaFrom = statespace->Translation(codonFrom);
+					int aaTo = statespace->Translation(codonTo);
+					S = log(aa[aaTo]/aa[aaFrom]) + log(codonprofile[codonTo]/codonprofile[codonFrom]);
+				}
+				else	{
+					S = log(codonprofile[codonTo]/codonprofile[codonFrom]);
+				}
+
+				double statSubRate;
+				if (fabs(S) < TOOSMALL)	{
+					statSubRate = statMutRate * 1.0/( 1.0 - (S / 2) );
+				}
+				else {
+					statSubRate = statMutRate * (S/(1-exp(-S)));
+				}
+				if (! synonymous)	{
+					statSubRate *= *omega;
+				}
+
+				int c;
+				if (S < min)	{
+					c = 0;
+				}
+				else if (S > max)	{
+					c = ncat-1;
+				}
+				else {
+					c = 0;
+					double tmp = min + ((double)c * step) - step/2 + step;
+					do	{
+						c++;
+						tmp = min + ((double)(c) * step) - step/2 + step;
+					} while (tmp < S );
+				}
+				// S close to max can fall beyond the last bin: counted in it, as for S > max
+				// (histo is the block of the calling thread: c must not overflow into the next histogram)
+				if (c >= ncat)	{
+					c = ncat-1;
+				}
+
+				histo[c] += statMutRate;
+				histo[ncat + c] += statSubRate;
+				total[0] += statMutRate;
+				total[1] += statSubRate;
+				if (! synonymous)	{
+					histo[2*ncat + c] += statMutRate;
+					histo[3*ncat + c] += statSubRate;
+					total[2] += statMutRate;
+					total[3] += statSubRate;
+				}
+				else	{
+					histo[4*ncat + c] += statMutRate;
+					histo[5*ncat + c] += statSubRate;
+					total[4] += statMutRate;
+					total[5] += statSubRate;
+				}
+			}
+		}
+	}
+}
+
+// the sites of one sample of Read, in blocks of fixed size
+// each site belongs to one block: the per-site statistics are accumulated directly
+// the global histograms are accumulated per block, and summed over blocks by the caller,
+// so that the result does not depend on the number of threads
+class SelectionHistogramLoop : public ParallelTask	{
+
+	public:
+
+	static const int blocksize = 16;
+
+	AACodonMutSelFinitePhyloProcess* process;
+	int nsite;
+	int nstate;
+	int ncat;
+	double min;
+	double max;
+	double step;
+
+	// per block: 6 histograms of ncat bins, and their 6 totals (see SiteSelectionHistogram)
+	int nblock;
+	double* blockhisto;
+	double* blocktotal;
+
+	double** sshistoMut;
+	double** sshistoSub;
+	double** sshistoNonsynMut;
+	double** sshistoNonsynSub;
+	double** sshistoSynMut;
+	double** sshistoSynSub;
+	double* ssStatNonsynSubRate;
+	double* ssStatSynSubRate;
+	double* ssStatNonsynMutRate;
+	double* ssStatSynMutRate;
+	double* ssdNdS;
+	int* ssProportiondNdSGreaterThanOne;
+
+	void Run(int begin, int end, int thread)	{
+
+		double* stat = new double[nstate];
+		double* histo = new double[6*ncat];
+		double total[6];
+
+		for (int b=begin; b<end; b++)	{
+			double* bhisto = blockhisto + b*6*ncat;
+			double* btotal = blocktotal + b*6;
+			for (int k=0; k<6*ncat; k++)	{
+				bhisto[k] = 0;
+			}
+			for (int k=0; k<6; k++)	{
+				btotal[k] = 0;
+			}
+			int sitemax = (b+1)*blocksize;
+			if (sitemax > nsite)	{
+				sitemax = nsite;
+			}
+			for (int site=b*blocksize; site<sitemax; site++)	{
+				process->SiteSelectionHistogram(site,ncat,min,max,step,stat,histo,total);
+				for (int c=0; c<ncat; c++)	{
+					sshistoMut[site][c] += histo[c]/total[0];
+					sshistoSub[site][c] += histo[ncat + c]/total[1];
+					sshistoNonsynMut[site][c] += histo[2*ncat + c]/total[2];
+					sshistoNonsynSub[site][c] += histo[3*ncat + c]/total[3];
+					sshistoSynMut[site][c] += histo[4*ncat + c]/total[4];
+					sshistoSynSub[site][c] += histo[5*ncat + c]/total[5];
+				}
+				for (int k=0; k<6*ncat; k++)	{
+					bhisto[k] += histo[k];
+				}
+				for (int k=0; k<6; k++)	{
+					btotal[k] += total[k];
+				}
+				ssStatNonsynSubRate[site] += total[3];
+				ssStatNonsynMutRate[site] += total[2];
+				ssStatSynSubRate[site] += total[5];
+				ssStatSynMutRate[site] += total[4];
+				double dnds = (total[3] / total[5]) / (total[2] / total[4]);
+				ssdNdS[site] += dnds;
+				if (dnds > 1.0)	{
+					ssProportiondNdSGreaterThanOne[site]++;
+				}
+			}
+		}
+
+		delete[] stat;
+		delete[] histo;
+	}
+};
+
+void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, int until)	{
+
+	ChainReader chain(name);
 	//cerr << "In AACodonMutSelDPPhyloProcess. GetDim() is : " << GetDim() << "\n";
 	int Nstate = AACodonMutSelFiniteSubstitutionProcess::GetNstate();
 	//cerr << "Nstate is: " << Nstate << "\n";
 	//cerr.flush();
-	double TOOSMALL = 1e-20;
 	int Ncat = 241;
 	double min = -30;
 	double max = 30;
@@ -743,12 +944,6 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 	double* shistoSynMut = new double[Ncat];
 	double* shistoSynSub = new double[Ncat];
 
-	double* tsshistoMut = new double[Ncat];
-	double* tsshistoSub = new double[Ncat];
-	double* tsshistoNonsynMut = new double[Ncat];
-	double* tsshistoNonsynSub = new double[Ncat];
-	double* tsshistoSynMut = new double[Ncat];
-	double* tsshistoSynSub = new double[Ncat];
 	for (int c = 0; c < Ncat; c++)	{
 		ghistoMut[c] = 0;
 		ghistoSub[c] = 0;
@@ -757,10 +952,8 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 		ghistoSynMut[c] = 0;
 		ghistoSynSub[c] = 0;
 	}
-	//const double* stat;
-	double* stat = new double[Nstate];
-	int pos, nucFrom, nucTo, nucRRIndex, c;
-	double statMutRate, S, statSubRate, totalMut, totalSub, totalNonsynMut, totalNonsynSub, totalSynMut, totalSynSub, siteTotalMut, siteTotalSub, siteTotalNonsynMut, siteTotalNonsynSub, siteTotalSynMut, siteTotalSynSub, Z;
+	int c;
+	double totalMut, totalSub, totalNonsynMut, totalNonsynSub, totalSynMut, totalSynSub;
 	cerr << "Ncat is " << Ncat << "\n";
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
@@ -768,17 +961,42 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 	while ((i < until) && (i < burnin))	{
 		cerr << ".";
 		cerr.flush();
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	cerr << "\nburnin complete\n";
 	cerr.flush();
+
+	SelectionHistogramLoop loop;
+	loop.process = this;
+	loop.nsite = ProfileProcess::GetNsite();
+	loop.nstate = Nstate;
+	loop.ncat = Ncat;
+	loop.min = min;
+	loop.max = max;
+	loop.step = step;
+	loop.nblock = (loop.nsite + SelectionHistogramLoop::blocksize - 1) / SelectionHistogramLoop::blocksize;
+	loop.blockhisto = new double[loop.nblock * 6 * Ncat];
+	loop.blocktotal = new double[loop.nblock * 6];
+	loop.sshistoMut = sshistoMut;
+	loop.sshistoSub = sshistoSub;
+	loop.sshistoNonsynMut = sshistoNonsynMut;
+	loop.sshistoNonsynSub = sshistoNonsynSub;
+	loop.sshistoSynMut = sshistoSynMut;
+	loop.sshistoSynSub = sshistoSynSub;
+	loop.ssStatNonsynSubRate = ssStatNonsynSubRate;
+	loop.ssStatSynSubRate = ssStatSynSubRate;
+	loop.ssStatNonsynMutRate = ssStatNonsynMutRate;
+	loop.ssStatSynMutRate = ssStatSynMutRate;
+	loop.ssdNdS = ssdNdS;
+	loop.ssProportiondNdSGreaterThanOne = ssProportiondNdSGreaterThanOne;
+
 	int samplesize = 0;
 	while (i < until)	{
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		QuickUpdate();
 		//UpdateMatrices();
@@ -796,6 +1014,16 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 		for (int a=0; a<Nstate; a++)	{
 			meanCodonProfile[a] += codonprofile[a];
 		}
+		for (int site=0; site<ProfileProcess::GetNsite(); site++)	{
+			for (int a=0; a<GetDim(); a++)	{
+				PosteriorMeanSiteAAP[site][a] += profile[alloc[site]][a]; 
+			}
+		}
+
+		// sites are shared out among the threads of the pool
+		ThreadPool::ParallelFor(loop,0,loop.nblock,1);
+
+		// global histograms of this sample: summed over blocks, always in the same order
 		totalMut = 0;
 		totalSub = 0;
 		totalNonsynMut = 0;
@@ -810,169 +1038,24 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 			shistoSynMut[c] = 0;
 			shistoSynSub[c] = 0;
 		}
-		for (int site=0; site<ProfileProcess::GetNsite(); site++)	{
-			siteTotalMut = 0;
-			siteTotalSub = 0;
-			siteTotalNonsynMut = 0;
-			siteTotalNonsynSub = 0;
-			siteTotalSynMut = 0;
-			siteTotalSynSub = 0;
-			
+		for (int b=0; b<loop.nblock; b++)	{
+			double* histo = loop.blockhisto + b*6*Ncat;
+			double* total = loop.blocktotal + b*6;
 			for (c = 0; c < Ncat; c++)	{
-				tsshistoMut[c] = 0;
-				tsshistoSub[c] = 0;
-				tsshistoNonsynMut[c] = 0;
-				tsshistoNonsynSub[c] = 0;
-				tsshistoSynMut[c] = 0;
-				tsshistoSynSub[c] = 0;
-			}
-			for (int a=0; a<GetDim(); a++)	{
-				PosteriorMeanSiteAAP[site][a] += profile[alloc[site]][a]; 
+				shistoMut[c] += histo[c];
+				shistoSub[c] += histo[Ncat + c];
+				shistoNonsynMut[c] += histo[2*Ncat + c];
+				shistoNonsynSub[c] += histo[3*Ncat + c];
+				shistoSynMut[c] += histo[4*Ncat + c];
+				shistoSynSub[c] += histo[5*Ncat + c];
 			}
-			Z = 0;
-			for (int s=0; s<Nstate; s++)	{
-				stat[s] = 	GetNucStat(AACodonMutSelProfileProcess::statespace->GetCodonPosition(0, s)) *
-						GetNucStat(AACodonMutSelProfileProcess::statespace->GetCodonPosition(1, s)) *
-						GetNucStat(AACodonMutSelProfileProcess::statespace->GetCodonPosition(2, s)) *
-						codonprofile[s] *
-						profile[alloc[site]][AACodonMutSelProfileProcess::statespace->Translation(s)];
-				Z += stat[s];
-			}
-			for (int s=0; s<Nstate; s++)	{
-				stat[s] /= Z;
-			}
-			//stat = GetStationary(site);
-			//stat = matrixarray[alloc[site]]->GetStationary();
-			int nonsyncount = 0;
-			int syncount = 0;
-			for (int codonFrom = 0; codonFrom<Nstate; codonFrom++)	{
-				for (int codonTo = 0; codonTo<Nstate; codonTo++)	{
-					pos = AACodonMutSelProfileProcess::statespace->GetDifferingPosition(codonFrom, codonTo);				
-					if ((pos != -1) && (pos != 3))  {
-						nucFrom = AACodonMutSelProfileProcess::statespace->GetCodonPosition(pos, codonFrom);
-						nucTo = AACodonMutSelProfileProcess::statespace->GetCodonPosition(pos, codonTo);
-						if (nucFrom<nucTo)	{
-							nucRRIndex = (2 * Nnuc - nucFrom - 1) * nucFrom / 2 + nucTo - nucFrom - 1;
-						}
-						else {
-							nucRRIndex = (2 * Nnuc - nucTo - 1) * nucTo / 2 + nucFrom - nucTo - 1;
-						}
-						statMutRate = GetNucRR(nucRRIndex) * GetNucStat(nucTo) * stat[codonFrom];
-						if (!AACodonMutSelProfileProcess::statespace->Synonymous(codonFrom, codonTo))	{
-							int aaFrom = AACodonMutSelProfileProcess::statespace->Translation(codonFrom);
-							int aaTo = AACodonMutSelProfileProcess::statespace->Translation(codonTo);
-							S = log(profile[alloc[site]][aaTo]/profile[alloc[site]][aaFrom]) + log(codonprofile[codonTo]/codonprofile[codonFrom]);
-						}
-						else	{
-							S = log(codonprofile[codonTo]/codonprofile[codonFrom]);
-						}
-
-						if (fabs(S) < TOOSMALL)	{
-							statSubRate = statMutRate * 1.0/( 1.0 - (S / 2) );
-						}
-						else {
-							statSubRate = statMutRate * (S/(1-exp(-S)));
-						}
-
-						if (!AACodonMutSelProfileProcess::statespace->Synonymous(codonFrom, codonTo))	{
-							statSubRate *= *omega;
-							//ssStatNonsynSubRate[site] += statSubRate;
-							//ssStatNonsynMutRate[site] += statMutRate;
-							nonsyncount++;
-						}
-						else	{
-							//ssStatSynSubRate[site] += statSubRate;
-							//ssStatSynMutRate[site] += statMutRate;
-							syncount++;
-						}
-
-
-						if (S < min)	{
-							c = 0;
-						}
-						else if (S > max)	{
-							c = Ncat-1;
-						}
-						else {
-							c = 0;
-							double tmp = min + ((double)c * step) - step/2 + step;
-							do	{
-								c++;
-								tmp = min + ((double)(c) * step) - step/2 + step;
-							} while (tmp < S );
-						}
-						if (c == Ncat)	{
-							cout << "error, c==Ncat.\n";
-							cout.flush();
-						}
-	
-						shistoMut[c] += statMutRate;
-						shistoSub[c] += statSubRate;
-						tsshistoMut[c] += statMutRate;
-						tsshistoSub[c] += statSubRate;
-						if (!AACodonMutSelProfileProcess::statespace->Synonymous(codonFrom, codonTo))	{
-							shistoNonsynMut[c] += statMutRate;
-							shistoNonsynSub[c] += statSubRate;
-							totalNonsynMut += statMutRate;
-							totalNonsynSub += statSubRate;
-
-							tsshistoNonsynMut[c] += statMutRate;
-							tsshistoNonsynSub[c] += statSubRate;
-							siteTotalNonsynMut += statMutRate;
-							siteTotalNonsynSub += statSubRate;
-						}
-						else	{
-							shistoSynMut[c] += statMutRate;
-							shistoSynSub[c] += statSubRate;
-							totalSynMut += statMutRate;
-							totalSynSub += statSubRate;
-
-							tsshistoSynMut[c] += statMutRate;
-							tsshistoSynSub[c] += statSubRate;
-							siteTotalSynMut += statMutRate;
-							siteTotalSynSub += statSubRate;
-							
-						}
-						totalMut += statMutRate;
-						totalSub += statSubRate;
-						siteTotalMut += statMutRate;
-						siteTotalSub += statSubRate;
-						//cerr << "nucFrom is: " << nucFrom << "\n";
-						//cerr << "mutRate is: " << statMutRate << "\n";
-						//cerr << "subRate is: " << statSubRate << "\n";
-					}
-				}
-				//cerr << "codonStat[" << codonFrom << "]: " << stat[codonFrom];
-				//cerr << ", amino acid " << AAMutSelProfileProcess::statespace->Translation(codonFrom);
-				//cerr << ", nuc pos 1: " << AAMutSelProfileProcess::statespace->GetCodonPosition(0, codonFrom);
-				//cerr << ", nuc pos 2: " << AAMutSelProfileProcess::statespace->GetCodonPosition(1, codonFrom);
-				//cerr << ", nuc pos 3: " << AAMutSelProfileProcess::statespace->GetCodonPosition(2, codonFrom);
-				//cerr << "\n";
-			}
-
-			for (c=0; c<Ncat; c++)	{
-				sshistoMut[site][c] += tsshistoMut[c]/siteTotalMut;
-				sshistoSub[site][c] += tsshistoSub[c]/siteTotalSub;
-				sshistoNonsynMut[site][c] += tsshistoNonsynMut[c]/siteTotalNonsynMut;
-				sshistoNonsynSub[site][c] += tsshistoNonsynSub[c]/siteTotalNonsynSub;
-				sshistoSynMut[site][c] += tsshistoSynMut[c]/siteTotalSynMut;
-				sshistoSynSub[site][c] += tsshistoSynSub[c]/siteTotalSynSub;
-			}
-
-			//ssdNdS[site] = ssStatNonsynSubRate[site] / ssStatSynSubRate[site];
-			//ssdNdS[site] = (ssStatNonsynSubRate[site] / nonsyncount ) / (ssStatSynSubRate[site] / syncount );
-			ssStatNonsynSubRate[site] += siteTotalNonsynSub;
-			ssStatNonsynMutRate[site] += siteTotalNonsynMut;
-			ssStatSynSubRate[site] += siteTotalSynSub;
-			ssStatSynMutRate[site] += siteTotalSynMut;
-			double dnds = (siteTotalNonsynSub / siteTotalSynSub) / (siteTotalNonsynMut / siteTotalSynMut);
-			//ssdNdS[site] = (ssStatNonsynSubRate[site] / ssStatSynSubRate[site] ) / (ssStatNonsynMutRate[site] / ssStatSynMutRate[site]);
-			ssdNdS[site] += dnds;
-			if (dnds > 1.0)	{
-				ssProportiondNdSGreaterThanOne[site]++;
-			}
-			//exit(1);
-		}	
+			totalMut += total[0];
+			totalSub += total[1];
+			totalNonsynMut += total[2];
+			totalNonsynSub += total[3];
+			totalSynMut += total[4];
+			totalSynSub += total[5];
+		}
 		// cerr << process->GetLogLikelihood() << '\t' << logl << '\t' << length << '\n';
 
 		for (c=0; c<Ncat; c++)	{
@@ -986,7 +1069,7 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -1189,12 +1272,8 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 	delete[] sshistoNonsynSub;
 	delete[] sshistoSynMut;
 	delete[] sshistoSynSub;
-	delete[] tsshistoMut;
-	delete[] tsshistoSub;
-	delete[] tsshistoNonsynMut;
-	delete[] tsshistoNonsynSub;
-	delete[] tsshistoSynMut;
-	delete[] tsshistoSynSub;
+	delete[] loop.blockhisto;
+	delete[] loop.blocktotal;
 	delete[] ghistoMut;
 	delete[] ghistoSub;
 	delete[] ghistoNonsynMut;
@@ -1211,7 +1290,6 @@ void AACodonMutSelFinitePhyloProcess::Read(string name, int burnin, int every, i
 	delete[] ppvhistoSub;
 	delete[] ppvhistoNonsynMut;
 	delete[] ppvhistoNonsynSub;
-	delete[] stat;
 	delete[] meanNucStat;
 	delete[] meanNucRR;
 	delete[] meanCodonProfile;
@@ -20,6 +20,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 #include "AACodonMutSelFiniteSubstitutionProcess.h"
 #include "GeneralPathSuffStatMatrixPhyloProcess.h"
 #include "GammaBranchProcess.h"
+#include "ParameterStore.h"
 //#include "Parallel.h"
 
 class AACodonMutSelFinitePhyloProcess : public virtual AACodonMutSelFiniteSubstitutionProcess, public virtual GeneralPathSuffStatMatrixPhyloProcess, public virtual GammaBranchProcess	{
@@ -67,17 +68,9 @@ class AACodonMutSelFinitePhyloProcess : public virtual AACodonMutSelFiniteSubsti
 		}
 		tree->RegisterWith(taxonset,myid);
 		
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		Create(tree,codondata,ncat,infixncomp,inempmix,inmixtype,insitemin,insitemax,statespace,fixcodonprofile,fixomega);
 		if (myid == 0)	{
@@ -129,17 +122,9 @@ class AACodonMutSelFinitePhyloProcess : public virtual AACodonMutSelFiniteSubsti
 		CodonStateSpace* statespace = codondata->GetCodonStateSpace();
 		const TaxonSet* taxonset = codondata->GetTaxonSet();
 
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		tree = new Tree(taxonset);
 		if (myid == 0)	{
@@ -170,6 +155,7 @@ class AACodonMutSelFinitePhyloProcess : public virtual AACodonMutSelFiniteSubsti
 	void SlaveComputeCVScore();
 	void SlaveUpdateParameters();
 	void GlobalUpdateParameters();
+	void CreateParameterStore();
 
 	double GetLogProb()	{
 		return GetLogPrior() + GetLogLikelihood();
@@ -284,6 +270,16 @@ class AACodonMutSelFinitePhyloProcess : public virtual AACodonMutSelFiniteSubsti
 	void CatPhobic(string name, int burnin, int every, int until);
     
 	void Read(string name, int burnin, int every, int until);
+
+	// for the current sample (used by Read)
+	// mutation and substitution flows at site, binned according to the scaled selection coefficient S of the codon changes
+	// (ncat bins of width step, from min to max; the first and last bins collect everything beyond)
+	// histo: ncat bins for each of the 6 flows (all mutations, all substitutions, nonsyn mut, nonsyn sub, syn mut, syn sub)
+	// total: summed over all bins for each of the 6 flows
+	// stat: work array of size Nstate
+	// only reads the parameters, so that different sites can be done concurrently
+	void SiteSelectionHistogram(int site, int ncat, double min, double max, double step, double* stat, double* histo, double* total);
+
 	// primary scheduler
 
 	double Move(double tuning = 1.0)	{
@@ -369,6 +365,9 @@ class AACodonMutSelFinitePhyloProcess : public virtual AACodonMutSelFiniteSubsti
 	Chrono chronocollapse;
 	Chrono chronounfold;
 
+	// parameter vector, broadcast incrementally by GlobalUpdateParameters
+	ParameterStore paramstore;
+
 };
 
 // enfin, le PhyloProcess ainsi construit peut etre instancie dans le main.cpp
@@ -86,6 +86,26 @@ class AACodonMutSelProfileProcess : public virtual GeneralPathSuffStatMatrixProf
 	
 	//double GetMinTotWeight() {return GetDim() / (GetDim()/2);}
 
+	virtual int GetNmatrixGlobal()	{
+		if (! nucrr)	{
+			return -1;
+		}
+		return Nnucrr + Nnuc + statespace->GetNstate() + 1;
+	}
+
+	virtual void GetMatrixGlobal(double* x)	{
+		for (int i=0; i<Nnucrr; i++)	{
+			*x++ = nucrr[i];
+		}
+		for (int i=0; i<Nnuc; i++)	{
+			*x++ = nucstat[i];
+		}
+		for (int i=0; i<statespace->GetNstate(); i++)	{
+			*x++ = codonprofile[i];
+		}
+		*x = *omega;
+	}
+
 	// nuc relative rates
 	virtual double LogNucRRPrior();
 	virtual void SampleNucRR();
@@ -535,16 +535,12 @@ void AACodonMutSelSBDPPhyloProcess::ReadPB(int argc, char* argv[])	{
 }
 
 void AACodonMutSelSBDPPhyloProcess::ReadMapStats(string name, int burnin, int every, int until){
-  	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 
@@ -560,7 +556,7 @@ void AACodonMutSelSBDPPhyloProcess::ReadMapStats(string name, int burnin, int ev
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		MPI_Status stat;
@@ -597,7 +593,7 @@ void AACodonMutSelSBDPPhyloProcess::ReadMapStats(string name, int burnin, int ev
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -610,11 +606,7 @@ void AACodonMutSelSBDPPhyloProcess::ReadMapStats(string name, int burnin, int ev
 
 void AACodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (! is)	{
-		cerr << "error: did not find " << name << ".chain\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	//cerr << "In AACodonMutSelDPPhyloProcess. GetDim() is : " << GetDim() << "\n";
 	int Nstate = AACodonMutSelSBDPSubstitutionProcess::GetNstate();
 	//cerr << "Nstate is: " << Nstate << "\n";
@@ -723,7 +715,7 @@ void AACodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int
 	while ((i < until) && (i < burnin))	{
 		cerr << ".";
 		cerr.flush();
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	cerr << "\nburnin complete\n";
@@ -733,7 +725,7 @@ void AACodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		QuickUpdate();
 		//UpdateMatrices();
@@ -941,7 +933,7 @@ void AACodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -1207,12 +1199,11 @@ int AACodonMutSelSBDPPhyloProcess::CountNonSynMapping(const Link* from, int i)	{
 
 int AACodonMutSelSBDPPhyloProcess::CountNonSynMapping(int i)	{
 	int count = 0;
-	for(int k=0; k<GetNstate(); ++k) {
-		for(int l=0; l<GetNstate(); ++l) {
-		// 	if (!AACodonMutSelProfileProcess::statespace->Synonymous(k, l)) {
-				count+=sitepaircount[i][pair<int,int>(k,l)];
-		//	}
-		}
+	PathSuffStat& suffstat = sitepathsuffstat[i];
+	for (int k=0; k<suffstat.GetNpair(); k++)	{
+	// 	if (!AACodonMutSelProfileProcess::statespace->Synonymous(suffstat.GetPairFrom(k), suffstat.GetPairTo(k))) {
+			count+=suffstat.GetPairCount(k);
+	//	}
 	}
 	return count;
 }
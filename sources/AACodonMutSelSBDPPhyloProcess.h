@@ -69,17 +69,9 @@ class AACodonMutSelSBDPPhyloProcess : public virtual AACodonMutSelSBDPSubstituti
 		}
 		tree->RegisterWith(taxonset,myid);
 		
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		Create(tree,codondata,insitemin,insitemax,statespace,fixcodonprofile,fixomega);
 		if (myid == 0)	{
@@ -123,17 +115,9 @@ class AACodonMutSelSBDPPhyloProcess : public virtual AACodonMutSelSBDPSubstituti
 		CodonStateSpace* statespace = codondata->GetCodonStateSpace();
 		const TaxonSet* taxonset = codondata->GetTaxonSet();
 
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		tree = new Tree(taxonset);
 		if (myid == 0)	{
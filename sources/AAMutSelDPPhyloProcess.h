@@ -63,17 +63,9 @@ class AAMutSelDPPhyloProcess : public virtual AAMutSelDPSubstitutionProcess, pub
 		}
 		tree->RegisterWith(taxonset,myid);
 		
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		Create(tree,codondata,insitemin,insitemax,statespace);
 		if (myid == 0)	{
@@ -98,17 +90,9 @@ class AAMutSelDPPhyloProcess : public virtual AAMutSelDPSubstitutionProcess, pub
 		CodonStateSpace* statespace = codondata->GetCodonStateSpace();
 		const TaxonSet* taxonset = codondata->GetTaxonSet();
 
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		tree = new Tree(taxonset);
 		if (myid == 0)	{
@@ -61,17 +61,9 @@ class AAMutSelFinitePhyloProcess : public virtual AAMutSelFiniteSubstitutionProc
 		}
 		tree->RegisterWith(taxonset,myid);
 		
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		Create(tree,codondata,ncat,infixncomp,inempmix,inmixtype,insitemin,insitemax,statespace);
 		if (myid == 0)	{
@@ -100,17 +92,9 @@ class AAMutSelFinitePhyloProcess : public virtual AAMutSelFiniteSubstitutionProc
 		CodonStateSpace* statespace = codondata->GetCodonStateSpace();
 		const TaxonSet* taxonset = codondata->GetTaxonSet();
 
-		int insitemin = -1,insitemax = -1;
-		if (myid > 0) {
-			int width = codondata->GetNsite()/(nprocs-1);
-			insitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				insitemax = codondata->GetNsite();
-			}
-			else {
-				insitemax = myid*width;
-			}
-		}
+		MakeMPIPartition(codondata);
+		int insitemin = GetProcSiteMin(myid);
+		int insitemax = GetProcSiteMax(myid);
 
 		tree = new Tree(taxonset);
 		if (myid == 0)	{
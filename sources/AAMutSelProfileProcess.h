@@ -75,6 +75,22 @@ class AAMutSelProfileProcess : public virtual GeneralPathSuffStatMatrixProfilePr
 	virtual void Delete();
 	virtual double GetNormalizationFactor()	{return 1.0;}
 
+	virtual int GetNmatrixGlobal()	{
+		if (! nucrr)	{
+			return -1;
+		}
+		return Nnucrr + Nnuc;
+	}
+
+	virtual void GetMatrixGlobal(double* x)	{
+		for (int i=0; i<Nnucrr; i++)	{
+			*x++ = nucrr[i];
+		}
+		for (int i=0; i<Nnuc; i++)	{
+			*x++ = nucstat[i];
+		}
+	}
+
 	// nuc relative rates
 	virtual double LogNucRRPrior();
 	virtual void SampleNucRR();
@@ -379,11 +379,7 @@ void AAMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int unti
 	cerr << "in read\n";
 	cerr.flush();
 
-	ifstream is((name + ".chain").c_str());
-	if (! is)	{
-		cerr << "error: did not find " << name << ".chain\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	//cerr << "In AAMutSelDPPhyloProcess. GetDim() is : " << GetDim() << "\n";
 	int Nstate = AAMutSelSBDPSubstitutionProcess::GetNstate();
 	//cerr << "Nstate is: " << Nstate << "\n";
@@ -457,7 +453,7 @@ void AAMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int unti
 	while ((i < until) && (i < burnin))	{
 		cerr << ".";
 		cerr.flush();
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	cerr << "\nburnin complete\n";
@@ -467,7 +463,7 @@ void AAMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int unti
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		QuickUpdate();
 		//UpdateMatrices();
@@ -626,7 +622,7 @@ void AAMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int unti
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
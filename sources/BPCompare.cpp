@@ -15,6 +15,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include "phylo.h"
 #include "Parallel.h"
+#include "ThreadPool.h"
 MPI_Datatype Propagate_arg;
 
 const double default_cutoff = 0.05;
@@ -45,6 +46,7 @@ int main(int argc, char* argv[])	{
 		cerr << '\n';
 		cerr << "\t compare bipartition frequencies between independent chains\n";
 		cerr << "\t and build consensus based on merged lists of trees\n";
+		cerr << "\t (trees are parsed on PB_NTHREADS threads, default 1)\n";
 		cerr << '\n';
 		exit(1);
 	}
@@ -113,6 +115,7 @@ int main(int argc, char* argv[])	{
 		i++;
 	}
 
+	ThreadPool::Init();
 	BPCompare(ChainName, P, burnin, every, until, ps, verbose, mergeallbp, OutFile, cutoff, conscutoff, rootonly, bench);
 
 }
@@ -15,6 +15,16 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include "phylo.h"
 
+static const int wordsize = 64;
+
+static inline unsigned long long TaxonBit(int index)	{
+	return 1ULL << (index % wordsize);
+}
+
+static inline int Popcount(unsigned long long x)	{
+	return __builtin_popcountll(x);
+}
+
 // ---------------------------------------------------------------------------------
 //		 Bipartition(TaxaParameters*)
 // ---------------------------------------------------------------------------------
@@ -23,12 +33,17 @@ Bipartition::Bipartition(TaxaParameters* inParam)	{
 
 	mParam = inParam;
 	Ntaxa = mParam->Ntaxa;
+	Nword = (Ntaxa + wordsize - 1) / wordsize;
 	
-	mArray = new int[Ntaxa];
-	for (int i=0; i<Ntaxa; i++)	{
-		mArray[i] = 0;
+	mSet = new unsigned long long[Nword];
+	mMask = new unsigned long long[Nword];
+	for (int w=0; w<Nword; w++)	{
+		mSet[w] = 0;
+		mMask[w] = ~0ULL;
+	}
+	if (Ntaxa % wordsize)	{
+		mMask[Nword-1] = TaxonBit(Ntaxa) - 1;
 	}
-
 }
 
 // ---------------------------------------------------------------------------------
@@ -39,9 +54,12 @@ Bipartition::Bipartition(const Bipartition& from)	{
 
 	mParam = from.mParam;
 	Ntaxa = mParam->Ntaxa;
-	mArray = new int[Ntaxa];
-	for (int i=0; i<Ntaxa; i++)	{
-		mArray[i] = from.mArray[i];
+	Nword = from.Nword;
+	mSet = new unsigned long long[Nword];
+	mMask = new unsigned long long[Nword];
+	for (int w=0; w<Nword; w++)	{
+		mSet[w] = from.mSet[w];
+		mMask[w] = from.mMask[w];
 	}
 }
 
@@ -52,7 +70,8 @@ Bipartition::Bipartition(const Bipartition& from)	{
 
 Bipartition::~Bipartition()	{
 
-	delete[] mArray;
+	delete[] mSet;
+	delete[] mMask;
 }
 
 // ---------------------------------------------------------------------------------
@@ -64,8 +83,9 @@ Bipartition&	Bipartition::operator=(const Bipartition& from)	{
 	if (this != & from)	{
 		// assume they have the same TaxaParameters
 		mParam = from.mParam;
-		for (int i=0; i<Ntaxa; i++)	{
-			mArray[i] = from.mArray[i];
+		for (int w=0; w<Nword; w++)	{
+			mSet[w] = from.mSet[w];
+			mMask[w] = from.mMask[w];
 		}
 	}
 	return *this;
@@ -79,13 +99,13 @@ Bipartition&	Bipartition::operator=(const string& from)	{
 
 	for (int i=0; i<Ntaxa; i++)	{
 		if (from[i] == '.')	{		// inside
-			mArray[i] = 0;
+			SetTaxonStatus(i,0);
 		}
 		else if (from[i] == '*')	{	// outside
-			mArray[i] = 1;
+			SetTaxonStatus(i,1);
 		}
 		else if (from[i] == ' ')	{	// absent
-			mArray[i] = -1;
+			SetTaxonStatus(i,-1);
 		}
 		else	{
 			cerr << "error in Bipartition::operator=(string)\n";
@@ -100,20 +120,20 @@ Bipartition&	Bipartition::operator=(const string& from)	{
 // ---------------------------------------------------------------------------------
 
 void Bipartition::AllAbsent()	{
-	for (int i=0; i<Ntaxa; i++)	{
-		mArray[i] = -1;
+	for (int w=0; w<Nword; w++)	{
+		mSet[w] = 0;
+		mMask[w] = 0;
 	}
 }
 
 void Bipartition::Suppress(const Bipartition& leafset)	{
-	for (int i=0; i<Ntaxa; i++)	{
-		if (leafset.mArray[i] == -1)	{
-			if (mArray[i] != 0)	{
-				cerr << "?? in Bipartition::Suppress: suppressing a non zero taxon\n";
-				exit(1);
-			}
-			mArray[i] = -1;
+	for (int w=0; w<Nword; w++)	{
+		unsigned long long suppressed = mMask[w] & ~leafset.mMask[w];
+		if (mSet[w] & suppressed)	{
+			cerr << "?? in Bipartition::Suppress: suppressing a non zero taxon\n";
+			exit(1);
 		}
+		mMask[w] &= ~suppressed;
 	}
 }
 
@@ -121,10 +141,10 @@ void Bipartition::PermutTaxa(int* permut)	{
 
 	int bk[Ntaxa];
 	for (int i=0; i<Ntaxa; i++)	{
-		bk[i] = mArray[i];
+		bk[i] = GetTaxonStatus(i);
 	}
 	for (int i=0; i<Ntaxa; i++)	{
-		mArray[permut[i]] = bk[i];
+		SetTaxonStatus(permut[i],bk[i]);
 	}	
 	Modulo();
 }
@@ -138,9 +158,7 @@ void Bipartition::PermutTaxa(int* permut)	{
 int Bipartition::CompareWith(const Bipartition& with) {
 
 	Bipartition bp(with.mParam);
-	for (int i=0; i<with.Ntaxa; i++)	{
-		bp.mArray[i] = -1;
-	}
+	bp.AllAbsent();
 	for (int i=0; i<Ntaxa; i++)	{
 		string name = mParam->SpeciesNames[i];
 		int k = 0;
@@ -152,7 +170,7 @@ int Bipartition::CompareWith(const Bipartition& with) {
 			// exit(1);
 		}
 		else	{
-			bp.mArray[k] = mArray[i];
+			bp.SetTaxonStatus(k,GetTaxonStatus(i));
 		}
 	}
 	return bp.IsCompatibleWith(with);
@@ -171,7 +189,7 @@ int Bipartition::SupportCheck(const Bipartition& with)	{
 			cerr << "error in Bipartition::SupportCheck: overflow\n";
 			exit(1);
 		}
-		bp.mArray[i] = with.mArray[k];
+		bp.SetTaxonStatus(i,with.GetTaxonStatus(k));
 	}
 	return bp == *this;
 }
@@ -206,9 +224,17 @@ int Bipartition::SupportCheck(BipartitionList* bplist)	{
 //		 GetTaxonStatus(int index)
 // ---------------------------------------------------------------------------------
 
-int	Bipartition::GetTaxonStatus(int index) {
+int	Bipartition::GetTaxonStatus(int index) const	{
 
-	return (index == -1) ? -3 : mArray[index];
+	if (index == -1)	{
+		return -3;
+	}
+	int w = index / wordsize;
+	unsigned long long bit = TaxonBit(index);
+	if (! (mMask[w] & bit))	{
+		return -1;
+	}
+	return (mSet[w] & bit) ? 1 : 0;
 }
 
 // ---------------------------------------------------------------------------------
@@ -216,12 +242,39 @@ int	Bipartition::GetTaxonStatus(int index) {
 // ---------------------------------------------------------------------------------
 
 void	Bipartition::SetTaxon(int index)	{
-	if (mArray[index] == -1)	{
+	if (GetTaxonStatus(index) == -1)	{
 		cerr << "error in Bipartition::SetTaxon\n";
 		exit(1);
 	}
 	else	{
-		mArray[index] = 1;
+		mSet[index / wordsize] |= TaxonBit(index);
+	}
+}
+
+// ---------------------------------------------------------------------------------
+//		 SetTaxonStatus(int index, int status)
+// ---------------------------------------------------------------------------------
+
+void	Bipartition::SetTaxonStatus(int index, int status)	{
+
+	int w = index / wordsize;
+	unsigned long long bit = TaxonBit(index);
+	if (status == -1)	{
+		mMask[w] &= ~bit;
+		mSet[w] &= ~bit;
+	}
+	else if ((status == 0) || (status == 1))	{
+		mMask[w] |= bit;
+		if (status)	{
+			mSet[w] |= bit;
+		}
+		else	{
+			mSet[w] &= ~bit;
+		}
+	}
+	else	{
+		cerr << "error in Bipartition::SetTaxonStatus: " << status << '\n';
+		exit(1);
 	}
 }
 
@@ -233,14 +286,13 @@ Boolean	Bipartition::operator==( const Bipartition& inPartition)	{
 
 	// assume they have the same TaxaParameters
 	// assume they are oriented the same way
-	Bipartition temp = inPartition;
-	Boolean test = true;
-	int i=0;
-	while (test && (i<Ntaxa))	{
-		test &= ((mArray[i] == -1) || (inPartition.mArray[i] == -1) || (mArray[i] == inPartition.mArray[i]));
-		i++;
+	// species eliminated in either of the two bipartitions are not compared
+	for (int w=0; w<Nword; w++)	{
+		if ((mSet[w] ^ inPartition.mSet[w]) & mMask[w] & inPartition.mMask[w])	{
+			return false;
+		}
 	}
-	return test;
+	return true;
 }
 
 
@@ -256,11 +308,49 @@ Bipartition::operator!=( const Bipartition& inPartition)	{
 }
 
 
+// ---------------------------------------------------------------------------------
+//		 IsComplete, IsIdenticalTo, GetHash
+// ---------------------------------------------------------------------------------
+
+Boolean	Bipartition::IsComplete() const	{
+
+	int n = 0;
+	for (int w=0; w<Nword; w++)	{
+		n += Popcount(mMask[w]);
+	}
+	return (n == Ntaxa);
+}
+
+Boolean	Bipartition::IsIdenticalTo(const Bipartition& with) const	{
+
+	for (int w=0; w<Nword; w++)	{
+		if ((mSet[w] != with.mSet[w]) || (mMask[w] != with.mMask[w]))	{
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned long long Bipartition::GetHash() const	{
+
+	// FNV-1a over the words
+	unsigned long long h = 14695981039346656037ULL;
+	for (int w=0; w<Nword; w++)	{
+		h ^= mSet[w];
+		h *= 1099511628211ULL;
+		h ^= mMask[w];
+		h *= 1099511628211ULL;
+	}
+	return h ^ (h >> 32);
+}
+
+
 double Bipartition::GetPriorProb()	{
 
-	int n1 = 0;
-	for (int k=0; k<Ntaxa; k++)	{
-		if (mArray[k])	n1++;
+	// eliminated species are counted with the downstream ones
+	int n1 = Ntaxa;
+	for (int w=0; w<Nword; w++)	{
+		n1 -= Popcount(mMask[w] & ~mSet[w]);
 	}
 	int n2 = Ntaxa - n1;
 	
@@ -281,25 +371,14 @@ double Bipartition::GetPriorProb()	{
 //		 IsCompatibleWith
 // ---------------------------------------------------------------------------------
 
+// over the species present in both bipartitions,
+// A and B are compatible iff one of the four intersections A.B, A.!B, !A.B or !A.!B is empty
+// (Orientation: A is included in B, or B in A)
+
 Boolean	Bipartition::IsCompatibleWith( const Bipartition& inPartition)	{
 	
-	// assume they have the same TaxaParameters
-	
-	Boolean test = false;
-	
-	Bipartition temp = *this;
-	temp &= inPartition;
-	test |= (temp == inPartition) || (temp == *this);
-	
-	if (! test)	{
-	
-		Bipartition NotThis = ! *this;
-		Bipartition temp2 = NotThis;
-		temp2 &= inPartition;
-		test |= (temp2 == inPartition) || (temp2 == NotThis);
-	}
-	
-	return test;
+	Boolean Orientation;
+	return IsCompatibleWith(inPartition,Orientation);
 }			
 
 
@@ -311,23 +390,22 @@ Boolean	Bipartition::IsCompatibleWith( const Bipartition& inPartition, Boolean&
 
 	// assume they have the same TaxaParameters
 
-	Boolean test = false;
-	Orientation = true;
-
-	Bipartition temp = *this;
-	temp &= inPartition;
-	test |= (temp == inPartition) || (temp == *this);
-
-	if (! test)	{
-	
-		Orientation = false;
-		Bipartition NotThis = ! *this;
-		Bipartition temp2 = NotThis;
-		temp2 &= inPartition;
-		test |= (temp2 == inPartition) || (temp2 == NotThis);
+	int n11 = 0;
+	int n10 = 0;
+	int n01 = 0;
+	int n00 = 0;
+	for (int w=0; w<Nword; w++)	{
+		unsigned long long mask = mMask[w] & inPartition.mMask[w];
+		unsigned long long a = mSet[w];
+		unsigned long long b = inPartition.mSet[w];
+		n11 += Popcount(a & b & mask);
+		n10 += Popcount(a & ~b & mask);
+		n01 += Popcount(~a & b & mask);
+		n00 += Popcount(~a & ~b & mask);
 	}
-	
-	return test;
+
+	Orientation = ((! n10) || (! n01));
+	return Orientation || (! n11) || (! n00);
 }			
 
 // ---------------------------------------------------------------------------------
@@ -337,10 +415,10 @@ Boolean	Bipartition::IsCompatibleWith( const Bipartition& inPartition, Boolean&
 Bipartition& Bipartition::operator|=( const Bipartition& inPartition)	{
 	
 	// assumes they are oriented likewise
-	for (int i=0; i<Ntaxa; i++)	{
-		if (mArray[i] != -1)	{
-			mArray[i]|=inPartition.mArray[i];
-		}
+	// species eliminated in inPartition are eliminated
+	for (int w=0; w<Nword; w++)	{
+		mMask[w] &= inPartition.mMask[w];
+		mSet[w] = (mSet[w] | inPartition.mSet[w]) & mMask[w];
 	}
 	
 	return *this;
@@ -353,10 +431,9 @@ Bipartition& Bipartition::operator|=( const Bipartition& inPartition)	{
 Bipartition& Bipartition::operator&=( const Bipartition& inPartition)	{
 	
 	// assumes they are oriented likewise
-	for (int i=0; i<Ntaxa; i++)	{
-		if (mArray[i] != -1)	{
-			mArray[i]&=inPartition.mArray[i];
-		}
+	// species eliminated in inPartition are left unchanged
+	for (int w=0; w<Nword; w++)	{
+		mSet[w] &= inPartition.mSet[w] | ~inPartition.mMask[w];
 	}
 	return *this;
 }
@@ -368,10 +445,8 @@ Bipartition& Bipartition::operator&=( const Bipartition& inPartition)	{
 Bipartition Bipartition::operator!()	{
 
 	Bipartition temp  = *this;
-	for (int i=0; i<Ntaxa; i++)	{
-		if (mArray[i] != -1)	{
-			temp.mArray[i] = 1 - mArray[i];
-		}
+	for (int w=0; w<Nword; w++)	{
+		temp.mSet[w] = mMask[w] & ~mSet[w];
 	}
 	return temp;
 }
@@ -383,46 +458,31 @@ Bipartition Bipartition::operator!()	{
 
 Boolean	Bipartition::IsInformative()	{
 
-	Boolean temp0 = false;
-	Boolean ret0 = false;
-	Boolean temp1 = false;
-	Boolean ret1 = false;
-	int i=0;
-	while (i<Ntaxa && ! (ret0 && ret1) )	{
-		int ind = mArray[i];
-		if (ind != -1)	{
-			if (temp0)	{
-				ret0 |= ind == 0;
-			}
-			temp0 |= ind == 0;
-
-			if (temp1)	{
-				ret1 |= ind == 1;
-			}
-			temp1 |= ind == 1;
-		}
-		i++;
+	int n1 = 0;
+	int n0 = 0;
+	for (int w=0; w<Nword; w++)	{
+		n1 += Popcount(mSet[w]);
+		n0 += Popcount(mMask[w] & ~mSet[w]);
 	}
-	return (ret0 && ret1);
+	return ((n0 >= 2) && (n1 >= 2));
 }
 
 // ---------------------------------------------------------------------------------
 //		 Modulo
 // ---------------------------------------------------------------------------------
 
+// canonical orientation: the first species that is not eliminated is upstream
+
 void
 Bipartition::Modulo()	{
 
-	int i=0;
-	while ((i<Ntaxa) && (mArray[i] == -1))	{
-		i++;
+	int w=0;
+	while ((w<Nword) && (! mMask[w]))	{
+		w++;
 	}
-	if (mArray[i] == 1)	{
-		while (i<Ntaxa)	{
-			if (mArray[i] != -1)	{
-				mArray[i] = 1 - mArray[i];
-			}
-			i++;
+	if ((w < Nword) && (mSet[w] & mMask[w] & (~mMask[w] + 1)))	{
+		for (; w<Nword; w++)	{
+			mSet[w] = mMask[w] & ~mSet[w];
 		}
 	}
 }
@@ -439,21 +499,21 @@ void	Bipartition::WriteToStream(ostream& os, int verbose)	{
 		int on = 0;
 		int off = 0;
 		for (int i=0; i<Ntaxa; i++)	{
-			if (mArray[i] == 1)	{
+			if (GetTaxonStatus(i) == 1)	{
 				on++;
 			}
-			else if (mArray[i] == 0)	{
+			else if (GetTaxonStatus(i) == 0)	{
 				off++;
 			}
 		}
 		for (int i=0; i<Ntaxa; i++)	{
 			if (on > off)	{
-				if (mArray[i] == 0)	{
+				if (GetTaxonStatus(i) == 0)	{
 					os << mParam->SpeciesNames[i] << '\n';
 				}
 			}
 			else	{
-				if (mArray[i] == 1)	{
+				if (GetTaxonStatus(i) == 1)	{
 					os << mParam->SpeciesNames[i] << '\n';
 				}
 			}
@@ -462,19 +522,15 @@ void	Bipartition::WriteToStream(ostream& os, int verbose)	{
 	else	{
 		for (int i=0; i<Ntaxa; i++)	{
 
-			if (mArray[i] ==-1)	{
+			int status = GetTaxonStatus(i);
+			if (status ==-1)	{
 				os << ' ';
 			}
-			else if (mArray[i] == 1)	{
+			else if (status == 1)	{
 				os << '*';
 			}
-			else if (mArray[i] == 0)	{
-				os << '.';
-			}
 			else	{
-				cerr << "error in Bipartition::WriteToStream(ostream& os)\n";
-				cerr << "found : " << mArray[i] << '\n'; 
-			exit(1);
+				os << '.';
 			}
 		}
 	}
@@ -491,4 +547,3 @@ void	Bipartition::ReadFromStream(istream& is)	{
 	is >> temp;
 	*this = temp;
 }
-
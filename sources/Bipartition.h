@@ -49,8 +49,9 @@ class Bipartition	{
 	void				Suppress(const Bipartition& leafset);
 
 	void				PermutTaxa(int* permut);
-	int				GetTaxonStatus(int index) ;
+	int				GetTaxonStatus(int index) const;
 	void				SetTaxon(int index);
+	void				SetTaxonStatus(int index, int status);
 
 	TaxaParameters*			GetParameters()	const;
 	
@@ -59,11 +60,21 @@ class Bipartition	{
 	double				GetPriorProb();
 	
 	void				Modulo();
-	
-	int*				mArray;
-			// -1 : species eliminated
-			// 0 : species upstream
-			// 1	: species downstream
+
+	// true if no species is eliminated
+	// (equality is then exact, and the bipartition can be hashed)
+	Boolean				IsComplete() const;
+	unsigned long long		GetHash() const;
+	Boolean				IsIdenticalTo(const Bipartition& with) const;
+
+	// status of species i:
+	// -1 : species eliminated		(bit i of mMask is 0)
+	// 0 : species upstream		(bit i of mMask is 1, bit i of mSet is 0)
+	// 1	: species downstream		(bit i of mMask is 1, bit i of mSet is 1)
+	// bits beyond Ntaxa are always 0
+	unsigned long long*		mSet;
+	unsigned long long*		mMask;
+	int				Nword;
 
 	TaxaParameters* 		mParam;
 	int				Ntaxa;
@@ -14,6 +14,20 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 **********************/
 
 #include "phylo.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+// indices sorted by decreasing value, in a stable way
+// (same order as the bubble sorts used before)
+struct DecreasingOrder	{
+
+	double* value;
+
+	bool operator()(int i, int j) const	{
+		return value[i] > value[j];
+	}
+};
 
 // ---------------------------------------------------------------------------------
 //		 BasicAllocation()
@@ -133,11 +147,8 @@ double BPCompare(string* ChainName, int P, int burnin, int every, int until, int
 	for (int k=0; k<bpsize; k++)	{
 		Bipartition bp = mergedbplist->GetBipartition(k);
 		for (int p=0; p<Q; p++)	{
-			int i = 0;
-			while ( (i < bplist[p]->GetSize()) && (bp != bplist[p]->GetBipartition(i)) )	{
-				i++;
-			}
-			if (i == bplist[p]->GetSize())	{
+			int i = bplist[p]->GetIndex(bp);
+			if (i == -1)	{
 				prob[p][k] = 0;
 				length[p][k] = 0;
 			}
@@ -204,15 +215,9 @@ double BPCompare(string* ChainName, int P, int burnin, int every, int until, int
 			for (int k=0; k<bpsize; k++)	{
 				permut[k] = k;
 			}
-			for (int i=0; i<bpsize; i++)	{
-				for (int j = bpsize-1; j>i; j--)	{
-					if (meanprob[permut[j]] > meanprob[permut[j-1]])	{
-						int tmp = permut[j];
-						permut[j] = permut[j-1];
-						permut[j-1] = tmp;
-					}
-				}
-			}
+			DecreasingOrder order;
+			order.value = meanprob;
+			stable_sort(permut, permut + bpsize, order);
 			if (! bench)	{
 				osp << "bipartition\tmaxdiff\tmeanprob\tprobs\tlengths\n";
 				osp << '\n';
@@ -244,15 +249,9 @@ double BPCompare(string* ChainName, int P, int burnin, int every, int until, int
 			for (int k=0; k<bpsize; k++)	{
 				permut[k] = k;
 			}
-			for (int i=0; i<bpsize; i++)	{
-				for (int j = bpsize-1; j>i; j--)	{
-					if (diff[permut[j]] > diff[permut[j-1]])	{
-						int tmp = permut[j];
-						permut[j] = permut[j-1];
-						permut[j-1] = tmp;
-					}
-				}
-			}
+			DecreasingOrder order;
+			order.value = diff;
+			stable_sort(permut, permut + bpsize, order);
 			if (! bench)	{
 				osp << "bipartition\tmaxdiff\tprobs\n";
 				osp << '\n';
@@ -370,6 +369,11 @@ void BipartitionList::BasicAllocation()	{
 	for (int i=0; i<mAllocatedSize; i++)	{
 		mBipartitionArray[i] = 0;
 	}
+
+	mHashTable = 0;
+	mHashSize = 0;
+	mNindexed = -1;
+	mNincomplete = 0;
 }
 
 // ---------------------------------------------------------------------------------
@@ -386,29 +390,130 @@ BipartitionList::BipartitionList(TaxaParameters* inParam)	{
 //		 BipartitionList(string filename)
 // ---------------------------------------------------------------------------------
 
+// read-only stream over a piece of memory
+class MemoryStreamBuffer : public streambuf	{
+
+	public:
+
+	MemoryStreamBuffer(const char* begin, const char* end)	{
+		setg((char*) begin, (char*) begin, (char*) end);
+	}
+};
+
+// a tree list read in memory in one go,
+// with the offset of each tree (trees are terminated by ';')
+class TreeListBuffer	{
+
+	public:
+
+	TreeListBuffer(string filename)	{
+
+		ifstream is(filename.c_str(), ios::in | ios::binary);
+		ostringstream os;
+		os << is.rdbuf();
+		buffer = os.str();
+
+		// number of words, as counted by reading them one after the other with >> until eof
+		// (see the default burnin)
+		nword = 0;
+		bool inword = false;
+		size_t start = string::npos;
+		for (size_t i=0; i<buffer.size(); i++)	{
+			char c = buffer[i];
+			bool space = ((c == ' ') || (c == '\n') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f'));
+			if ((! space) && (! inword))	{
+				nword++;
+			}
+			inword = ! space;
+			if ((! space) && (start == string::npos))	{
+				start = i;
+			}
+			if ((c == ';') && (start != string::npos))	{
+				begin.push_back(start);
+				end.push_back(i+1);
+				start = string::npos;
+			}
+		}
+		if (start != string::npos)	{
+			begin.push_back(start);
+			end.push_back(buffer.size());
+		}
+		if (! inword)	{
+			nword++;
+		}
+	}
+
+	int GetNtree() {return begin.size();}
+	int GetNword() {return nword;}
+
+	int ReadTree(int k, PBTree& tree)	{
+		MemoryStreamBuffer membuf(buffer.data() + begin[k], buffer.data() + end[k]);
+		istream is(&membuf);
+		return tree.ReadFromStream(is);
+	}
+
+	private:
+
+	string buffer;
+	vector<size_t> begin;
+	vector<size_t> end;
+	int nword;
+};
+
+// parses and prunes a series of trees of a tree list
+// (each tree into its own list of bipartitions, or into its root bipartition)
+class TreeListPruning : public ParallelTask	{
+
+	public:
+
+	TreeListPruning(TreeListBuffer* inbuffer, TaxaParameters* inparam, bool inrootonly, int* intreeindex) : buffer(inbuffer), param(inparam), rootonly(inrootonly), treeindex(intreeindex) {}
+
+	void Run(int begin, int end, int thread)	{
+		for (int i=begin; i<end; i++)	{
+			list[i] = 0;
+			rootbp[i] = 0;
+			PBTree tree(param);
+			if (buffer->ReadTree(treeindex[i],tree) && (tree.GetSize() == param->Ntaxa))	{
+				tree.RegisterWithParam(param);
+				if (rootonly)	{
+					rootbp[i] = new Bipartition(tree.GetRootBipartition());
+				}
+				else	{
+					list[i] = new BipartitionList(param);
+					tree.Trichotomise();
+					list[i]->Prune(&tree);
+				}
+			}
+		}
+	}
+
+	TreeListBuffer* buffer;
+	TaxaParameters* param;
+	bool rootonly;
+	int* treeindex;
+	BipartitionList** list;
+	Bipartition** rootbp;
+};
+
 BipartitionList::BipartitionList(string filename, int burnin, int every, int until, double cutoff, bool rootonly)	{
 
 	BasicAllocation();
 	
+	// the file is read only once
+	TreeListBuffer buffer(filename);
+
 	if (burnin <0)	{
 		if (burnin == -1)	{
 			burnin = -5;
 		}
-		ifstream is(filename.c_str());
-		int n = 0;
-		string tmp;
-		while (!is.eof())	{
-			is >> tmp;
-			n++;
-		}
+		int n = buffer.GetNword();
 		burnin = - n / burnin;
 	}
 			
-	ifstream is(filename.c_str());
 	PBTree tree;	
 	int size = 0;
 	Ntree = 0;
-	if (! tree.ReadFromStream(is))	{
+	if ((! buffer.GetNtree()) || (! buffer.ReadTree(0,tree)))	{
 		return;
 	}
 	size = 1;
@@ -430,30 +535,46 @@ BipartitionList::BipartitionList(string filename, int burnin, int every, int unt
 		}
 	}
 
-	while (! is.eof())	{
-		PBTree tree(mParam);
-		int noteof = tree.ReadFromStream(is);
-		if (noteof)	{
-			size++;
-			if (size > burnin)	{
-				cycle ++;
-				if (cycle == every)	{
-					cycle = 0;
-				}
-				if (((until == -1) || (size<=until)) && (! cycle) && (tree.GetSize() == mParam->Ntaxa))	{
-					tree.RegisterWithParam(mParam);
-					if (rootonly)	{
-						Bipartition tempbp = tree.GetRootBipartition();
-						Append2(tempbp,1,1);
-					}
-					else	{
-						BipartitionList tempList(mParam);
-						tree.Trichotomise();
-						tempList.Prune(&tree);
-						Append(&tempList);
-					}
-					Ntree++;
-				}
+	// the trees to be used are known in advance
+	// (the others are not parsed)
+	vector<int> treeindex;
+	for (int k=1; k<buffer.GetNtree(); k++)	{
+		size++;
+		if (size > burnin)	{
+			cycle ++;
+			if (cycle == every)	{
+				cycle = 0;
+			}
+			if (((until == -1) || (size<=until)) && (! cycle))	{
+				treeindex.push_back(k);
+			}
+		}
+	}
+
+	// trees are parsed and pruned in parallel, by batches
+	// and then merged in their order in the file (so that the result does not depend on the number of threads)
+	const int batchsize = 256;
+	BipartitionList* list[batchsize];
+	Bipartition* rootbp[batchsize];
+	for (unsigned int batch=0; batch<treeindex.size(); batch+=batchsize)	{
+		int n = treeindex.size() - batch;
+		if (n > batchsize)	{
+			n = batchsize;
+		}
+		TreeListPruning task(&buffer,mParam,rootonly,&treeindex[batch]);
+		task.list = list;
+		task.rootbp = rootbp;
+		ThreadPool::ParallelFor(task,0,n,1);
+		for (int i=0; i<n; i++)	{
+			if (rootbp[i])	{
+				Append2(*rootbp[i],1,1);
+				Ntree++;
+				delete rootbp[i];
+			}
+			if (list[i])	{
+				Append(list[i]);
+				Ntree++;
+				delete list[i];
 			}
 		}
 	}
@@ -488,9 +609,8 @@ int BipartitionList::IsEqualTo(BipartitionList* comp)	{
 	}
 	for (int i=0; i<comp->GetSize(); i++)	{
 		Bipartition bp = GetBipartition(i);
-		int k = 0;
-		while ((k<GetSize()) && (bp != comp->GetBipartition(k))) k++;
-		if (k == GetSize())	{
+		int k = comp->GetIndex(bp);
+		if (k == -1)	{
 			cerr << "comparing bplists: non matching bipartition\n";
 			equal = 0;
 		}
@@ -570,6 +690,7 @@ BipartitionList::~BipartitionList()	{
 	delete[] mWeightArray;
 	delete[] mLengthArray;
 	delete[] mCompatibleArray;
+	delete[] mHashTable;
 }
 
 		
@@ -579,27 +700,32 @@ BipartitionList::~BipartitionList()	{
 
 void BipartitionList::Sort()	{
 
-	for (int i=0; i< mSize-1; i++)	{
-		for (int j= mSize-1; i<j ; j--)		{
-			if (mWeightArray[j] > mWeightArray[j-1])	{
-
-				// swap the probs
-				double tmp = mWeightArray[j];
-				mWeightArray[j] = mWeightArray[j-1];
-				mWeightArray[j-1] = tmp;
-
-				//swap the mean lengths
-				tmp = mLengthArray[j];
-				mLengthArray[j] = mLengthArray[j-1];
-				mLengthArray[j-1] = tmp;
+	ClearIndex();
+	int* permut = new int[mSize];
+	for (int i=0; i<mSize; i++)	{
+		permut[i] = i;
+	}
+	DecreasingOrder order;
+	order.value = mWeightArray;
+	stable_sort(permut, permut + mSize, order);
 
-				// swap the bipartitions
-				Bipartition* Btemp = mBipartitionArray[j];
-				mBipartitionArray[j] = mBipartitionArray[j-1];
-				mBipartitionArray[j-1] = Btemp;
-			}
-		}
+	double* weight = new double[mSize];
+	double* length = new double[mSize];
+	Bipartition** bp = new Bipartition*[mSize];
+	for (int i=0; i<mSize; i++)	{
+		weight[i] = mWeightArray[permut[i]];
+		length[i] = mLengthArray[permut[i]];
+		bp[i] = mBipartitionArray[permut[i]];
+	}
+	for (int i=0; i<mSize; i++)	{
+		mWeightArray[i] = weight[i];
+		mLengthArray[i] = length[i];
+		mBipartitionArray[i] = bp[i];
 	}
+	delete[] permut;
+	delete[] weight;
+	delete[] length;
+	delete[] bp;
 }
 	
 // ---------------------------------------------------------------------------------
@@ -649,6 +775,7 @@ int BipartitionList::RegisterWith(TaxaParameters* inParam)	{
 	for (int i=0; i<mSize; i++)	{
 		mBipartitionArray[i]->PermutTaxa(permut);
 	}	
+	ClearIndex();
 	delete[] permut;
 	}
 	return ok;
@@ -669,6 +796,7 @@ void BipartitionList::Truncate(double cutoff)	{
 		mBipartitionArray[j] = 0;
 	}
 	mSize = i;
+	ClearIndex();
 }
 
 
@@ -679,6 +807,7 @@ void BipartitionList::Truncate(double cutoff)	{
 void BipartitionList::Flush(){
 	mSize = 0;
 	mWeight = 0;
+	ClearIndex();
 }
 	
 
@@ -693,6 +822,7 @@ void BipartitionList::Pop(){
 		exit(1);
 	}
 	mSize--;
+	ClearIndex();
 }
 	
 
@@ -705,6 +835,7 @@ void BipartitionList::Modulo()	{
 	for (int i=0; i<mSize; i++)	{
 		mBipartitionArray[i]->Modulo();
 	}
+	ClearIndex();
 }
 
 
@@ -715,23 +846,23 @@ void BipartitionList::Modulo()	{
 int BipartitionList::CheckForDuplicates()	{
 	int returnvalue = 0;
 	for (int i=0; i<mSize; i++)	{
-		for (int j=i+1; j<mSize; j++)	{
-			if ((*mBipartitionArray[i]) == (*mBipartitionArray[j]))	{
-				cerr << "error: found duplicates\n";
-				mBipartitionArray[i]->WriteToStream(cerr);
-				cerr << '\n';
-				mBipartitionArray[j]->WriteToStream(cerr);
-				cerr << '\n';
-				returnvalue = 1;
-			}
-			if ((*mBipartitionArray[i]) == !(*mBipartitionArray[j]))	{
-				cerr << "error: found symmetrical duplicates\n";
-				mBipartitionArray[i]->WriteToStream(cerr);
-				cerr << '\n';
-				mBipartitionArray[j]->WriteToStream(cerr);
-				cerr << '\n';
-				returnvalue = 1;
-			}
+		int j = GetIndex(*mBipartitionArray[i]);
+		if (j != i)	{
+			cerr << "error: found duplicates\n";
+			mBipartitionArray[j]->WriteToStream(cerr);
+			cerr << '\n';
+			mBipartitionArray[i]->WriteToStream(cerr);
+			cerr << '\n';
+			returnvalue = 1;
+		}
+		j = GetIndex(!(*mBipartitionArray[i]));
+		if (j > i)	{
+			cerr << "error: found symmetrical duplicates\n";
+			mBipartitionArray[i]->WriteToStream(cerr);
+			cerr << '\n';
+			mBipartitionArray[j]->WriteToStream(cerr);
+			cerr << '\n';
+			returnvalue = 1;
 		}
 	}
 	return returnvalue;
@@ -767,6 +898,7 @@ void BipartitionList::Suppress(const Bipartition& bp)	{
 	for (int i=0; i<mSize; i++)	{
 		mBipartitionArray[i]->Suppress(bp);
 	}
+	ClearIndex();
 }
 		
 
@@ -774,8 +906,61 @@ void BipartitionList::Suppress(const Bipartition& bp)	{
 //		 GetIndex()
 // ---------------------------------------------------------------------------------
 
+void BipartitionList::UpdateIndex()	{
+
+	// rebuild from scratch if the table was cleared or would be more than half full
+	if ((mNindexed == -1) || (2*mSize >= mHashSize))	{
+		if (2*mSize >= mHashSize)	{
+			delete[] mHashTable;
+			mHashSize = 1024;
+			while (2*mSize >= mHashSize)	{
+				mHashSize *= 2;
+			}
+			mHashTable = new int[mHashSize];
+		}
+		for (int h=0; h<mHashSize; h++)	{
+			mHashTable[h] = -1;
+		}
+		mNindexed = 0;
+		mNincomplete = 0;
+	}
+
+	for (int i=mNindexed; i<mSize; i++)	{
+		const Bipartition& bp = *mBipartitionArray[i];
+		if (! bp.IsComplete())	{
+			mNincomplete++;
+		}
+		// only the first of identical bipartitions is indexed
+		int h = bp.GetHash() & (mHashSize - 1);
+		while ((mHashTable[h] != -1) && (! mBipartitionArray[mHashTable[h]]->IsIdenticalTo(bp)))	{
+			h = (h + 1) & (mHashSize - 1);
+		}
+		if (mHashTable[h] == -1)	{
+			mHashTable[h] = i;
+		}
+	}
+	mNindexed = mSize;
+}
+
 int BipartitionList::GetIndex(const Bipartition& inPartition){
 	
+	if (mNindexed != mSize)	{
+		UpdateIndex();
+	}
+
+	// species eliminated in either bipartition are not compared by operator==
+	// so that the hash table can only be used if all are complete
+	if (inPartition.IsComplete() && (! mNincomplete))	{
+		int h = inPartition.GetHash() & (mHashSize - 1);
+		while (mHashTable[h] != -1)	{
+			if (mBipartitionArray[mHashTable[h]]->IsIdenticalTo(inPartition))	{
+				return mHashTable[h];
+			}
+			h = (h + 1) & (mHashSize - 1);
+		}
+		return -1;
+	}
+
 	int i=0;
 	while ( (i<mSize) && (*mBipartitionArray[i] != inPartition))	{
 		i++;
@@ -815,11 +1000,9 @@ void BipartitionList::Append(BipartitionList* inList)	{
 
 void BipartitionList::Append(Bipartition inPartition, double inWeight, double inLength)	{
 
-	int i=0;
-	while ( (i<mSize) && (*mBipartitionArray[i] != inPartition))	{
-		i++;
-	}
-	if (i == mSize)	{
+	int i = GetIndex(inPartition);
+	if (i == -1)	{
+		i = mSize;
 		mSize++;
 		if (mSize > mAllocatedSize)	{
 			Reallocate();
@@ -835,11 +1018,9 @@ void BipartitionList::Append(Bipartition inPartition, double inWeight, double in
 
 void BipartitionList::Append2(Bipartition inPartition, double inWeight, double inLength)	{
 
-	int i=0;
-	while ( (i<mSize) && (*mBipartitionArray[i] != inPartition))	{
-		i++;
-	}
-	if (i == mSize)	{
+	int i = GetIndex(inPartition);
+	if (i == -1)	{
+		i = mSize;
 		mSize++;
 		if (mSize > mAllocatedSize)	{
 			Reallocate();
@@ -884,11 +1065,7 @@ void BipartitionList::FastInsert(Bipartition inPartition, double weight, double
 void BipartitionList::Insert(Bipartition inPartition, double weight, double length)	{
 
 	if (CheckLevel)	{
-		int i=0;
-		while ( (i<mSize) && (*mBipartitionArray[i] != inPartition))	{
-			i++;
-		}
-		if (i != mSize)	{
+		if (GetIndex(inPartition) != -1)	{
 			cerr << "error : inserting an already existing bipartition\n";
 			exit(1);
 		}
@@ -996,6 +1173,7 @@ void BipartitionList::ReadFromStream(istream& is)	{
 			is >> temp >> size >> temp >> mWeight;
 			cerr << size << '\n';
 			mSize = 0;
+			ClearIndex();
 				
 			for (int i=0; i<size; i++)	{
 				double prob;
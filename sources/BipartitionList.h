@@ -50,6 +50,7 @@ class BipartitionList	{
 
 	// return the index of a bipartition
 	// return -1 if not found
+	// (hash lookup if the bipartition and all bipartitions of the list are complete, linear search otherwise)
 	int 				GetIndex(const Bipartition& inPartition);
 	
 	void				Sort();
@@ -99,6 +100,16 @@ class BipartitionList	{
 	int				mAllocatedSize;
 	static const int		basicsize = 100;
 	void				Reallocate();
+
+	// hash index of the bipartitions (open addressing, -1 : empty slot)
+	// only the first mNindexed bipartitions are in the table, the others are added lazily by UpdateIndex
+	// any operation modifying or reordering existing bipartitions should call ClearIndex (mNindexed = -1)
+	int*				mHashTable;
+	int				mHashSize;
+	int				mNindexed;
+	int				mNincomplete;
+	void				ClearIndex()	{mNindexed = -1;}
+	void				UpdateIndex();
 	
 }
 ;
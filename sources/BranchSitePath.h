@@ -19,70 +19,36 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
 #include <map>
+#include <vector>
 #include "Tree.h"
 #include "SubMatrix.h"
+#include "PathSuffStat.h"
 
-class Plink	{
-
-	friend class BranchSitePath;
-
-	public:
-
-				Plink();
-				Plink(int instate, double inrel_time);
-				~Plink();
-	Plink* 			Prev();
-	Plink* 			Next();
-
-	bool 			IsFirst();
-	bool 			IsLast();
-
-	void 			Splice();
-	void 			Insert(Plink* link);
-
-	void 			SetState(int instate);
-	int 			GetState();
-
-	void 			SetRelativeTime(double inrel_time);
-	double 			GetRelativeTime();
-
-	private:
-
-	Plink* next;
-	Plink* prev;
-	
-	int state;
-	double rel_time;
-
-};
+// substitution history of one site along one branch
+// stored as two contiguous arrays:
+// state[k] : k-th state visited along the branch (state[0] is the state at the top of the branch)
+// reltime[k] : time spent in state[k], relative to the length of the branch
+//
+// paths are never created directly:
+// they are first built into a PathBuilder,
+// and then copied into a PathPool, which owns all the paths of a cycle
 
 class BranchSitePath  {
 
-	public:
-
-				// special constructor: for Poisson processes (for which the detailed path does not matter,
-				// only the total number of substitutions and the final state)
-				BranchSitePath(int incount, int instate);
+	friend class PathPool;
 
-				BranchSitePath(int instate = -1);
-	virtual			~BranchSitePath();
-
-	Plink* 			Init();
-	Plink*  		Last();
-	int 			GetNsub();
-	int 			GetInitState();
-	int 			GetFinalState();
-	double 			GetRelativeTime(Plink* link) {return link->GetRelativeTime();}
+	public:
 
-	void 			Reset(int state);
-	void 			Append(int instate, double reltimelength);
+	int 			GetNsub() {return nsub;}
+	int 			GetNsegment() {return nsegment;}
+	int 			GetState(int k) {return state[k];}
+	double 			GetRelativeTime(int k) {return reltime[k];}
+	int 			GetInitState() {return state[0];}
+	int 			GetFinalState() {return state[nsegment-1];}
 
 	void 			Print(ostream& os)	{
-		Plink* link = Init();
-		while (link)	{
-			int state = link->GetState();
-			os << state << "  :  " << GetRelativeTime(link);
-			link = link->Next();
+		for (int k=0; k<nsegment; k++)	{
+			os << state[k] << "  :  " << reltime[k];
 		}
 		os << "\t:::\t" << GetNsub();
 		os << '\n';
@@ -94,181 +60,201 @@ class BranchSitePath  {
 	}
 
 	void AddRateSuffStat(int& count, double& beta, double factor, const double* rr, const double* stat, int nstate)	{
-		Plink* link = Init();
-		while (link)	{
-			int state = link->GetState();
+		for (int l=0; l<nsegment; l++)	{
+			int s = state[l];
 			double tmp = 0;
 			for (int k=0; k<nstate; k++)	{
-				if (k != state)	{
-					tmp += rr[rrindex(state,k,nstate)] * stat[k];
+				if (k != s)	{
+					tmp += rr[rrindex(s,k,nstate)] * stat[k];
 				}
 			}
-			beta += GetRelativeTime(link) * factor * tmp;
-			if (link != last)	{
-				count ++;
-			}
-			link = link->Next();
+			beta += reltime[l] * factor * tmp;
 		}
+		count += nsegment - 1;
 	}
 
 	void AddProfileSuffStat(int* count, double* beta, double factor, const double* rr, int nstate)	{
-		Plink* link = Init();
-		while (link)	{
-			int state = link->GetState();
+		for (int l=0; l<nsegment; l++)	{
+			int s = state[l];
 			for (int k=0; k<nstate; k++)	{
-				if (k!=state)	{
-					beta[k] += GetRelativeTime(link) * factor * rr[rrindex(state,k,nstate)];
+				if (k!=s)	{
+					beta[k] += reltime[l] * factor * rr[rrindex(s,k,nstate)];
 				}
 			}
-			if (link != last)	{
-				count[link->Next()->GetState()] ++;
+			if (l < nsegment-1)	{
+				count[state[l+1]] ++;
 			}
-			link = link->Next();
 		}
 	}
 
 	void AddRRSuffStat(int* count, double* beta, double factor, const double* stat, int nstate)	{
-		Plink* link = Init();
-		while (link)	{
-			int state = link->GetState();
+		for (int l=0; l<nsegment; l++)	{
+			int s = state[l];
 			for (int k=0; k<nstate; k++)	{
-				if (k!=state)	{
-					beta[rrindex(state,k,nstate)] += GetRelativeTime(link) * factor * stat[k];
+				if (k!=s)	{
+					beta[rrindex(s,k,nstate)] += reltime[l] * factor * stat[k];
 				}
 			}
-			if (link != last)	{
-				count[rrindex(state,link->Next()->GetState(),nstate)] ++;
+			if (l < nsegment-1)	{
+				count[rrindex(s,state[l+1],nstate)] ++;
 			}
-			link = link->Next();
 		}
 	}
 
 	void AddGeneralPathRateSuffStat(int& count, double& beta, double factor, SubMatrix* mat)	{
-		Plink* link = Init();
-		while (link)	{
-			int state = link->GetState();
-			beta -= GetRelativeTime(link) * factor * (*mat)(state,state);
-			if (link != last)	{
-				count ++;
-			}
-			link = link->Next();
+		for (int l=0; l<nsegment; l++)	{
+			int s = state[l];
+			beta -= reltime[l] * factor * (*mat)(s,s);
 		}
+		count += nsegment - 1;
 	}
 
-	void AddGeneralPathSuffStat(map<pair<int,int>,int>& paircount, map<int,double>& waitingtime, double factor)	{
-		Plink* link = Init();
-		while (link)	{
-			int state = link->GetState();
-			waitingtime[state] += GetRelativeTime(link) * factor;
-			if (link != last)	{
-				paircount[pair<int,int>(state,link->Next()->GetState())]++;
+	void AddGeneralPathSuffStat(PathSuffStat& suffstat, double factor)	{
+		for (int l=0; l<nsegment; l++)	{
+			int s = state[l];
+			suffstat.AddWaitingTime(s,reltime[l] * factor);
+			if (l < nsegment-1)	{
+				suffstat.AddPair(s,state[l+1]);
 			}
-			link = link->Next();
 		}
 	}
 
-	Plink* init;
-	Plink* last;
+	private:
+
+	// number of substitutions
+	// equal to nsegment-1, except for Poisson processes,
+	// for which only the number of substitutions and the final state are sampled
+	// (see PathPool::NewPath(int,int))
 	int nsub;
+	int nsegment;
+	int* state;
+	double* reltime;
+};
+
+// growable path, used as a scratch space while a path is being sampled
+// (the arrays are kept from one path to the next)
+
+class PathBuilder	{
+
+	public:
 
+	void Reset(int instate)	{
+		state.clear();
+		reltime.clear();
+		state.push_back(instate);
+		reltime.push_back(0);
+	}
+
+	// close the current segment (of relative length reltimelength)
+	// and open a new one in state instate
+	void Append(int instate, double reltimelength)	{
+		reltime.back() = reltimelength;
+		state.push_back(instate);
+		reltime.push_back(0);
+	}
+
+	void SetLastRelativeTime(double inreltime) {reltime.back() = inreltime;}
+	int GetFinalState() {return state.back();}
+	int GetNsub() {return state.size() - 1;}
+
+	private:
+
+	friend class PathPool;
+
+	vector<int> state;
+	vector<double> reltime;
 };
 
-//-------------------------------------------------------------------------
-//-------------------------------------------------------------------------
-//	* Inline definitions
-//-------------------------------------------------------------------------
-//-------------------------------------------------------------------------
+// slab allocator owning all the paths (and the per-branch arrays of paths) sampled during one cycle
+// memory is allocated by large chunks, and never given back to the system:
+// Reset releases all paths at once in O(1), and the chunks are then reused by the next cycle
+
+class PathPool	{
+
+	public:
 
+	PathPool() : current(0), offset(0), allocbytes(0) {}
 
-//-------------------------------------------------------------------------
-//	* Plink
-//-------------------------------------------------------------------------
+	~PathPool()	{
+		for (unsigned int c=0; c<chunk.size(); c++)	{
+			delete[] chunk[c];
+		}
+	}
 
-inline Plink::Plink() : next(0), prev(0), state(0), rel_time(0)  {}
-inline Plink::Plink(int instate, double inrel_time) : next(0), prev(0), state(instate), rel_time(inrel_time){}
-inline Plink::~Plink()	{Splice();}
+	// array of n (uninitialized) path pointers
+	BranchSitePath** NewPathArray(int n)	{
+		return (BranchSitePath**) Allocate(n * sizeof(BranchSitePath*));
+	}
 
-inline Plink* Plink::Prev() {return prev;}
-inline Plink* Plink::Next() {return next;}
+	// copy of a path built in a PathBuilder
+	BranchSitePath* NewPath(const PathBuilder& from)	{
+		int n = from.state.size();
+		BranchSitePath* path = AllocatePath(n);
+		for (int k=0; k<n; k++)	{
+			path->state[k] = from.state[k];
+			path->reltime[k] = from.reltime[k];
+		}
+		path->nsub = n - 1;
+		return path;
+	}
 
-inline bool Plink::IsFirst()	{return prev == 0;}
-inline bool Plink::IsLast() {return next == 0;}
+	// path without substitution (or, for Poisson processes, a number of substitutions and a final state)
+	BranchSitePath* NewPath(int instate, int innsub = 0)	{
+		BranchSitePath* path = AllocatePath(1);
+		path->state[0] = instate;
+		path->reltime[0] = 0;
+		path->nsub = innsub;
+		return path;
+	}
 
-inline void Plink::Insert(Plink* link)	{
-	link->next = next;
-	if (next)	{
-		next->prev = link;
+	void Reset()	{
+		current = 0;
+		offset = 0;
 	}
-	link->prev = this;
-	next = link;
-}
 
-inline void Plink::Splice()	{
-	if (prev)	{
-		prev->next = next;
+	// number of bytes allocated since the last call (counter is reset)
+	double GetAllocBytes()	{
+		double tmp = allocbytes;
+		allocbytes = 0;
+		return tmp;
 	}
-	if (next)	{
-		next->prev = prev;
+
+	private:
+
+	BranchSitePath* AllocatePath(int nsegment)	{
+		BranchSitePath* path = (BranchSitePath*) Allocate(sizeof(BranchSitePath));
+		path->nsegment = nsegment;
+		path->reltime = (double*) Allocate(nsegment * sizeof(double));
+		path->state = (int*) Allocate(nsegment * sizeof(int));
+		return path;
 	}
-	prev = next = 0;
-}
-
-inline void Plink::SetState(int instate) {state = instate;}
-inline void Plink::SetRelativeTime(double inrel_time) {rel_time = inrel_time;}
-inline double Plink::GetRelativeTime() {return rel_time;}
-inline int Plink::GetState() {return state;}
-
-//-------------------------------------------------------------------------
-//	* BranchSitePath
-//-------------------------------------------------------------------------
-
-inline Plink* BranchSitePath::Init() {return init;}
-inline Plink*  BranchSitePath::Last() {return last;}
-
-inline void BranchSitePath::Append(int instate, double reltimelength)	{
-	last->SetRelativeTime(reltimelength);
-	Plink* link = new Plink(instate,0);
-	last->Insert(link);
-	last = link;
-	nsub++;
-}	
-
-inline int BranchSitePath::GetNsub()	{
-	return nsub;
-}
-
-inline int BranchSitePath::GetInitState() {return init->GetState();}
-inline int BranchSitePath::GetFinalState() {return last->GetState();}
-
-
-inline BranchSitePath::BranchSitePath(int incount, int infinalstate)	{
-	init = last = new Plink;
-	init->SetState(infinalstate);
-	nsub = incount;
-}
-
-inline BranchSitePath::BranchSitePath(int instate)	{
-	init = last = new Plink;
-	init->SetState(instate);
-	nsub = 0;
-}
-
-inline BranchSitePath::~BranchSitePath()	{
-	Reset(0);
-	delete init;
-}
-
-inline void BranchSitePath::Reset(int state)	{
-	Plink* link=last;
-	while (link!=init)	{
-		Plink* prev = link->Prev();
-		delete link;
-		link = prev;
+
+	void* Allocate(size_t size)	{
+		// keep everything aligned on doubles
+		size = (size + align - 1) & ~(align - 1);
+		while ((current < chunk.size()) && (offset + size > chunksize[current]))	{
+			current++;
+			offset = 0;
+		}
+		if (current == chunk.size())	{
+			size_t newsize = (size > defaultchunksize) ? size : defaultchunksize;
+			chunk.push_back(new char[newsize]);
+			chunksize.push_back(newsize);
+			allocbytes += newsize;
+		}
+		void* ret = chunk[current] + offset;
+		offset += size;
+		return ret;
 	}
-	nsub = 0;
-	init->SetState(state);
-	init->SetRelativeTime(0);
-	last = init;
-}
+
+	static const size_t align = sizeof(double);
+	static const size_t defaultchunksize = 1 << 20;
+
+	vector<char*> chunk;
+	vector<size_t> chunksize;
+	unsigned int current;
+	size_t offset;
+	double allocbytes;
+};
 
 #endif 
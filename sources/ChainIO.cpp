@@ -0,0 +1,208 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "ChainIO.h"
+#include "IndexedRecordFile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+static const char chainmagic[8] = "PBCHAIN";
+static const char indexmagic[8] = "PBINDEX";
+static const int chainversion = 1;
+
+static const long long headersize = sizeof(chainmagic) + sizeof(int);
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//	* ChainWriter
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+
+void ChainWriter::Create(string name)	{
+
+	ofstream os((name + ".chain").c_str(), ios::out | ios::binary | ios::trunc);
+	if (! os)	{
+		cerr << "error: cannot create " << name << ".chain\n";
+		exit(1);
+	}
+	os.write(chainmagic, sizeof(chainmagic));
+	os.write((const char*) &chainversion, sizeof(int));
+	vector<long long> offset;
+	IndexedRecordFile::WriteIndex(os,headersize,offset,indexmagic);
+}
+
+ChainWriter::ChainWriter() : end(0)	{
+}
+
+ChainWriter::~ChainWriter()	{
+
+	if (IsOpen())	{
+		string error;
+		Close(error);
+	}
+}
+
+void ChainWriter::Open(string name, string& error)	{
+
+	filename = name + ".chain";
+	ifstream is(filename.c_str(), ios::in | ios::binary);
+	if (! is)	{
+		error = "error: cannot open " + filename;
+		return;
+	}
+	char magic[sizeof(chainmagic)];
+	int version = 0;
+	is.read(magic, sizeof(chainmagic));
+	is.read((char*) &version, sizeof(int));
+	if ((! is) || memcmp(magic,chainmagic,sizeof(chainmagic)) || (version != chainversion))	{
+		error = "error in ChainWriter::Open: " + filename + " is not a valid binary chain";
+		return;
+	}
+	// without a valid index (previous run killed), new records go after the last complete one
+	long long indexoffset;
+	if (IndexedRecordFile::ReadIndex(is,headersize,indexmagic,offset,indexoffset))	{
+		end = indexoffset;
+	}
+	else	{
+		end = IndexedRecordFile::ScanRecords(is,headersize,1,offset);
+	}
+	is.close();
+
+	// remove the index and the footer: until Close, readers rebuild the index from the records
+	if (truncate(filename.c_str(),end))	{
+		error = "error in ChainWriter::Open: cannot truncate " + filename;
+		return;
+	}
+	os.open(filename.c_str(), ios::out | ios::app | ios::binary);
+	if (! os)	{
+		error = "error: cannot open " + filename;
+	}
+}
+
+void ChainWriter::Append(string sample, string& error)	{
+
+	offset.push_back(end);
+	long long size = sample.size();
+	os.write((const char*) &size, sizeof(long long));
+	os.write(sample.data(), size);
+	end += sizeof(long long) + size;
+	if (! os)	{
+		error = "error in ChainWriter::Append: cannot write to " + filename;
+	}
+}
+
+void ChainWriter::Close(string& error)	{
+
+	IndexedRecordFile::WriteIndex(os,end,offset,indexmagic);
+	os.close();
+	if (! os)	{
+		error = "error in ChainWriter::Close: cannot write to " + filename;
+	}
+	offset.clear();
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//	* ChainReader
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+
+ChainReader::ChainReader(string name) : filename(name + ".chain"), indexed(false), current(0)	{
+
+	is.open(filename.c_str(), ios::in | ios::binary);
+	if (! is)	{
+		cerr << "error: no .chain file found\n";
+		exit(1);
+	}
+
+	char magic[sizeof(chainmagic)];
+	is.read(magic, sizeof(chainmagic));
+	if (is && (! memcmp(magic,chainmagic,sizeof(chainmagic))))	{
+		int version;
+		is.read((char*) &version, sizeof(int));
+		if (version != chainversion)	{
+			cerr << "error: " << filename << " : unknown binary chain format version " << version << '\n';
+			exit(1);
+		}
+		indexed = true;
+		ReadIndex();
+	}
+	else	{
+		// text chain: parse from the beginning
+		is.clear();
+		is.close();
+		is.open(filename.c_str());
+	}
+}
+
+ChainReader::~ChainReader()	{
+	is.close();
+}
+
+void ChainReader::ReadIndex()	{
+
+	long long indexoffset;
+	if (! IndexedRecordFile::ReadIndex(is,headersize,indexmagic,offset,indexoffset))	{
+		cerr << "warning: " << filename << " : no index (run killed, or still running), scanning records\n";
+		ScanRecords();
+	}
+}
+
+void ChainReader::ScanRecords()	{
+	IndexedRecordFile::ScanRecords(is,headersize,1,offset);
+}
+
+istream& ChainReader::GetNextSample()	{
+
+	if (! indexed)	{
+		current++;
+		return is;
+	}
+	if (current >= ((int) offset.size()))	{
+		cerr << "error in ChainReader: " << filename << " only has " << offset.size() << " samples\n";
+		exit(1);
+	}
+	long long size;
+	is.seekg(offset[current]);
+	is.read((char*) &size, sizeof(long long));
+	string buffer(size, ' ');
+	is.read(&buffer[0], size);
+	sample.clear();
+	sample.str(buffer);
+	current++;
+	return sample;
+}
+
+void ChainReader::SkipSample()	{
+
+	if (! indexed)	{
+		cerr << "error in ChainReader::SkipSample: text chains cannot be skipped\n";
+		exit(1);
+	}
+	current++;
+}
+
+void ChainReader::Seek(int i)	{
+
+	if (! indexed)	{
+		cerr << "error in ChainReader::Seek: text chains cannot be accessed randomly\n";
+		exit(1);
+	}
+	current = i;
+}
+
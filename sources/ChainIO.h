@@ -0,0 +1,116 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef CHAINIO_H
+#define CHAINIO_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// .chain files
+//
+// text format (default, -s):
+// samples written one after the other by Model::ToStream
+// reading sample i requires parsing all samples before it
+//
+// indexed binary format (-sb), see IndexedRecordFile.h:
+// header     : magic "PBCHAIN", format version (int)
+// records    : one per sample (same serialization as in the text format)
+// footer     : magic "PBINDEX"
+//
+// the writer keeps the index in memory: when a chain is opened for appending, its index and footer are removed,
+// and they are written back after the last record when the chain is closed
+// if the footer is missing or corrupted (e.g. run killed, or still running), the index is rebuilt by scanning the records
+
+class ChainWriter	{
+
+	public:
+
+	// create an empty binary chain
+	static void Create(string name);
+
+	ChainWriter();
+	// closes the chain if still open
+	~ChainWriter();
+
+	// the following functions do not exit on failure (they are called by the writer thread, see OutputWriter):
+	// error is then set to an error message
+
+	// open an existing binary chain for appending
+	void Open(string name, string& error);
+
+	bool IsOpen() {return os.is_open();}
+
+	// append a sample (after the last complete record)
+	void Append(string sample, string& error);
+
+	// write the index and the footer, and close the chain
+	void Close(string& error);
+
+	private:
+
+	string filename;
+	ofstream os;
+	vector<long long> offset;
+	// end of the last record
+	long long end;
+};
+
+class ChainReader	{
+
+	public:
+
+	// open name.chain (text or binary)
+	ChainReader(string name);
+	~ChainReader();
+
+	// true for binary chains: samples can then be skipped without being parsed
+	bool IsIndexed() {return indexed;}
+
+	// number of samples (binary chains only, -1 otherwise)
+	int GetSize() {return indexed ? ((int) offset.size()) : -1;}
+
+	// index of the next sample to be read
+	int GetCurrentIndex() {return current;}
+
+	// stream from which the next sample can be parsed (with FromStream)
+	istream& GetNextSample();
+
+	// skip the next sample (binary chains only)
+	void SkipSample();
+
+	// random access to sample i (binary chains only)
+	void Seek(int i);
+
+	private:
+
+	void ReadIndex();
+	void ScanRecords();
+
+	string filename;
+	ifstream is;
+	istringstream sample;
+	bool indexed;
+	int current;
+	vector<long long> offset;
+};
+
+#endif
+
@@ -60,11 +60,11 @@ int Chrono::operator++()	{
 }
 
 double Chrono::GetTime()	{
-	double tmp = ((double) (((long) (1000 * TotalTime)) / 1000));
-	if (tmp < 0)	{
-		cerr << "error : negative time : " << TotalTime << '\t' << 1000 * TotalTime << '\t' << (int) (1000 * TotalTime) << '\n';
+	if (TotalTime < 0)	{
+		cerr << "error : negative time : " << TotalTime << '\n';
 		exit(1);
 	}
+	return TotalTime;
 }
 
 double Chrono::GetTimePerCount()	{
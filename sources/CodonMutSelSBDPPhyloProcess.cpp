@@ -385,11 +385,7 @@ void CodonMutSelSBDPPhyloProcess::ReadPB(int argc, char* argv[])	{
 
 void CodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (! is)	{
-		cerr << "error: did not find " << name << ".chain\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	//cerr << "In CodonMutSelDPPhyloProcess. GetDim() is : " << GetDim() << "\n";
 	int Nstate = CodonMutSelSBDPSubstitutionProcess::GetNstate();
 	//cerr << "Nstate is: " << Nstate << "\n";
@@ -477,7 +473,7 @@ void CodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int u
 	while ((i < until) && (i < burnin))	{
 		cerr << ".";
 		cerr.flush();
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -485,7 +481,7 @@ void CodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int u
 		// cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		QuickUpdate();
 		//UpdateMatrices();
@@ -654,7 +650,7 @@ void CodonMutSelSBDPPhyloProcess::Read(string name, int burnin, int every, int u
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
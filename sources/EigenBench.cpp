@@ -0,0 +1,176 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+// micro-benchmark of the symmetric eigensolvers of LinAlg
+// on random mutation-selection codon matrices (61x61)
+//
+// for each solver: mean time per diagonalization,
+// and max reconstruction errors | u.diag(v).invu - Q | and | u.invu - I |
+
+#include "Parallel.h"
+MPI_Datatype Propagate_arg;
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#include "Random.h"
+#include "Chrono.h"
+#include "linalg.h"
+#include "CodonStateSpace.h"
+#include "CodonSubMatrix.h"
+
+static void Dirichlet(double* x, int dim, double alpha)	{
+	double total = 0;
+	for (int i=0; i<dim; i++)	{
+		x[i] = rnd::GetRandom().sGamma(alpha);
+		if (x[i] < 1e-50)	{
+			x[i] = 1e-50;
+		}
+		total += x[i];
+	}
+	for (int i=0; i<dim; i++)	{
+		x[i] /= total;
+	}
+}
+
+int main(int argc, char* argv[])	{
+
+	int nmatrix = 100;
+	int nrep = 10;
+	double alpha = 1.0;
+
+	int i = 1;
+	while (i < argc)	{
+		string s = argv[i];
+		if (s == "-n")	{
+			i++;
+			nmatrix = atoi(argv[i]);
+		}
+		else if (s == "-r")	{
+			i++;
+			nrep = atoi(argv[i]);
+		}
+		else if (s == "-a")	{
+			i++;
+			alpha = atof(argv[i]);
+		}
+		else	{
+			cerr << "eigenbench [-n <nmatrix>] [-r <nrep>] [-a <alpha>]\n";
+			cerr << "\t-n : number of random codon matrices (default 100)\n";
+			cerr << "\t-r : number of times each matrix is diagonalized (default 10)\n";
+			cerr << "\t-a : concentration of the random amino-acid profiles (default 1)\n";
+			exit(1);
+		}
+		i++;
+	}
+
+	CodonStateSpace* statespace = new CodonStateSpace(Universal);
+	int nstate = statespace->GetNstate();
+	int Nnucrr = Nnuc * (Nnuc-1) / 2;
+
+	// random matrices
+	double** Q = new double*[nmatrix];
+	double** pi = new double*[nmatrix];
+	double* nucrr = new double[Nnucrr];
+	double* nucstat = new double[Nnuc];
+	double* codonprofile = new double[nstate];
+	double* aaprofile = new double[Naa];
+	double omega = 1.0;
+	for (int m=0; m<nmatrix; m++)	{
+		Dirichlet(nucrr,Nnucrr,1.0);
+		Dirichlet(nucstat,Nnuc,1.0);
+		Dirichlet(codonprofile,nstate,10.0);
+		Dirichlet(aaprofile,Naa,alpha);
+		omega = rnd::GetRandom().sGamma(1.0);
+		AACodonMutSelProfileSubMatrix* mat = new AACodonMutSelProfileSubMatrix(statespace,nucrr,nucstat,codonprofile,aaprofile,&omega,true);
+		Q[m] = new double[nstate*nstate];
+		pi[m] = new double[nstate];
+		const double* stat = mat->GetStationary();
+		for (int a=0; a<nstate; a++)	{
+			pi[m][a] = stat[a];
+			for (int b=0; b<nstate; b++)	{
+				Q[m][a*nstate + b] = (*mat)(a,b);
+			}
+		}
+		delete mat;
+	}
+
+	double** q = new double*[nstate];
+	double** u = new double*[nstate];
+	double** invu = new double*[nstate];
+	for (int a=0; a<nstate; a++)	{
+		q[a] = new double[nstate];
+		u[a] = new double[nstate];
+		invu[a] = new double[nstate];
+	}
+	double* v = new double[nstate];
+
+	const int nsolver = 3;
+	string solvername[nsolver] = {"QR","QL","LAPACK"};
+
+	cout << "solver\ttime (ms)\terr Q\terr I\n";
+	for (int solver=0; solver<nsolver; solver++)	{
+#ifndef LINALG_LAPACK
+		if (solver == LinAlg::LAPACKSOLVER)	{
+			cout << solvername[solver] << "\tnot compiled (make EIGEN=lapack)\n";
+			continue;
+		}
+#endif
+		LinAlg::eigensolver = solver;
+		Chrono chrono;
+		double errQ = 0;
+		double errI = 0;
+		bool failed = false;
+		for (int m=0; m<nmatrix; m++)	{
+			for (int a=0; a<nstate; a++)	{
+				for (int b=0; b<nstate; b++)	{
+					q[a][b] = Q[m][a*nstate + b];
+				}
+			}
+			chrono.Start();
+			for (int rep=0; rep<nrep; rep++)	{
+				int n = LinAlg::DiagonalizeRateMatrix(q,pi[m],nstate,v,u,invu,1000,1e-20);
+				failed |= (n == 1000);
+			}
+			chrono.Stop();
+
+			for (int a=0; a<nstate; a++)	{
+				for (int b=0; b<nstate; b++)	{
+					double totQ = 0;
+					double totI = 0;
+					for (int k=0; k<nstate; k++)	{
+						totQ += u[a][k] * v[k] * invu[k][b];
+						totI += u[a][k] * invu[k][b];
+					}
+					if (errQ < fabs(totQ - q[a][b]))	{
+						errQ = fabs(totQ - q[a][b]);
+					}
+					if (errI < fabs(totI - (a == b)))	{
+						errI = fabs(totI - (a == b));
+					}
+				}
+			}
+		}
+		cout << solvername[solver] << '\t' << chrono.GetTime() / nmatrix / nrep << '\t' << errQ << '\t' << errI;
+		if (failed)	{
+			cout << "\tFAILED";
+		}
+		cout << '\n';
+	}
+}
+
@@ -110,14 +110,20 @@ void ExpoConjugateGTRPhyloProcess::UpdateBranchLengthSuffStat()	{
 
 void ExpoConjugateGTRPhyloProcess::UpdateSiteProfileSuffStat()	{
 
-	for (int i=sitemin; i<sitemax; i++)	{
+	MethodLoop<ExpoConjugateGTRPhyloProcess> loop(this,&ExpoConjugateGTRPhyloProcess::UpdateSiteProfileSuffStat);
+	RunSiteLoop(loop);
+}
+
+void ExpoConjugateGTRPhyloProcess::UpdateSiteProfileSuffStat(int begin, int end)	{
+
+	for (int i=begin; i<end; i++)	{
 		for (int k=0; k<GetDim(); k++)	{
 			siteprofilesuffstatcount[i][k] = 0;
 			siteprofilesuffstatbeta[i][k] = 0;
 		}
 	}
 	for (int j=0; j<GetNbranch(); j++)	{
-		AddSiteProfileSuffStat(siteprofilesuffstatcount,siteprofilesuffstatbeta,submap[j],blarray[j], (j == 0));
+		AddSiteProfileSuffStat(siteprofilesuffstatcount,siteprofilesuffstatbeta,submap[j],blarray[j], (j == 0),begin,end);
 	}
 }
 
@@ -128,7 +134,7 @@ void ExpoConjugateGTRPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 	// slaves should call : UpdateSiteProfileSuffStat
 	// then collect all suff stats
 	assert(myid == 0);
-	int i,j,k,l,width,nalloc,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
+	int i,j,k,l,nalloc,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
 	MPI_Status stat;
 	MESSAGE signal = UPDATE_SPROFILE;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
@@ -141,12 +147,10 @@ void ExpoConjugateGTRPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 	// each slave computes its array for sitemin <= site < sitemax
 	// thus, one just needs to gather all arrays into the big master array 0 <= site < Nsite
 	// (gather)
-	width = GetNsite()/(nprocs-1);
 	nalloc = 0;
 	for(i=0; i<nprocs-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (nprocs-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		workload[i] = (smax[i] - smin[i])*GetNstate();
 		if (workload[i] > nalloc) nalloc = workload[i];
 	}
@@ -67,6 +67,8 @@ class ExpoConjugateGTRPhyloProcess : public virtual GTRPhyloProcess, public virt
 	void UpdateBranchLengthSuffStat();
 	void UpdateRRSuffStat();
 	void UpdateSiteProfileSuffStat();
+	// sites [begin,end) only (one block of the thread pool)
+	void UpdateSiteProfileSuffStat(int begin, int end);
 
 	int GlobalCountMapping();
 	int CountMapping();
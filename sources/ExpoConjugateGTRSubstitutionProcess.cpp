@@ -54,17 +54,17 @@ void ExpoConjugateGTRSubstitutionProcess::AddBranchLengthSuffStat(int& count, do
 	}
 }
 
-void ExpoConjugateGTRSubstitutionProcess::AddSiteProfileSuffStat(int** siteprofilesuffstatcount, double** siteprofilesuffstatbeta, BranchSitePath** patharray, double branchlength, bool isroot)	{
+void ExpoConjugateGTRSubstitutionProcess::AddSiteProfileSuffStat(int** siteprofilesuffstatcount, double** siteprofilesuffstatbeta, BranchSitePath** patharray, double branchlength, bool isroot, int begin, int end)	{
 	if (!isroot)	{
 		// non root case
-		for (int i=sitemin; i<sitemax; i++)	{
+		for (int i=begin; i<end; i++)	{
 		// for (int i=0; i<GetNsite(); i++)	{
 			patharray[i]->AddProfileSuffStat(siteprofilesuffstatcount[i],siteprofilesuffstatbeta[i],GetRate(i)*branchlength,GetRR(),GetNstate(i));
 		}
 	}
 	else	{
 		// root case
-		for (int i=sitemin; i<sitemax; i++)	{
+		for (int i=begin; i<end; i++)	{
 		// for (int i=0; i<GetNsite(); i++)	{
 			siteprofilesuffstatcount[i][patharray[i]->GetInitState()]++;
 		}
@@ -46,7 +46,7 @@ class ExpoConjugateGTRSubstitutionProcess : public virtual GTRSubstitutionProces
 	void AddRRSuffStat(int* rrsuffstatcount, double* rrsuffstatbeta, BranchSitePath** patharray, double branchlength);
 
 	void AddBranchLengthSuffStat(int& count, double& beta, BranchSitePath** patharray);
-	void AddSiteProfileSuffStat(int** siteprofilesuffstatcount, double** siteprofilesuffstatbeta, BranchSitePath** patharray, double branchlength, bool isroot);
+	void AddSiteProfileSuffStat(int** siteprofilesuffstatcount, double** siteprofilesuffstatbeta, BranchSitePath** patharray, double branchlength, bool isroot, int begin, int end);
 
 };
 
@@ -0,0 +1,114 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+// stochastic mappings of readpb_mpi -map are stored in a single name.maps file (see MappingIO.h)
+// extractmap writes them back as one text file per site, name_<site>.map:
+// for each sample, the posterior mapping, the posterior predictive mapping, and an empty line
+
+#include "Parallel.h"
+MPI_Datatype Propagate_arg;
+
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+#include "MappingIO.h"
+
+// number of site files open at the same time
+const int MaxOpenFiles = 256;
+
+int main(int argc, char* argv[])	{
+
+	string name = "";
+	int site = -1;
+
+	try	{
+		if (argc == 1)	{
+			throw(0);
+		}
+		int i = 1;
+		while (i < argc)	{
+			string s = argv[i];
+			if (s == "-s")	{
+				if (i+1 >= argc)	{
+					throw(0);
+				}
+				i++;
+				site = atoi(argv[i]);
+			}
+			else	{
+				if (i != (argc-1))	{
+					throw(0);
+				}
+				name = argv[i];
+			}
+			i++;
+		}
+		if (name == "")	{
+			throw(0);
+		}
+	}
+	catch(...)	{
+		cerr << "extractmap [-s <site>] <chainname>\n";
+		cerr << "\twrites the stochastic mappings of <chainname>.maps into one file per site, <chainname>_<site>.map\n";
+		cerr << "\t-s <site> : only this site (numbered from 0)\n";
+		cerr << '\n';
+		exit(1);
+	}
+
+	MappingReader reader(name);
+	int sitemin = 0;
+	int sitemax = reader.GetNsite();
+	if (site != -1)	{
+		if ((site < 0) || (site >= reader.GetNsite()))	{
+			cerr << "error: site " << site << " out of range (" << reader.GetNsite() << " sites)\n";
+			exit(1);
+		}
+		sitemin = site;
+		sitemax = site + 1;
+	}
+
+	// sites are done in groups, so that each record is read only once per group
+	for (int begin=sitemin; begin<sitemax; begin+=MaxOpenFiles)	{
+		int end = begin + MaxOpenFiles;
+		if (end > sitemax)	{
+			end = sitemax;
+		}
+		ofstream* os = new ofstream[end-begin];
+		for (int i=begin; i<end; i++)	{
+			ostringstream s;
+			s << name << '_' << i << ".map";
+			os[i-begin].open(s.str().c_str());
+			if (! os[i-begin])	{
+				cerr << "error: cannot create " << s.str() << '\n';
+				exit(1);
+			}
+		}
+		for (int record=0; record<reader.GetSize(); record++)	{
+			for (int i=begin; i<end; i++)	{
+				os[i-begin] << reader.GetSiteMapping(record,i);
+				if (record % 2)	{
+					os[i-begin] << '\n';
+				}
+			}
+		}
+		delete[] os;
+	}
+	cerr << reader.GetSize() / 2 << " samples, mappings in " << name << "_<site>.map\n";
+}
+
@@ -89,6 +89,19 @@ class GTRProfileProcess : public virtual MatrixProfileProcess {
 	virtual void Create(int innsite, int indim);
 	virtual void Delete();
 
+	virtual int GetNmatrixGlobal()	{
+		if (! rr)	{
+			return -1;
+		}
+		return Nrr;
+	}
+
+	virtual void GetMatrixGlobal(double* x)	{
+		for (int i=0; i<Nrr; i++)	{
+			x[i] = rr[i];
+		}
+	}
+
 	// relative rates
 	virtual double LogRRPrior();
 	virtual void SampleRR();
@@ -16,6 +16,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include "GeneralPathSuffStatMatrixMixtureProfileProcess.h"
 #include "Random.h"
+#include "ThreadPool.h"
 
 //-------------------------------------------------------------------------
 //-------------------------------------------------------------------------
@@ -24,36 +25,27 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 //-------------------------------------------------------------------------
 
 void GeneralPathSuffStatMatrixMixtureProfileProcess::Create(int innsite, int indim)	{
-	if (! profilepaircount)	{
+	if (! profilepathsuffstat)	{
 		MatrixMixtureProfileProcess::Create(innsite,indim);
-		profilepaircount = new map< pair<int,int>, int>[GetNmodeMax()];
-		profilewaitingtime = new map<int,double>[GetNmodeMax()];
-		profilerootcount = new map<int,int>[GetNmodeMax()];
+		profilepathsuffstat = new PathSuffStat[GetNmodeMax()];
 	}
 }
 
 void GeneralPathSuffStatMatrixMixtureProfileProcess::Delete() {
-	if (profilepaircount)	{
-		delete[] profilepaircount;
-		delete[] profilerootcount;
-		delete[] profilewaitingtime;
-		profilepaircount = 0;
-		profilerootcount = 0;
-		profilewaitingtime = 0;
+	if (profilepathsuffstat)	{
+		delete[] profilepathsuffstat;
+		profilepathsuffstat = 0;
 		MatrixMixtureProfileProcess::Delete();
 	}
 }
 
 void GeneralPathSuffStatMatrixMixtureProfileProcess::UpdateModeProfileSuffStat()	{
 	for (int i=0; i<GetNcomponent(); i++)	{
-		profilepaircount[i].clear();
-		profilerootcount[i].clear();
-		profilewaitingtime[i].clear();
+		profilepathsuffstat[i].Clear();
 	}
 	for (int i=0; i<GetNsite(); i++)	{
 		
-		map<pair<int,int>, int>& paircount = GetSitePairCount(i);
-		map<int,double>& waitingtime = GetSiteWaitingTime(i);
+		PathSuffStat& suffstat = GetSitePathSuffStat(i);
 		int rootstate = GetSiteRootState(i);
 		/*
 		if (rootstate < 0)	{
@@ -63,13 +55,8 @@ void GeneralPathSuffStatMatrixMixtureProfileProcess::UpdateModeProfileSuffStat()
 		}
 		*/
 		int cat = alloc[i];
-		profilerootcount[cat][rootstate]++;
-		for (map<int,double>::iterator i = waitingtime.begin(); i!= waitingtime.end(); i++)	{
-			profilewaitingtime[cat][i->first] += i->second;
-		}
-		for (map<pair<int,int>, int>::iterator i = paircount.begin(); i!= paircount.end(); i++)	{
-			profilepaircount[cat][i->first] += i->second;
-		}
+		profilepathsuffstat[cat].Add(suffstat);
+		profilepathsuffstat[cat].AddRootState(rootstate);
 	}
 }
 
@@ -83,59 +70,131 @@ double GeneralPathSuffStatMatrixMixtureProfileProcess::ProfileSuffStatLogProb(in
 		exit(1);
 	}
 	const double* stat = matrixarray[cat]->GetStationary();
-	for (map<int,int>::iterator i = profilerootcount[cat].begin(); i!= profilerootcount[cat].end(); i++)	{
-		total += i->second * log(stat[i->first]);
+	PathSuffStat& suffstat = profilepathsuffstat[cat];
+	for (int k=0; k<suffstat.GetNroot(); k++)	{
+		total += suffstat.GetRootCount(k) * log(stat[suffstat.GetRootState(k)]);
 	}
-	for (map<int,double>::iterator i = profilewaitingtime[cat].begin(); i!= profilewaitingtime[cat].end(); i++)	{
-		total += i->second * (*mat)(i->first,i->first);
+	for (int k=0; k<suffstat.GetNvisited(); k++)	{
+		int state = suffstat.GetVisitedState(k);
+		total += suffstat.GetWaitingTime(state) * (*mat)(state,state);
 	}
-	for (map<pair<int,int>, int>::iterator i = profilepaircount[cat].begin(); i!= profilepaircount[cat].end(); i++)	{
-		total += i->second * log((*mat)(i->first.first, i->first.second));
+	for (int k=0; k<suffstat.GetNpair(); k++)	{
+		total += suffstat.GetPairCount(k) * log((*mat)(suffstat.GetPairFrom(k), suffstat.GetPairTo(k)));
 	}
 	profilesuffstatlogprob[cat] = total;
 	return total;
 }
 
-void GeneralPathSuffStatMatrixMixtureProfileProcess::SwapComponents(int cat1, int cat2)	{
-
-	MatrixMixtureProfileProcess::SwapComponents(cat1,cat2);
+// global moves (nucleotide rates, omega, etc.) call UpdateMatrices, which only corrupts the matrices
+// the matrices are then rebuilt on demand while computing the suffstat log probs
+// each thread working on its own components (a matrix only reads the global parameters)
+// log probs are summed in component order, whatever the number of threads
+double GeneralPathSuffStatMatrixMixtureProfileProcess::ProfileSuffStatLogProb()	{
+	MethodLoop<GeneralPathSuffStatMatrixMixtureProfileProcess> loop(this,&GeneralPathSuffStatMatrixMixtureProfileProcess::ComponentSuffStatLogProb);
+	ThreadPool::ParallelFor(loop,0,GetNcomponent(),1);
+	double total = 0;
+	for (int i=0; i<GetNcomponent(); i++)	{
+		total += profilesuffstatlogprob[i];
+	}
+	return total;
+}
 
-	// booh! inefficient copies!
-	//cerr << "swap in general path suff stat matrix mixture profile process\n";
-	//exit(1);
+void GeneralPathSuffStatMatrixMixtureProfileProcess::ComponentSuffStatLogProb(int begin, int end)	{
+	for (int cat=begin; cat<end; cat++)	{
+		ProfileSuffStatLogProb(cat);
+	}
+}
 
-	map<int,int> roottmp = profilerootcount[cat1];
-	profilerootcount[cat1] = profilerootcount[cat2];
-	profilerootcount[cat2] = roottmp;
+void GeneralPathSuffStatMatrixMixtureProfileProcess::SwapComponents(int cat1, int cat2)	{
 
-	map<int,double> timetmp = profilewaitingtime[cat1];
-	profilewaitingtime[cat1] = profilewaitingtime[cat2];
-	profilewaitingtime[cat2] = timetmp;
+	MatrixMixtureProfileProcess::SwapComponents(cat1,cat2);
 
-	map<pair<int,int>,int> pairtmp = profilepaircount[cat1];
-	profilepaircount[cat1] = profilepaircount[cat2];
-	profilepaircount[cat2] = pairtmp;
+	profilepathsuffstat[cat1].Swap(profilepathsuffstat[cat2]);
 }
 
 
 double GeneralPathSuffStatMatrixMixtureProfileProcess::LogStatProb(int site, int cat)	{
 	double total = 0;
 	SubMatrix* mat = matrixarray[cat];
-	const double* stat = matrixarray[cat]->GetStationary();
-	total += log(stat[GetSiteRootState(site)]);
+	total += mat->GetLogStationary()[GetSiteRootState(site)];
 
-	map<int,double>& waitingtime = GetSiteWaitingTime(site);
-	for (map<int,double>::iterator i = waitingtime.begin(); i!= waitingtime.end(); i++)	{
-		total += i->second * (*mat)(i->first,i->first);
+	PathSuffStat& suffstat = GetSitePathSuffStat(site);
+	for (int k=0; k<suffstat.GetNvisited(); k++)	{
+		int state = suffstat.GetVisitedState(k);
+		total += suffstat.GetWaitingTime(state) * (*mat)(state,state);
 	}
-
-	map<pair<int,int>, int>& paircount = GetSitePairCount(site);
-	for (map<pair<int,int>, int>::iterator i = paircount.begin(); i!= paircount.end(); i++)	{
-		total += i->second * log((*mat)(i->first.first, i->first.second));
+	for (int k=0; k<suffstat.GetNpair(); k++)	{
+		total += suffstat.GetPairCount(k) * mat->GetLogRow(suffstat.GetPairFrom(k))[suffstat.GetPairTo(k)];
 	}
 	return total;
 }
 
+// all components in one pass over the site suffstats:
+// for each term, the inner loop runs over components and only reads the cached log tables of the matrices
+// (terms are added in the same order as in LogStatProb)
+void GeneralPathSuffStatMatrixMixtureProfileProcess::LogStatProbArray(int site, int ncat, double* logprob)	{
+
+	int rootstate = GetSiteRootState(site);
+	for (int cat=0; cat<ncat; cat++)	{
+		logprob[cat] = matrixarray[cat]->GetLogStationary()[rootstate];
+	}
+
+	PathSuffStat& suffstat = GetSitePathSuffStat(site);
+	for (int k=0; k<suffstat.GetNvisited(); k++)	{
+		int state = suffstat.GetVisitedState(k);
+		double time = suffstat.GetWaitingTime(state);
+		for (int cat=0; cat<ncat; cat++)	{
+			logprob[cat] += time * (*matrixarray[cat])(state,state);
+		}
+	}
+	for (int k=0; k<suffstat.GetNpair(); k++)	{
+		int from = suffstat.GetPairFrom(k);
+		int to = suffstat.GetPairTo(k);
+		int count = suffstat.GetPairCount(k);
+		for (int cat=0; cat<ncat; cat++)	{
+			logprob[cat] += count * matrixarray[cat]->GetLogRow(from)[to];
+		}
+	}
+}
+
+
+// one block of sites of LogStatProbTable
+class LogStatProbLoop : public ParallelTask	{
+
+	public:
+
+	GeneralPathSuffStatMatrixMixtureProfileProcess* process;
+	int first;
+	int ncat;
+	double* logprob;
+
+	void Run(int begin, int end, int thread)	{
+		for (int site=begin; site<end; site++)	{
+			process->LogStatProbArray(site,ncat,logprob + (site-first)*ncat);
+		}
+	}
+};
+
+// sites are shared out among the threads of the pool
+// which then only read the log tables of the matrices: these are all computed beforehand
+void GeneralPathSuffStatMatrixMixtureProfileProcess::LogStatProbTable(int begin, int end, int ncat, double* logprob)	{
+
+	for (int cat=0; cat<ncat; cat++)	{
+		SubMatrix* mat = matrixarray[cat];
+		mat->GetLogStationary();
+		for (int k=0; k<mat->GetNstate(); k++)	{
+			mat->GetLogRow(k);
+		}
+	}
+
+	LogStatProbLoop loop;
+	loop.process = this;
+	loop.first = begin;
+	loop.ncat = ncat;
+	loop.logprob = logprob;
+	int blocksize = (end - begin) / (8 * ThreadPool::GetNthread());
+	ThreadPool::ParallelFor(loop,begin,end,(blocksize < 16) ? 16 : blocksize);
+}
 
 void GeneralPathSuffStatMatrixMixtureProfileProcess::AddSite(int site, int cat)	{
 	alloc[site] = cat;
@@ -24,7 +24,7 @@ class GeneralPathSuffStatMatrixMixtureProfileProcess : public virtual MatrixMixt
 
 	public:
 
-	GeneralPathSuffStatMatrixMixtureProfileProcess() : profilerootcount(0), profilepaircount(0) , profilewaitingtime(0) {}
+	GeneralPathSuffStatMatrixMixtureProfileProcess() : profilepathsuffstat(0) {}
 	virtual ~GeneralPathSuffStatMatrixMixtureProfileProcess() {}
 
 	protected:
@@ -37,12 +37,10 @@ class GeneralPathSuffStatMatrixMixtureProfileProcess : public virtual MatrixMixt
 		SampleStat(k);
 		// useful?
 		if (activesuffstat)	{
-			profilepaircount[k].clear();
-			profilerootcount[k].clear();
-			profilewaitingtime[k].clear();
+			profilepathsuffstat[k].Clear();
 		}
 		CreateMatrix(k);
-		UpdateMatrix(k);
+		UpdateComponentMatrix(k);
 	}
 
 	virtual void DeleteComponent(int k)	{
@@ -52,7 +50,7 @@ class GeneralPathSuffStatMatrixMixtureProfileProcess : public virtual MatrixMixt
 	// update component k (in particular, will be used for updating the matrix
 	// typically, after the profile has changed)
 	virtual void UpdateComponent(int k)	{
-		UpdateMatrix(k);
+		UpdateComponentMatrix(k);
 	}
 
 	// necessary to keep track of componentwise sufficient statistics 
@@ -64,17 +62,22 @@ class GeneralPathSuffStatMatrixMixtureProfileProcess : public virtual MatrixMixt
 	void UpdateModeProfileSuffStat();
 
 	double ProfileSuffStatLogProb(int cat);
+	// over all components, spread over the thread pool
+	double ProfileSuffStatLogProb();
+	// components [begin,end) only (one block of the thread pool)
+	void ComponentSuffStatLogProb(int begin, int end);
 	void SwapComponents(int cat1, int cat2);
 
 	virtual double LogStatProb(int site, int cat);
+	virtual void LogStatProbArray(int site, int ncat, double* logprob);
+	virtual void LogStatProbTable(int begin, int end, int ncat, double* logprob);
+	friend class LogStatProbLoop;
 
 	// implemented in phyloprocess
 	// virtual double logSiteProbPath(int site, SubMatrix* mat) = 0;
 
 	// componentwise
-	map<int,int>* profilerootcount;
-	map< pair<int,int>, int>* profilepaircount;
-	map<int,double>* profilewaitingtime;
+	PathSuffStat* profilepathsuffstat;
 
 };
 
@@ -25,23 +25,15 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 void GeneralPathSuffStatMatrixOneProfileProcess::UpdateProfileSuffStat()	{
 
-	profilepaircount.clear();
-	profilerootcount.clear();
-	profilewaitingtime.clear();
+	profilepathsuffstat.Clear();
 
 	for (int i=0; i<GetNsite(); i++)	{
 		
-		map<pair<int,int>, int>& paircount = GetSitePairCount(i);
-		map<int,double>& waitingtime = GetSiteWaitingTime(i);
+		PathSuffStat& suffstat = GetSitePathSuffStat(i);
 		int rootstate = GetSiteRootState(i);
 
-		profilerootcount[rootstate]++;
-		for (map<int,double>::iterator i = waitingtime.begin(); i!= waitingtime.end(); i++)	{
-			profilewaitingtime[i->first] += i->second;
-		}
-		for (map<pair<int,int>, int>::iterator i = paircount.begin(); i!= paircount.end(); i++)	{
-			profilepaircount[i->first] += i->second;
-		}
+		profilepathsuffstat.Add(suffstat);
+		profilepathsuffstat.AddRootState(rootstate);
 	}
 }
 
@@ -53,14 +45,15 @@ double GeneralPathSuffStatMatrixOneProfileProcess::ProfileSuffStatLogProb()	{
 		exit(1);
 	}
 	const double* stat = matrix->GetStationary();
-	for (map<int,int>::iterator i = profilerootcount.begin(); i!= profilerootcount.end(); i++)	{
-		total += i->second * log(stat[i->first]);
+	for (int k=0; k<profilepathsuffstat.GetNroot(); k++)	{
+		total += profilepathsuffstat.GetRootCount(k) * log(stat[profilepathsuffstat.GetRootState(k)]);
 	}
-	for (map<int,double>::iterator i = profilewaitingtime.begin(); i!= profilewaitingtime.end(); i++)	{
-		total += i->second * (*mat)(i->first,i->first);
+	for (int k=0; k<profilepathsuffstat.GetNvisited(); k++)	{
+		int state = profilepathsuffstat.GetVisitedState(k);
+		total += profilepathsuffstat.GetWaitingTime(state) * (*mat)(state,state);
 	}
-	for (map<pair<int,int>, int>::iterator i = profilepaircount.begin(); i!= profilepaircount.end(); i++)	{
-		total += i->second * log((*mat)(i->first.first, i->first.second));
+	for (int k=0; k<profilepathsuffstat.GetNpair(); k++)	{
+		total += profilepathsuffstat.GetPairCount(k) * log((*mat)(profilepathsuffstat.GetPairFrom(k), profilepathsuffstat.GetPairTo(k)));
 	}
 	return total;
 }
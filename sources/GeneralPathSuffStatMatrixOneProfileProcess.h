@@ -34,9 +34,7 @@ class GeneralPathSuffStatMatrixOneProfileProcess : public virtual MatrixOneProfi
 
 	double ProfileSuffStatLogProb();
 
-	map<int,int> profilerootcount;
-	map< pair<int,int>, int> profilepaircount;
-	map<int,double> profilewaitingtime;
+	PathSuffStat profilepathsuffstat;
 
 };
 
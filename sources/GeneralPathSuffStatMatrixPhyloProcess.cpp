@@ -85,41 +85,46 @@ void GeneralPathSuffStatMatrixPhyloProcess::GlobalUnfold()	{
 void GeneralPathSuffStatMatrixPhyloProcess::CreateSuffStat()	{
 
 	PhyloProcess::CreateSuffStat();
-	if (sitepaircount)	{
+	if (sitepathsuffstat)	{
 		cerr << "error in PhyloProcess::CreateSuffStat\n";
 		exit(1);
 	}
 	siterootstate = new int[GetNsite()];
-	sitepaircount = new map<pair<int,int>, int>[GetNsite()];
-	sitewaitingtime = new map<int,double>[GetNsite()];
+	sitepathsuffstat = new PathSuffStat[GetNsite()];
+	for (int i=0; i<GetNsite(); i++)	{
+		sitepathsuffstat[i].Create(GetNstate());
+	}
 }
 
 void GeneralPathSuffStatMatrixPhyloProcess::DeleteSuffStat()	{
 
 	/*
-	if (!sitepaircount)	{
+	if (!sitepathsuffstat)	{
 		cerr << "error in PhyloProcess::DeleteSuffStat\n";
 		// exit(1);
 	}
 	*/
 	delete[] siterootstate;
-	delete[] sitepaircount;
-	delete[] sitewaitingtime;
+	delete[] sitepathsuffstat;
 	siterootstate = 0;
-	sitepaircount = 0;
-	sitewaitingtime = 0;
+	sitepathsuffstat = 0;
 	PhyloProcess::DeleteSuffStat();
 }
 
 void GeneralPathSuffStatMatrixPhyloProcess::UpdateSiteProfileSuffStat()	{
 
-	for (int i=sitemin; i<sitemax; i++)	{
-		sitepaircount[i].clear();
-		sitewaitingtime[i].clear();
+	MethodLoop<GeneralPathSuffStatMatrixPhyloProcess> loop(this,&GeneralPathSuffStatMatrixPhyloProcess::UpdateSiteProfileSuffStat);
+	RunSiteLoop(loop);
+}
+
+void GeneralPathSuffStatMatrixPhyloProcess::UpdateSiteProfileSuffStat(int begin, int end)	{
+
+	for (int i=begin; i<end; i++)	{
+		sitepathsuffstat[i].Clear();
 	}
 
 	for (int j=0; j<GetNbranch(); j++)	{
-		AddSiteProfileSuffStat(siterootstate,sitepaircount,sitewaitingtime,submap[j],blarray[j],(j == 0));
+		AddSiteProfileSuffStat(siterootstate,sitepathsuffstat,submap[j],blarray[j],(j == 0),begin,end);
 	}
 }
 
@@ -159,8 +164,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::UpdateBranchLengthSuffStat()	{
 void GeneralPathSuffStatMatrixPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 
 	for (int i=0; i<GetNsite(); i++)	{
-		sitepaircount[i].clear();
-		sitewaitingtime[i].clear();
+		sitepathsuffstat[i].Clear();
 	}
 
 	// MPI2
@@ -168,7 +172,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 	// slaves should call : UpdateSiteProfileSuffStat
 	// then collect all suff stats
 	assert(myid == 0);
-	int width,inalloc,dnalloc,smin[nprocs-1],smax[nprocs-1],iworkload[nprocs-1],dworkload[nprocs-1];
+	int inalloc,dnalloc,smin[nprocs-1],smax[nprocs-1],iworkload[nprocs-1],dworkload[nprocs-1];
 	MPI_Status stat;
 	MESSAGE signal = UPDATE_SPROFILE;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
@@ -181,13 +185,11 @@ void GeneralPathSuffStatMatrixPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 	// each slave computes its array for sitemin <= site < sitemax
 	// thus, one just needs to gather all arrays into the big master array 0 <= site < Nsite
 	// (gather)
-	width = GetNsite()/(nprocs-1);
 	inalloc = 0;
 	dnalloc = 0;
 	for(int i=0; i<nprocs-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (nprocs-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		// workload[i] = (smax[i] - smin[i])*(GetNstate()*GetNstate()*sizeof(int) + GetNstate()*sizeof(double));
 		iworkload[i] = (smax[i] - smin[i])*(GetNstate()*GetNstate() + 1);
 		if (iworkload[i] > inalloc) inalloc = iworkload[i];
@@ -215,7 +217,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 			for(int k=0; k<GetNstate(); ++k) {
 				for(int l=0; l<GetNstate(); ++l) {
 					if (ivector[m])	{
-						sitepaircount[j][pair<int,int>(k,l)] = ivector[m];
+						sitepathsuffstat[j].AddPair(k,l,ivector[m]);
 					}
 					iivector[im] = ivector[m];
 					m++;
@@ -232,7 +234,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 		for(int j=smin[i-1]; j<smax[i-1]; ++j) {
 			for(int k=0; k<GetNstate(); ++k) {
 				if (dvector[m])	{
-					sitewaitingtime[j][k] = dvector[m];
+					sitepathsuffstat[j].AddWaitingTime(k,dvector[m]);
 				}
 				ddvector[dm] = dvector[m];
 				m++;
@@ -271,12 +273,15 @@ void GeneralPathSuffStatMatrixPhyloProcess::SlaveUpdateSiteProfileSuffStat()	{
 	for(int j=sitemin; j<sitemax; ++j) {
 		ivector[m] = siterootstate[j];
 		m++;
-		for(int k=0; k<GetNstate(); ++k) {
-			for(int l=0; l<GetNstate(); ++l) {
-				ivector[m] = sitepaircount[j][pair<int,int>(k,l)];
-				m++;
-			}
+		int* pairvector = ivector + m;
+		for(int k=0; k<GetNstate()*GetNstate(); ++k) {
+			pairvector[k] = 0;
 		}
+		PathSuffStat& suffstat = sitepathsuffstat[j];
+		for (int k=0; k<suffstat.GetNpair(); k++)	{
+			pairvector[suffstat.GetPairFrom(k)*GetNstate() + suffstat.GetPairTo(k)] = suffstat.GetPairCount(k);
+		}
+		m += GetNstate()*GetNstate();
 	}
 	if (m != iworkload)	{
 		cerr << "count error\n";
@@ -288,7 +293,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::SlaveUpdateSiteProfileSuffStat()	{
 	m = 0;
 	for(int j=sitemin; j<sitemax; ++j) {
 		for(int k=0; k<GetNstate(); ++k) {
-			dvector[m] = sitewaitingtime[j][k];
+			dvector[m] = sitepathsuffstat[j].GetWaitingTime(k);
 			m++;
 		}
 	}
@@ -299,8 +304,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::SlaveUpdateSiteProfileSuffStat()	{
 	MPI_Send(dvector,dworkload,MPI_DOUBLE,0,TAG1,MPI_COMM_WORLD);
 
 	for (int i=0; i<GetNsite(); i++)	{
-		sitepaircount[i].clear();
-		sitewaitingtime[i].clear();
+		sitepathsuffstat[i].Clear();
 	}
 
 	int iload = GetNsite() * (GetNstate()*GetNstate() + 1);
@@ -318,7 +322,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::SlaveUpdateSiteProfileSuffStat()	{
 		for(int k=0; k<GetNstate(); ++k) {
 			for(int l=0; l<GetNstate(); ++l) {
 				if (iivector[im])	{
-					sitepaircount[j][pair<int,int>(k,l)] = iivector[im];
+					sitepathsuffstat[j].AddPair(k,l,iivector[im]);
 				}
 				im++;
 			}
@@ -329,7 +333,7 @@ void GeneralPathSuffStatMatrixPhyloProcess::SlaveUpdateSiteProfileSuffStat()	{
 	for(int j=0; j<GetNsite(); j++)	{
 		for(int k=0; k<GetNstate(); ++k) {
 			if (ddvector[dm])	{
-				sitewaitingtime[j][k] = ddvector[dm];
+				sitepathsuffstat[j].AddWaitingTime(k,ddvector[dm]);
 			}
 			dm++;
 		}
@@ -357,12 +361,6 @@ void GeneralPathSuffStatMatrixPhyloProcess::SlaveUpdateSiteProfileSuffStat()	{
 int GeneralPathSuffStatMatrixPhyloProcess::CountMapping(int i)	{
 	cerr << "in count mapping\n";
 	exit(1);
-	int count = 0;
-	for(int k=0; k<GetNstate(i); ++k) {
-		for(int l=0; l<GetNstate(i); ++l) {
-			count+=sitepaircount[i][pair<int,int>(k,l)];
-		}
-	}
-	return count;
+	return sitepathsuffstat[i].GetTotalPairCount();
 }
 
@@ -24,7 +24,7 @@ class GeneralPathSuffStatMatrixPhyloProcess : public virtual MatrixPhyloProcess,
 
 	public:
 
-	GeneralPathSuffStatMatrixPhyloProcess() : siterootstate(0), sitepaircount(0), sitewaitingtime(0) {}
+	GeneralPathSuffStatMatrixPhyloProcess() : siterootstate(0), sitepathsuffstat(0) {}
 	virtual ~GeneralPathSuffStatMatrixPhyloProcess() {}
 
 	// this is the log of the site likelihood?
@@ -46,9 +46,8 @@ class GeneralPathSuffStatMatrixPhyloProcess : public virtual MatrixPhyloProcess,
 	void Unfold();
 	void Collapse();
 
-	map<pair<int,int>,int>& GetSitePairCount(int site) {return sitepaircount[site];}
+	PathSuffStat& GetSitePathSuffStat(int site) {return sitepathsuffstat[site];}
 	int GetSiteRootState(int site) {return siterootstate[site];}
-	map<int,double>& GetSiteWaitingTime(int site) {return sitewaitingtime[site];}
 
 	// should also create the matrices
 	void GlobalUnfold();
@@ -63,14 +62,15 @@ class GeneralPathSuffStatMatrixPhyloProcess : public virtual MatrixPhyloProcess,
 	void UpdateSiteRateSuffStat();
 	void UpdateBranchLengthSuffStat();
 	void UpdateSiteProfileSuffStat();
+	// sites [begin,end) only (one block of the thread pool)
+	void UpdateSiteProfileSuffStat(int begin, int end);
 
 	int CountMapping(int site);
 	// int CountMapping();
 	// int GlobalCountMapping();
 
 	int* siterootstate;
-	map< pair<int,int>, int>* sitepaircount;
-	map<int,double>* sitewaitingtime;
+	PathSuffStat* sitepathsuffstat;
 	
 };
 
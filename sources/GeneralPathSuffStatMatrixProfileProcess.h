@@ -18,6 +18,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 #define GENPATHSSMATPROFILE_H
 
 #include "MatrixProfileProcess.h"
+#include "PathSuffStat.h"
 
 // superclass for all matrix implementations using generic sufficient statistics
 // generic sufficient statistics are: total time in each state, number of transitions between each pair of states, number of times in each state at the root
@@ -30,8 +31,8 @@ class GeneralPathSuffStatMatrixProfileProcess : public virtual MatrixProfileProc
 
 	// will be implemented in phyloprocess
 	// return the sufficient statistics for a given site
-	virtual map<pair<int,int>,int>& GetSitePairCount(int site) = 0;
-	virtual map<int,double>& GetSiteWaitingTime(int site) = 0;
+	// (pair counts and waiting times)
+	virtual PathSuffStat& GetSitePathSuffStat(int site) = 0;
 	virtual int GetSiteRootState(int site) = 0;
 
 };
@@ -36,18 +36,18 @@ void GeneralPathSuffStatMatrixSubstitutionProcess::AddSiteRateSuffStat(int* site
 	}
 }
 
-void GeneralPathSuffStatMatrixSubstitutionProcess::AddSiteProfileSuffStat(int* siterootstate, map<pair<int,int>, int>* sitepaircount, map<int,double>* sitewaitingtime, BranchSitePath** patharray, double branchlength, bool isroot)	{
+void GeneralPathSuffStatMatrixSubstitutionProcess::AddSiteProfileSuffStat(int* siterootstate, PathSuffStat* sitepathsuffstat, BranchSitePath** patharray, double branchlength, bool isroot, int begin, int end)	{
 	if (!isroot)	{
 		// non root case
-		for (int i=sitemin; i<sitemax; i++)	{
+		for (int i=begin; i<end; i++)	{
 		// for (int i=0; i<GetNsite(); i++)	{
 			// patharray[i]->AddGeneralPathSuffStat(sitepaircount[i], sitewaitingtime[i], efflength);
-			patharray[i]->AddGeneralPathSuffStat(sitepaircount[i],sitewaitingtime[i],GetRate(i)*branchlength);
+			patharray[i]->AddGeneralPathSuffStat(sitepathsuffstat[i],GetRate(i)*branchlength);
 		}
 	}
 	else	{
 		// root case
-		for (int i=sitemin; i<sitemax; i++)	{
+		for (int i=begin; i<end; i++)	{
 		// for (int i=0; i<GetNsite(); i++)	{
 			siterootstate[i] = patharray[i]->GetInitState();
 		}
@@ -31,7 +31,7 @@ class GeneralPathSuffStatMatrixSubstitutionProcess : public virtual MatrixSubsti
 	void AddBranchLengthSuffStat(int& count, double& beta, BranchSitePath** patharray);
 	void AddSiteRateSuffStat(int* count, double* beta, BranchSitePath** patharray, double length);
 	// void AddSiteProfileSuffStat(int& siterootstate, map<pair<int,int>, int>& sitepaircount, map<int,double>& sitewaitingtime, BranchSitePath* path, double efflength, bool isroot);
-	void AddSiteProfileSuffStat(int* siterootstate, map<pair<int,int>, int>* sitepaircount, map<int,double>* sitewaitingtime, BranchSitePath** patharray, double branchlength, bool isroot);
+	void AddSiteProfileSuffStat(int* siterootstate, PathSuffStat* sitepathsuffstat, BranchSitePath** patharray, double branchlength, bool isroot, int begin, int end);
 
 };
 
@@ -0,0 +1,77 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "IndexedRecordFile.h"
+
+#include <cstring>
+
+static const long long footersize = 2*sizeof(long long) + IndexedRecordFile::MagicSize;
+
+void IndexedRecordFile::WriteIndex(ostream& os, long long indexoffset, const vector<long long>& offset, const char* magic)	{
+
+	long long n = offset.size();
+	if (n)	{
+		os.write((const char*) &offset[0], n * sizeof(long long));
+	}
+	os.write((const char*) &indexoffset, sizeof(long long));
+	os.write((const char*) &n, sizeof(long long));
+	os.write(magic, MagicSize);
+}
+
+bool IndexedRecordFile::ReadIndex(istream& is, long long headersize, const char* magic, vector<long long>& offset, long long& indexoffset)	{
+
+	is.seekg(0, ios::end);
+	long long filesize = is.tellg();
+	long long n = -1;
+	char filemagic[MagicSize];
+	indexoffset = 0;
+	if (filesize >= headersize + footersize)	{
+		is.seekg(-footersize, ios::end);
+		is.read((char*) &indexoffset, sizeof(long long));
+		is.read((char*) &n, sizeof(long long));
+		is.read(filemagic, MagicSize);
+	}
+	if ((! is) || (n < 0) || memcmp(filemagic,magic,MagicSize) || (indexoffset + n * ((long long) sizeof(long long)) + footersize != filesize))	{
+		is.clear();
+		return false;
+	}
+	offset.resize(n);
+	is.seekg(indexoffset);
+	if (n)	{
+		is.read((char*) &offset[0], n * sizeof(long long));
+	}
+	return true;
+}
+
+long long IndexedRecordFile::ScanRecords(istream& is, long long headersize, long long minsize, vector<long long>& offset)	{
+
+	is.seekg(0, ios::end);
+	long long filesize = is.tellg();
+	offset.clear();
+	long long pos = headersize;
+	while (pos + (long long) sizeof(long long) <= filesize)	{
+		long long size;
+		is.seekg(pos);
+		is.read((char*) &size, sizeof(long long));
+		if ((! is) || (size < minsize) || (pos + (long long) sizeof(long long) + size > filesize))	{
+			break;
+		}
+		offset.push_back(pos);
+		pos += sizeof(long long) + size;
+	}
+	is.clear();
+	return pos;
+}
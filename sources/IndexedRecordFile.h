@@ -0,0 +1,54 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef INDEXEDRECORDFILE_H
+#define INDEXEDRECORDFILE_H
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// binary files made of indexed records (.chain files written with -sb, see ChainIO.h, and .maps files, see MappingIO.h)
+//
+// header     : specific to each format, of fixed size
+// records    : for each record, its size in bytes (long long), followed by the record itself
+// index      : offset of each record in the file (long long)
+// footer     : offset of the index, number of records (long long), magic (8 chars, specific to each format)
+//
+// the index and the footer are written last: if they are missing or corrupted (e.g. program killed while writing),
+// the index can be rebuilt by scanning the records
+// numbers are stored in the native byte order of the machine
+
+class IndexedRecordFile	{
+
+	public:
+
+	static const int MagicSize = 8;
+
+	// write the index and the footer
+	static void WriteIndex(ostream& os, long long indexoffset, const vector<long long>& offset, const char* magic);
+
+	// read the footer and the index
+	// returns false if they are missing or corrupted (the stream is then cleared)
+	static bool ReadIndex(istream& is, long long headersize, const char* magic, vector<long long>& offset, long long& indexoffset);
+
+	// rebuild the index from the records, which are contiguous after the header
+	// stops at the first incomplete record, or at the first record smaller than minsize bytes
+	// returns the end of the last complete record
+	static long long ScanRecords(istream& is, long long headersize, long long minsize, vector<long long>& offset);
+};
+
+#endif
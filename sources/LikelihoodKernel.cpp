@@ -0,0 +1,529 @@
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+#include "LikelihoodKernel.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PB_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+//-------------------------------------------------------------------------
+//	* scalar versions
+//	(same order of operations as the original loops)
+//-------------------------------------------------------------------------
+
+static void ScalarMultiply(double* to, const double* from, int n)	{
+	for (int k=0; k<n; k++)	{
+		to[k] *= from[k];
+	}
+}
+
+static double ScalarSum(const double* x, int n)	{
+	double tot = 0;
+	for (int k=0; k<n; k++)	{
+		tot += x[k];
+	}
+	return tot;
+}
+
+static double ScalarDot(const double* x, const double* y, int n)	{
+	double tot = 0;
+	for (int k=0; k<n; k++)	{
+		tot += x[k] * y[k];
+	}
+	return tot;
+}
+
+static void ScalarScale(double* x, double a, int n)	{
+	for (int k=0; k<n; k++)	{
+		x[k] *= a;
+	}
+}
+
+static void ScalarAffine(double* y, const double* x, double a, double b, int n)	{
+	for (int k=0; k<n; k++)	{
+		y[k] = a * x[k] + b;
+	}
+}
+
+static void ScalarMatVec(const double* mat, int ld, const double* x, double* y, int n)	{
+	for (int k=0; k<n; k++)	{
+		y[k] = 0;
+	}
+	for (int l=0; l<n; l++)	{
+		const double* row = mat + l*ld;
+		double a = x[l];
+		for (int k=0; k<n; k++)	{
+			y[k] += a * row[k];
+		}
+	}
+}
+
+static bool ScalarRange(const double* x, int n, double& min, double& max)	{
+	bool ok = true;
+	min = x[0];
+	max = x[0];
+	for (int k=0; k<n; k++)	{
+		if (isnan(x[k]))	{
+			ok = false;
+		}
+		if (min > x[k])	{
+			min = x[k];
+		}
+		if (max < x[k])	{
+			max = x[k];
+		}
+	}
+	return ok;
+}
+
+#ifdef PB_X86_KERNELS
+
+// the generic MatVec accumulate the output vector by chunks of MatVecChunk entries (a multiple of 8)
+// so that the accumulator has a fixed size on the stack, whatever the leading dimension
+static const int MatVecChunk = 64;
+
+//-------------------------------------------------------------------------
+//	* AVX2 versions (4 doubles per register)
+//-------------------------------------------------------------------------
+
+__attribute__((target("avx2,fma")))
+static void AVX2Multiply(double* to, const double* from, int n)	{
+	int k = 0;
+	for (; k+4<=n; k+=4)	{
+		_mm256_storeu_pd(to+k, _mm256_mul_pd(_mm256_loadu_pd(to+k), _mm256_loadu_pd(from+k)));
+	}
+	for (; k<n; k++)	{
+		to[k] *= from[k];
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static double AVX2HorizontalSum(__m256d v)	{
+	__m128d lo = _mm256_castpd256_pd128(v);
+	__m128d hi = _mm256_extractf128_pd(v,1);
+	lo = _mm_add_pd(lo,hi);
+	return _mm_cvtsd_f64(_mm_add_sd(lo,_mm_unpackhi_pd(lo,lo)));
+}
+
+__attribute__((target("avx2,fma")))
+static double AVX2Sum(const double* x, int n)	{
+	__m256d acc = _mm256_setzero_pd();
+	int k = 0;
+	for (; k+4<=n; k+=4)	{
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(x+k));
+	}
+	double tot = AVX2HorizontalSum(acc);
+	for (; k<n; k++)	{
+		tot += x[k];
+	}
+	return tot;
+}
+
+__attribute__((target("avx2,fma")))
+static double AVX2Dot(const double* x, const double* y, int n)	{
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+k), _mm256_loadu_pd(y+k), acc0);
+		acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(x+k+4), _mm256_loadu_pd(y+k+4), acc1);
+	}
+	for (; k+4<=n; k+=4)	{
+		acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(x+k), _mm256_loadu_pd(y+k), acc0);
+	}
+	double tot = AVX2HorizontalSum(_mm256_add_pd(acc0,acc1));
+	for (; k<n; k++)	{
+		tot += x[k] * y[k];
+	}
+	return tot;
+}
+
+__attribute__((target("avx2,fma")))
+static void AVX2Scale(double* x, double a, int n)	{
+	__m256d va = _mm256_set1_pd(a);
+	int k = 0;
+	for (; k+4<=n; k+=4)	{
+		_mm256_storeu_pd(x+k, _mm256_mul_pd(_mm256_loadu_pd(x+k), va));
+	}
+	for (; k<n; k++)	{
+		x[k] *= a;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void AVX2Affine(double* y, const double* x, double a, double b, int n)	{
+	__m256d va = _mm256_set1_pd(a);
+	__m256d vb = _mm256_set1_pd(b);
+	int k = 0;
+	for (; k+4<=n; k+=4)	{
+		_mm256_storeu_pd(y+k, _mm256_fmadd_pd(va, _mm256_loadu_pd(x+k), vb));
+	}
+	for (; k<n; k++)	{
+		y[k] = a * x[k] + b;
+	}
+}
+
+// N known at compile time: accumulators stay in registers
+template<int N> __attribute__((target("avx2,fma")))
+static void AVX2MatVecN(const double* mat, int ld, const double* x, double* y)	{
+	const int NV = (N+3)/4;
+	__m256d acc[NV];
+	for (int v=0; v<NV; v++)	{
+		acc[v] = _mm256_setzero_pd();
+	}
+	for (int l=0; l<N; l++)	{
+		__m256d a = _mm256_broadcast_sd(x+l);
+		const double* row = mat + l*ld;
+		for (int v=0; v<NV; v++)	{
+			acc[v] = _mm256_fmadd_pd(_mm256_loadu_pd(row + 4*v), a, acc[v]);
+		}
+	}
+	for (int v=0; v<N/4; v++)	{
+		_mm256_storeu_pd(y + 4*v, acc[v]);
+	}
+	if (N % 4)	{
+		double tmp[4];
+		_mm256_storeu_pd(tmp, acc[NV-1]);
+		for (int k=0; k<N%4; k++)	{
+			y[4*(NV-1)+k] = tmp[k];
+		}
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void AVX2MatVecGeneric(const double* mat, int ld, const double* x, double* y, int n)	{
+	double acc[MatVecChunk];
+	for (int begin=0; begin<ld; begin+=MatVecChunk)	{
+		int end = begin + MatVecChunk;
+		if (end > ld)	{
+			end = ld;
+		}
+		for (int k=0; k<end-begin; k++)	{
+			acc[k] = 0;
+		}
+		for (int l=0; l<n; l++)	{
+			__m256d a = _mm256_broadcast_sd(x+l);
+			const double* row = mat + l*ld + begin;
+			for (int k=0; k<end-begin; k+=4)	{
+				_mm256_storeu_pd(acc+k, _mm256_fmadd_pd(_mm256_loadu_pd(row+k), a, _mm256_loadu_pd(acc+k)));
+			}
+		}
+		for (int k=begin; (k<end) && (k<n); k++)	{
+			y[k] = acc[k-begin];
+		}
+	}
+}
+
+static void AVX2MatVec(const double* mat, int ld, const double* x, double* y, int n)	{
+	if (n == 61)	{
+		AVX2MatVecN<61>(mat,ld,x,y);
+	}
+	else if (n == 20)	{
+		AVX2MatVecN<20>(mat,ld,x,y);
+	}
+	else	{
+		AVX2MatVecGeneric(mat,ld,x,y,n);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static bool AVX2Range(const double* x, int n, double& min, double& max)	{
+	__m256d vmin = _mm256_set1_pd(x[0]);
+	__m256d vmax = vmin;
+	__m256d vnan = _mm256_setzero_pd();
+	int k = 0;
+	for (; k+4<=n; k+=4)	{
+		__m256d v = _mm256_loadu_pd(x+k);
+		vmin = _mm256_min_pd(vmin,v);
+		vmax = _mm256_max_pd(vmax,v);
+		vnan = _mm256_or_pd(vnan, _mm256_cmp_pd(v,v,_CMP_UNORD_Q));
+	}
+	double tmin[4], tmax[4];
+	_mm256_storeu_pd(tmin,vmin);
+	_mm256_storeu_pd(tmax,vmax);
+	bool ok = _mm256_testz_pd(vnan,vnan);
+	min = tmin[0];
+	max = tmax[0];
+	for (int i=1; i<4; i++)	{
+		if (min > tmin[i])	{
+			min = tmin[i];
+		}
+		if (max < tmax[i])	{
+			max = tmax[i];
+		}
+	}
+	for (; k<n; k++)	{
+		if (isnan(x[k]))	{
+			ok = false;
+		}
+		if (min > x[k])	{
+			min = x[k];
+		}
+		if (max < x[k])	{
+			max = x[k];
+		}
+	}
+	return ok;
+}
+
+//-------------------------------------------------------------------------
+//	* AVX-512 versions (8 doubles per register, masked loads and stores for the tails)
+//-------------------------------------------------------------------------
+
+// horizontal reductions, in the same order as _mm512_reduce_add_pd / min_pd / max_pd
+// (whose gcc versions, like the unmasked _mm512_min_pd and _mm512_max_pd, start from an uninitialized vector and trigger -Wuninitialized)
+
+__attribute__((target("avx512f")))
+static inline double AVX512ReduceAdd(__m512d v)	{
+	__m256d t = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF,v,1), _mm512_maskz_extractf64x4_pd(0xF,v,0));
+	__m128d u = _mm_add_pd(_mm256_extractf128_pd(t,1), _mm256_castpd256_pd128(t));
+	return _mm_cvtsd_f64(_mm_add_sd(u, _mm_unpackhi_pd(u,u)));
+}
+
+__attribute__((target("avx512f")))
+static inline double AVX512ReduceMin(__m512d v)	{
+	__m256d t = _mm256_min_pd(_mm512_maskz_extractf64x4_pd(0xF,v,1), _mm512_maskz_extractf64x4_pd(0xF,v,0));
+	__m128d u = _mm_min_pd(_mm256_extractf128_pd(t,1), _mm256_castpd256_pd128(t));
+	return _mm_cvtsd_f64(_mm_min_sd(u, _mm_unpackhi_pd(u,u)));
+}
+
+__attribute__((target("avx512f")))
+static inline double AVX512ReduceMax(__m512d v)	{
+	__m256d t = _mm256_max_pd(_mm512_maskz_extractf64x4_pd(0xF,v,1), _mm512_maskz_extractf64x4_pd(0xF,v,0));
+	__m128d u = _mm_max_pd(_mm256_extractf128_pd(t,1), _mm256_castpd256_pd128(t));
+	return _mm_cvtsd_f64(_mm_max_sd(u, _mm_unpackhi_pd(u,u)));
+}
+
+__attribute__((target("avx512f")))
+static void AVX512Multiply(double* to, const double* from, int n)	{
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		_mm512_storeu_pd(to+k, _mm512_mul_pd(_mm512_loadu_pd(to+k), _mm512_loadu_pd(from+k)));
+	}
+	if (k < n)	{
+		__mmask8 m = (__mmask8) ((1 << (n-k)) - 1);
+		_mm512_mask_storeu_pd(to+k, m, _mm512_mul_pd(_mm512_maskz_loadu_pd(m,to+k), _mm512_maskz_loadu_pd(m,from+k)));
+	}
+}
+
+__attribute__((target("avx512f")))
+static double AVX512Sum(const double* x, int n)	{
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		acc = _mm512_add_pd(acc, _mm512_loadu_pd(x+k));
+	}
+	if (k < n)	{
+		__mmask8 m = (__mmask8) ((1 << (n-k)) - 1);
+		acc = _mm512_add_pd(acc, _mm512_maskz_loadu_pd(m,x+k));
+	}
+	return AVX512ReduceAdd(acc);
+}
+
+__attribute__((target("avx512f")))
+static double AVX512Dot(const double* x, const double* y, int n)	{
+	__m512d acc = _mm512_setzero_pd();
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		acc = _mm512_fmadd_pd(_mm512_loadu_pd(x+k), _mm512_loadu_pd(y+k), acc);
+	}
+	if (k < n)	{
+		__mmask8 m = (__mmask8) ((1 << (n-k)) - 1);
+		acc = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m,x+k), _mm512_maskz_loadu_pd(m,y+k), acc);
+	}
+	return AVX512ReduceAdd(acc);
+}
+
+__attribute__((target("avx512f")))
+static void AVX512Scale(double* x, double a, int n)	{
+	__m512d va = _mm512_set1_pd(a);
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		_mm512_storeu_pd(x+k, _mm512_mul_pd(_mm512_loadu_pd(x+k), va));
+	}
+	if (k < n)	{
+		__mmask8 m = (__mmask8) ((1 << (n-k)) - 1);
+		_mm512_mask_storeu_pd(x+k, m, _mm512_mul_pd(_mm512_maskz_loadu_pd(m,x+k), va));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void AVX512Affine(double* y, const double* x, double a, double b, int n)	{
+	__m512d va = _mm512_set1_pd(a);
+	__m512d vb = _mm512_set1_pd(b);
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		_mm512_storeu_pd(y+k, _mm512_fmadd_pd(va, _mm512_loadu_pd(x+k), vb));
+	}
+	if (k < n)	{
+		__mmask8 m = (__mmask8) ((1 << (n-k)) - 1);
+		_mm512_mask_storeu_pd(y+k, m, _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(m,x+k), vb));
+	}
+}
+
+template<int N> __attribute__((target("avx512f")))
+static void AVX512MatVecN(const double* mat, int ld, const double* x, double* y)	{
+	const int NV = (N+7)/8;
+	__m512d acc[NV];
+	for (int v=0; v<NV; v++)	{
+		acc[v] = _mm512_setzero_pd();
+	}
+	for (int l=0; l<N; l++)	{
+		__m512d a = _mm512_set1_pd(x[l]);
+		const double* row = mat + l*ld;
+		for (int v=0; v<NV; v++)	{
+			acc[v] = _mm512_fmadd_pd(_mm512_loadu_pd(row + 8*v), a, acc[v]);
+		}
+	}
+	for (int v=0; v<N/8; v++)	{
+		_mm512_storeu_pd(y + 8*v, acc[v]);
+	}
+	if (N % 8)	{
+		_mm512_mask_storeu_pd(y + 8*(NV-1), (__mmask8) ((1 << (N%8)) - 1), acc[NV-1]);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void AVX512MatVecGeneric(const double* mat, int ld, const double* x, double* y, int n)	{
+	double acc[MatVecChunk];
+	for (int begin=0; begin<ld; begin+=MatVecChunk)	{
+		int end = begin + MatVecChunk;
+		if (end > ld)	{
+			end = ld;
+		}
+		for (int k=0; k<end-begin; k++)	{
+			acc[k] = 0;
+		}
+		for (int l=0; l<n; l++)	{
+			__m512d a = _mm512_set1_pd(x[l]);
+			const double* row = mat + l*ld + begin;
+			for (int k=0; k<end-begin; k+=8)	{
+				_mm512_storeu_pd(acc+k, _mm512_fmadd_pd(_mm512_loadu_pd(row+k), a, _mm512_loadu_pd(acc+k)));
+			}
+		}
+		for (int k=begin; (k<end) && (k<n); k++)	{
+			y[k] = acc[k-begin];
+		}
+	}
+}
+
+static void AVX512MatVec(const double* mat, int ld, const double* x, double* y, int n)	{
+	if (n == 61)	{
+		AVX512MatVecN<61>(mat,ld,x,y);
+	}
+	else if (n == 20)	{
+		AVX512MatVecN<20>(mat,ld,x,y);
+	}
+	else	{
+		AVX512MatVecGeneric(mat,ld,x,y,n);
+	}
+}
+
+__attribute__((target("avx512f")))
+static bool AVX512Range(const double* x, int n, double& min, double& max)	{
+	__m512d vmin = _mm512_set1_pd(x[0]);
+	__m512d vmax = vmin;
+	__mmask8 nan = 0;
+	int k = 0;
+	for (; k+8<=n; k+=8)	{
+		__m512d v = _mm512_loadu_pd(x+k);
+		vmin = _mm512_mask_min_pd(vmin,0xFF,vmin,v);
+		vmax = _mm512_mask_max_pd(vmax,0xFF,vmax,v);
+		nan |= _mm512_cmp_pd_mask(v,v,_CMP_UNORD_Q);
+	}
+	if (k < n)	{
+		__mmask8 m = (__mmask8) ((1 << (n-k)) - 1);
+		__m512d v = _mm512_maskz_loadu_pd(m,x+k);
+		vmin = _mm512_mask_min_pd(vmin,m,vmin,v);
+		vmax = _mm512_mask_max_pd(vmax,m,vmax,v);
+		nan |= _mm512_mask_cmp_pd_mask(m,v,v,_CMP_UNORD_Q);
+	}
+	min = AVX512ReduceMin(vmin);
+	max = AVX512ReduceMax(vmax);
+	return ! nan;
+}
+
+#endif
+
+//-------------------------------------------------------------------------
+//	* selection
+//-------------------------------------------------------------------------
+
+const char* LikelihoodKernel::name = "scalar";
+void (*LikelihoodKernel::Multiply)(double*, const double*, int) = ScalarMultiply;
+double (*LikelihoodKernel::Sum)(const double*, int) = ScalarSum;
+double (*LikelihoodKernel::Dot)(const double*, const double*, int) = ScalarDot;
+void (*LikelihoodKernel::Scale)(double*, double, int) = ScalarScale;
+void (*LikelihoodKernel::Affine)(double*, const double*, double, double, int) = ScalarAffine;
+void (*LikelihoodKernel::MatVec)(const double*, int, const double*, double*, int) = ScalarMatVec;
+bool (*LikelihoodKernel::Range)(const double*, int, double&, double&) = ScalarRange;
+
+void LikelihoodKernel::Init()	{
+
+	string isa = "scalar";
+#ifdef PB_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))	{
+		isa = "avx512";
+	}
+	else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))	{
+		isa = "avx2";
+	}
+	const char* force = getenv("PB_KERNEL");
+	if (force)	{
+		string tmp = force;
+		if ((tmp == "scalar") || ((tmp == "avx2") && (isa != "scalar")))	{
+			isa = tmp;
+		}
+	}
+	if (isa == "avx512")	{
+		name = "avx512";
+		Multiply = AVX512Multiply;
+		Sum = AVX512Sum;
+		Dot = AVX512Dot;
+		Scale = AVX512Scale;
+		Affine = AVX512Affine;
+		MatVec = AVX512MatVec;
+		Range = AVX512Range;
+		return;
+	}
+	if (isa == "avx2")	{
+		name = "avx2";
+		Multiply = AVX2Multiply;
+		Sum = AVX2Sum;
+		Dot = AVX2Dot;
+		Scale = AVX2Scale;
+		Affine = AVX2Affine;
+		MatVec = AVX2MatVec;
+		Range = AVX2Range;
+		return;
+	}
+#endif
+	name = "scalar";
+	Multiply = ScalarMultiply;
+	Sum = ScalarSum;
+	Dot = ScalarDot;
+	Scale = ScalarScale;
+	Affine = ScalarAffine;
+	MatVec = ScalarMatVec;
+	Range = ScalarRange;
+}
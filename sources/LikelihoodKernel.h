@@ -0,0 +1,63 @@
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef LIKELIHOODKERNEL_H
+#define LIKELIHOODKERNEL_H
+
+// elementary vector operations
+// on which the CPU intensive methods of SubstitutionProcess are built
+//
+// three implementations are available: scalar, AVX2 and AVX-512
+// the one to use is chosen once (Init), according to the instruction sets supported by the CPU
+// the choice can be forced by setting the environment variable PB_KERNEL to scalar, avx2 or avx512
+//
+// the matrix-vector product has specialized versions for 20 (amino-acids) and 61 (codons) states
+
+class LikelihoodKernel {
+
+	public:
+
+	static void Init();
+	static const char* GetName() {return name;}
+
+	// to[k] *= from[k]
+	static void (*Multiply)(double* to, const double* from, int n);
+
+	// returns sum_k x[k]
+	static double (*Sum)(const double* x, int n);
+
+	// returns sum_k x[k] * y[k]
+	static double (*Dot)(const double* x, const double* y, int n);
+
+	// x[k] *= a
+	static void (*Scale)(double* x, double a, int n);
+
+	// y[k] = a * x[k] + b
+	static void (*Affine)(double* y, const double* x, double a, double b, int n);
+
+	// y[k] = sum_l x[l] * mat[l*ld + k], for k < n
+	// ld should be a multiple of 8, and each row of mat should be padded with 0's up to ld
+	static void (*MatVec)(const double* mat, int ld, const double* x, double* y, int n);
+
+	// computes min and max over x
+	// returns false if x contains a nan
+	static bool (*Range)(const double* x, int n, double& min, double& max);
+
+	private:
+
+	static const char* name;
+};
+
+#endif
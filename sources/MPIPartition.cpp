@@ -0,0 +1,127 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "MPIPartition.h"
+
+#include <iostream>
+#include <cstdlib>
+using namespace std;
+
+MPIPartition::MPIPartition(int innprocs, int inmyid, int innsite)	{
+
+	nprocs = innprocs;
+	myid = inmyid;
+	nsite = innsite;
+	cost = new double[nsite];
+	for (int i=0; i<nsite; i++)	{
+		cost[i] = 1.0;
+	}
+	bound = new int[nprocs];
+	MakeMPIPartition();
+}
+
+MPIPartition::~MPIPartition()	{
+	delete[] cost;
+	delete[] bound;
+}
+
+int MPIPartition::GetSiteMin(int proc)	{
+	if (proc == -1)	{
+		proc = myid;
+	}
+	if (! proc)	{
+		return -1;
+	}
+	return bound[proc-1];
+}
+
+int MPIPartition::GetSiteMax(int proc)	{
+	if (proc == -1)	{
+		proc = myid;
+	}
+	if (! proc)	{
+		return -1;
+	}
+	return bound[proc];
+}
+
+int MPIPartition::GetMaxWidth()	{
+	int max = 0;
+	for (int proc=1; proc<nprocs; proc++)	{
+		if (max < bound[proc] - bound[proc-1])	{
+			max = bound[proc] - bound[proc-1];
+		}
+	}
+	return max;
+}
+
+double MPIPartition::GetTotalCost(int proc)	{
+	double total = 0;
+	for (int i=GetSiteMin(proc); i<GetSiteMax(proc); i++)	{
+		total += cost[i];
+	}
+	return total;
+}
+
+// slave proc takes sites until the cumulated cost reaches proc/(nprocs-1) of the total cost
+// a site is given to the slave for which the cumulated cost at the middle of the site falls into its share
+// with uniform costs, this gives ranges of Nsite/(nprocs-1) or Nsite/(nprocs-1) + 1 sites
+void MPIPartition::MakeMPIPartition(const int* maxwidth)	{
+
+	int nslave = nprocs - 1;
+	double total = 0;
+	for (int i=0; i<nsite; i++)	{
+		total += cost[i];
+	}
+
+	// room: number of sites that can still be given to slaves proc+1 ... nslave
+	int room = 0;
+	if (maxwidth)	{
+		for (int proc=1; proc<=nslave; proc++)	{
+			room += maxwidth[proc-1];
+		}
+		if (room < nsite)	{
+			cerr << "error in MPIPartition: " << nsite << " sites, but room for only " << room << " sites over the slaves\n";
+			exit(1);
+		}
+	}
+
+	bound[0] = 0;
+	double cumul = 0;
+	int i = 0;
+	for (int proc=1; proc<nslave; proc++)	{
+		double target = total * proc / nslave;
+		while ((i < nsite) && (cumul + 0.5 * cost[i] < target))	{
+			cumul += cost[i];
+			i++;
+		}
+		if (maxwidth)	{
+			room -= maxwidth[proc-1];
+			int lower = nsite - room;
+			int upper = bound[proc-1] + maxwidth[proc-1];
+			while (i > upper)	{
+				i--;
+				cumul -= cost[i];
+			}
+			while (i < lower)	{
+				cumul += cost[i];
+				i++;
+			}
+		}
+		bound[proc] = i;
+	}
+	bound[nslave] = nsite;
+}
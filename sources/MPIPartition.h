@@ -0,0 +1,70 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef MPIPARTITION_H
+#define MPIPARTITION_H
+
+#include "MPIModule.h"
+
+// partition of the sites among the slaves (processes 1 <= proc < nprocs)
+// each slave is given a contiguous range of sites: GetSiteMin(proc) <= site < GetSiteMax(proc)
+//
+// by default, all sites are assumed to have the same computational cost,
+// and the remainder of Nsite / (nprocs-1) is spread over the slaves (instead of all being given to the last one)
+// alternatively, a cost can be specified for each site (SetSiteCost), in which case
+// the ranges are chosen so as to approximately equalize the total cost per slave
+//
+// all processes should build the same partition (same costs, and then MakeMPIPartition)
+
+class MPIPartition : public MPIModule	{
+
+	public:
+
+	MPIPartition(int innprocs, int inmyid, int innsite);
+	~MPIPartition();
+
+	int GetNprocs() {return nprocs;}
+	int GetMyid() {return myid;}
+	int GetNsite() {return nsite;}
+
+	// proc == -1 : current process
+	// -1 is returned for the master
+	int GetSiteMin(int proc = -1);
+	int GetSiteMax(int proc = -1);
+
+	// largest range over all slaves
+	int GetMaxWidth();
+
+	void SetSiteCost(int site, double incost) {cost[site] = incost;}
+	double GetTotalCost(int proc);
+
+	void MakeMPIPartition() {MakeMPIPartition(0);}
+	// maxwidth: maximum number of sites that can be given to each slave (maxwidth[proc-1] for slave proc)
+	// the ranges are then the cost-balanced ones, shrunk or extended as little as needed to respect these limits
+	void MakeMPIPartition(const int* maxwidth);
+
+	private:
+
+	int nprocs;
+	int myid;
+	int nsite;
+	double* cost;
+	// slave proc gets sites bound[proc-1] <= site < bound[proc]
+	int* bound;
+};
+
+#endif
+
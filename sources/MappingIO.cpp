@@ -0,0 +1,198 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "MappingIO.h"
+#include "IndexedRecordFile.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef MAPPING_ZLIB
+#include <zlib.h>
+#endif
+
+static const char mapmagic[8] = "PBMAPS";
+static const char indexmagic[8] = "PBMINDX";
+static const int mapversion = 1;
+
+static const long long headersize = sizeof(mapmagic) + 3*sizeof(int);
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//	* MappingWriter
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+
+MappingWriter::MappingWriter(string name, int innsite) : filename(name + ".maps"), nsite(innsite)	{
+
+#ifdef MAPPING_ZLIB
+	compressed = 1;
+#else
+	compressed = 0;
+#endif
+	os.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if (! os)	{
+		cerr << "error: cannot create " << filename << '\n';
+		exit(1);
+	}
+	os.write(mapmagic, sizeof(mapmagic));
+	os.write((const char*) &mapversion, sizeof(int));
+	os.write((const char*) &nsite, sizeof(int));
+	os.write((const char*) &compressed, sizeof(int));
+}
+
+MappingWriter::~MappingWriter()	{
+
+	IndexedRecordFile::WriteIndex(os,os.tellp(),offset,indexmagic);
+	os.close();
+}
+
+void MappingWriter::Append(const vector<string>& sitemapping)	{
+
+	if (((int) sitemapping.size()) != nsite)	{
+		cerr << "error in MappingWriter::Append: " << sitemapping.size() << " sites instead of " << nsite << '\n';
+		exit(1);
+	}
+
+	vector<long long> siteoffset(nsite+1);
+	siteoffset[0] = 0;
+	for (int i=0; i<nsite; i++)	{
+		siteoffset[i+1] = siteoffset[i] + sitemapping[i].size();
+	}
+	string text;
+	text.reserve(siteoffset[nsite]);
+	for (int i=0; i<nsite; i++)	{
+		text += sitemapping[i];
+	}
+
+#ifdef MAPPING_ZLIB
+	uLongf zsize = compressBound(text.size());
+	string ztext(zsize, ' ');
+	if (compress((Bytef*) &ztext[0], &zsize, (const Bytef*) text.data(), text.size()) != Z_OK)	{
+		cerr << "error in MappingWriter::Append: compression failed\n";
+		exit(1);
+	}
+	ztext.resize(zsize);
+	text.swap(ztext);
+#endif
+
+	offset.push_back(os.tellp());
+	long long size = (nsite+1) * sizeof(long long) + text.size();
+	os.write((const char*) &size, sizeof(long long));
+	os.write((const char*) &siteoffset[0], (nsite+1) * sizeof(long long));
+	os.write(text.data(), text.size());
+	if (! os)	{
+		cerr << "error in MappingWriter::Append: write failed\n";
+		exit(1);
+	}
+}
+
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+//	* MappingReader
+//-------------------------------------------------------------------------
+//-------------------------------------------------------------------------
+
+MappingReader::MappingReader(string name) : filename(name + ".maps"), current(-1)	{
+
+	is.open(filename.c_str(), ios::in | ios::binary);
+	if (! is)	{
+		cerr << "error: no " << filename << " file found\n";
+		exit(1);
+	}
+	char magic[sizeof(mapmagic)];
+	int version;
+	is.read(magic, sizeof(mapmagic));
+	is.read((char*) &version, sizeof(int));
+	is.read((char*) &nsite, sizeof(int));
+	is.read((char*) &compressed, sizeof(int));
+	if ((! is) || memcmp(magic,mapmagic,sizeof(mapmagic)))	{
+		cerr << "error: " << filename << " is not a valid mapping file\n";
+		exit(1);
+	}
+	if (version != mapversion)	{
+		cerr << "error: " << filename << " : unknown mapping format version " << version << '\n';
+		exit(1);
+	}
+#ifndef MAPPING_ZLIB
+	if (compressed)	{
+		cerr << "error: " << filename << " is compressed: recompile with zlib support (make MAPS=zlib)\n";
+		exit(1);
+	}
+#endif
+	ReadIndex();
+}
+
+void MappingReader::ReadIndex()	{
+
+	long long indexoffset;
+	if (! IndexedRecordFile::ReadIndex(is,headersize,indexmagic,offset,indexoffset))	{
+		cerr << "warning: " << filename << " : no index, scanning records\n";
+		ScanRecords();
+	}
+}
+
+void MappingReader::ScanRecords()	{
+	IndexedRecordFile::ScanRecords(is,headersize,(nsite+1) * sizeof(long long),offset);
+}
+
+void MappingReader::LoadRecord(int record)	{
+
+	if ((record < 0) || (record >= GetSize()))	{
+		cerr << "error in MappingReader: " << filename << " only has " << GetSize() << " records\n";
+		exit(1);
+	}
+	long long size;
+	is.seekg(offset[record]);
+	is.read((char*) &size, sizeof(long long));
+	siteoffset.resize(nsite+1);
+	is.read((char*) &siteoffset[0], (nsite+1) * sizeof(long long));
+	long long textsize = size - (nsite+1) * sizeof(long long);
+	text.assign(textsize, ' ');
+	if (textsize)	{
+		is.read(&text[0], textsize);
+	}
+	if (! is)	{
+		cerr << "error in MappingReader: " << filename << " : cannot read record " << record << '\n';
+		exit(1);
+	}
+
+#ifdef MAPPING_ZLIB
+	if (compressed)	{
+		uLongf textlength = siteoffset[nsite];
+		string ztext(textlength, ' ');
+		if (uncompress((Bytef*) &ztext[0], &textlength, (const Bytef*) text.data(), text.size()) != Z_OK)	{
+			cerr << "error in MappingReader: " << filename << " : cannot uncompress record " << record << '\n';
+			exit(1);
+		}
+		text.swap(ztext);
+	}
+#endif
+	current = record;
+}
+
+string MappingReader::GetSiteMapping(int record, int site)	{
+
+	if ((site < 0) || (site >= nsite))	{
+		cerr << "error in MappingReader: site " << site << " out of range (" << nsite << " sites)\n";
+		exit(1);
+	}
+	if (record != current)	{
+		LoadRecord(record);
+	}
+	return text.substr(siteoffset[site], siteoffset[site+1] - siteoffset[site]);
+}
+
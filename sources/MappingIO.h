@@ -0,0 +1,100 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+
+#ifndef MAPPINGIO_H
+#define MAPPINGIO_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// .maps files: stochastic mappings produced by readpb_mpi -map, all sites in one file
+//
+// indexed binary file, see IndexedRecordFile.h:
+// header     : magic "PBMAPS", format version (int), number of sites (int), compression (int, 0: none, 1: zlib)
+// records    : one per mapping of the whole alignment
+//              (for each sample of the chain: the posterior mapping, then the posterior predictive mapping)
+//              offsets of the nsite+1 site mappings in the text of the record (long long),
+//              text of the record: the site mappings one after the other, in the format of the former name_<site>.map files
+//              (stored compressed as a whole if compression is 1)
+// footer     : magic "PBMINDX"
+//
+// the index and the footer are written when the writer is closed
+// if they are missing (e.g. readpb killed before the end), the reader rebuilds the index by scanning the records
+//
+// compression requires zlib (make MAPS=zlib)
+
+class MappingWriter	{
+
+	public:
+
+	// create name.maps
+	MappingWriter(string name, int innsite);
+
+	// writes the index and closes the file
+	~MappingWriter();
+
+	// append a mapping, given as the text of each site
+	void Append(const vector<string>& sitemapping);
+
+	private:
+
+	string filename;
+	ofstream os;
+	int nsite;
+	int compressed;
+	vector<long long> offset;
+};
+
+class MappingReader	{
+
+	public:
+
+	// open name.maps
+	MappingReader(string name);
+
+	int GetNsite() {return nsite;}
+
+	// number of records
+	int GetSize() {return (int) offset.size();}
+
+	// the mapping of site in record
+	// successive calls for the same record only read the file once
+	string GetSiteMapping(int record, int site);
+
+	private:
+
+	void ReadIndex();
+	void ScanRecords();
+	void LoadRecord(int record);
+
+	string filename;
+	ifstream is;
+	int nsite;
+	int compressed;
+	vector<long long> offset;
+
+	// currently loaded record
+	int current;
+	vector<long long> siteoffset;
+	string text;
+};
+
+#endif
+
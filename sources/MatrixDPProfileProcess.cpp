@@ -49,8 +49,8 @@ double MatrixDPProfileProcess::IncrementalDPMove(int nrep)	{
 		// Gibbs
 
 		double max = 0;
+		LogStatProbArray(site,h,mLogSamplingArray);
 		for (int mode = 0; mode < h; mode++)	{
-			mLogSamplingArray[mode] =  LogStatProb(site,mode);
 			if ((!mode) || (max < mLogSamplingArray[mode]))	{
 				max = mLogSamplingArray[mode];
 			}
@@ -144,8 +144,8 @@ void MatrixDPProfileProcess::SlaveMixMove()	{
 		}
 
 		double max = 0;
+		LogStatProbArray(site,h,logsamp);
 		for (int k=0; k<h; k++)	{
-			logsamp[k] = LogStatProb(site,k);
 			if ((!k) || (max < logsamp[k]))	{
 				max = logsamp[k];
 			}
@@ -205,14 +205,12 @@ double MatrixDPProfileProcess::GlobalMixMove(int Nrep, int Nprofile)	{
 	UpdateOccupancyNumbers();
 
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int maxw = 0;
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		int w = smax[i] - smin[i];
 		if (maxw < w)	{
 			maxw = w;
@@ -30,13 +30,11 @@ double MatrixFiniteProfileProcess::GlobalIncrementalFiniteMove(int nrep)	{
 	MPI_Bcast(&nrep,1,MPI_INT,0,MPI_COMM_WORLD);
 
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	int NAccepted = 0;
@@ -85,6 +83,9 @@ double MatrixFiniteProfileProcess::SlaveIncrementalFiniteMove()	{
 	double* bigarray = new double[Ncomponent * GetNsite()];
 	double* bigcumul = new double[Ncomponent * GetNsite()];
 
+	// matrices do not change during the move
+	LogStatProbTable(GetSiteMin(),GetSiteMax(),Ncomponent,bigarray + GetSiteMin() * Ncomponent);
+
 	for (int rep=0; rep<nrep; rep++)	{
 
 		// receive weights sent by master
@@ -100,7 +101,6 @@ double MatrixFiniteProfileProcess::SlaveIncrementalFiniteMove()	{
 
 			double max = 0;
 			for (int mode = 0; mode < Ncomponent; mode++)	{
-				mLogSamplingArray[mode] =  LogStatProb(site,mode);
 				if ((!mode) || (max < mLogSamplingArray[mode]))	{
 					max = mLogSamplingArray[mode];
 				}
@@ -155,8 +155,8 @@ double MatrixFiniteProfileProcess::IncrementalFiniteMove(int nrep)	{
 			RemoveSite(site,bk);
 
 			double max = 0;
+			LogStatProbArray(site,Ncomponent,mLogSamplingArray);
 			for (int mode = 0; mode < Ncomponent; mode++)	{
-				mLogSamplingArray[mode] =  LogStatProb(site,mode);
 				if ((!mode) || (max < mLogSamplingArray[mode]))	{
 					max = mLogSamplingArray[mode];
 				}
@@ -47,13 +47,11 @@ double MatrixFiniteProfileProcess::GlobalIncrementalFiniteMove(int nrep, int K0)
 	MPI_Bcast(&K0,1,MPI_INT,0,MPI_COMM_WORLD);
 
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	int NAccepted = 0;
@@ -167,8 +165,8 @@ double MatrixFiniteProfileProcess::SlaveIncrementalFiniteMove()	{
 			int bk = alloc[site];
 
 			double max = 0;
+			LogStatProbArray(site,K0,mLogSamplingArray);
 			for (int mode = 0; mode<K0; mode++)	{
-				mLogSamplingArray[mode] =  LogStatProb(site,mode);
 				if ((!mode) || (max < mLogSamplingArray[mode]))	{
 					max = mLogSamplingArray[mode];
 				}
@@ -244,8 +242,8 @@ double MatrixFiniteProfileProcess::IncrementalFiniteMove(int nrep, int K0)	{
 			int bk = alloc[site];
 
 			double max = 0;
+			LogStatProbArray(site,K0,mLogSamplingArray);
 			for (int mode = 0; mode<K0; mode++)	{
-				mLogSamplingArray[mode] =  LogStatProb(site,mode);
 				if ((!mode) || (max < mLogSamplingArray[mode]))	{
 					max = mLogSamplingArray[mode];
 				}
@@ -30,8 +30,8 @@ void MatrixMixtureProfileProcess::SwapComponents(int cat1, int cat2)	{
 
 	MixtureProfileProcess::SwapComponents(cat1,cat2);
 
-	UpdateMatrix(cat1);
-	UpdateMatrix(cat2);
+	UpdateComponentMatrix(cat1);
+	UpdateComponentMatrix(cat2);
 
 	// useful?
 	// in expo gtr: null pointers anyway
@@ -50,8 +50,12 @@ void MatrixMixtureProfileProcess::Create(int innsite, int indim)	{
 	if (! matrixarray)	{
 		MixtureProfileProcess::Create(innsite,indim);
 		matrixarray = new SubMatrix*[GetNmodeMax()];
+		matrixprofile = new double*[GetNmodeMax()];
+		matrixuptodate = new bool[GetNmodeMax()];
 		for (int i=0; i<GetNmodeMax(); i++)	{
 			matrixarray[i] = 0;
+			matrixprofile[i] = new double[GetDim()];
+			matrixuptodate[i] = false;
 		}
 		// SampleProfile();
 	}
@@ -61,13 +65,62 @@ void MatrixMixtureProfileProcess::Delete() {
 	if (matrixarray)	{
 		for (int i=0; i<GetNmodeMax(); i++)	{
 			delete matrixarray[i];
+			delete[] matrixprofile[i];
 		}
 		delete[] matrixarray;
+		delete[] matrixprofile;
+		delete[] matrixuptodate;
+		delete[] matrixglobal;
 		matrixarray = 0;
+		matrixprofile = 0;
+		matrixuptodate = 0;
+		matrixglobal = 0;
+		nmatrixglobal = -1;
 		MixtureProfileProcess::Delete();
 	}
 }
 
+void MatrixMixtureProfileProcess::UpdateComponentMatrix(int k)	{
+
+	UpdateMatrix(k);
+	for (int i=0; i<GetDim(); i++)	{
+		matrixprofile[k][i] = profile[k][i];
+	}
+	matrixuptodate[k] = true;
+}
+
+void MatrixMixtureProfileProcess::UpdateMatrices()	{
+
+	// have the global parameters changed since last call?
+	int nglobal = GetNmatrixGlobal();
+	bool globalchanged = (nglobal < 0) || (nglobal != nmatrixglobal);
+	if (nglobal != nmatrixglobal)	{
+		delete[] matrixglobal;
+		matrixglobal = (nglobal > 0) ? new double[nglobal] : 0;
+		nmatrixglobal = nglobal;
+	}
+	if (nglobal > 0)	{
+		double global[nglobal];
+		GetMatrixGlobal(global);
+		for (int i=0; i<nglobal; i++)	{
+			if (global[i] != matrixglobal[i])	{
+				globalchanged = true;
+				matrixglobal[i] = global[i];
+			}
+		}
+	}
+
+	for (int k=0; k<GetNcomponent(); k++)	{
+		bool changed = globalchanged || (! matrixuptodate[k]);
+		for (int i=0; (! changed) && (i<GetDim()); i++)	{
+			changed = (profile[k][i] != matrixprofile[k][i]);
+		}
+		if (changed)	{
+			UpdateComponentMatrix(k);
+		}
+	}
+}
+
 double MatrixMixtureProfileProcess::GlobalMoveProfile(double tuning, int n, int nrep)	{
 
 	UpdateOccupancyNumbers();
@@ -24,7 +24,7 @@ class MatrixMixtureProfileProcess : public virtual MatrixProfileProcess, public
 
 	public:
 
-	MatrixMixtureProfileProcess() : matrixarray(0) {}
+	MatrixMixtureProfileProcess() : matrixarray(0), matrixprofile(0), matrixuptodate(0), matrixglobal(0), nmatrixglobal(-1) {}
 	virtual ~MatrixMixtureProfileProcess() {}
 
 	SubMatrix* GetMatrix(int site)	{
@@ -55,16 +55,15 @@ class MatrixMixtureProfileProcess : public virtual MatrixProfileProcess, public
 	virtual void UpdateModeProfileSuffStat() = 0;
 
 	// should be called each time global parameters are modified
-	virtual void UpdateMatrices()	{
-		for (int k=0; k<GetNcomponent(); k++)	{
-			UpdateMatrix(k);
-		}
-	}
+	// only the matrices whose profile or global parameters have changed since their last update are recomputed
+	// (all of them if the process does not declare its global parameters, see MatrixProfileProcess::GetNmatrixGlobal)
+	virtual void UpdateMatrices();
 
 	virtual void CreateMatrices()	{
 		for (int k=0; k<GetNcomponent(); k++)	{
 			if (! matrixarray[k])	{
 				CreateMatrix(k);
+				matrixuptodate[k] = false;
 			}
 		}
 		for (int k=GetNcomponent(); k<GetNmodeMax(); k++)	{
@@ -97,10 +96,15 @@ class MatrixMixtureProfileProcess : public virtual MatrixProfileProcess, public
 	virtual void DeleteMatrix(int k)	{
 		delete matrixarray[k];
 		matrixarray[k] = 0;
+		matrixuptodate[k] = false;
 	}
 
 	virtual void UpdateMatrix(int k) = 0;
 
+	// updates matrix k, and records the profile it was updated with
+	// (to be used instead of UpdateMatrix(k) each time profile k has been modified)
+	void UpdateComponentMatrix(int k);
+
 	/*
 	virtual void CreateComponent(int k)	{
 		occupancy[k] = 0;
@@ -136,6 +140,12 @@ class MatrixMixtureProfileProcess : public virtual MatrixProfileProcess, public
 	*/
 
 	SubMatrix** matrixarray;
+
+	// profiles and global parameters with which each matrix was last updated
+	double** matrixprofile;
+	bool* matrixuptodate;
+	double* matrixglobal;
+	int nmatrixglobal;
 };
 
 #endif
@@ -45,6 +45,12 @@ class MatrixProfileProcess : public virtual ProfileProcess	{
 	// updates all matrices
 	// (should be called, e.g. when performing a Metropolis on relative exchangeabilities or global mutation parameters)
 	virtual void UpdateMatrices() = 0;
+
+	// global parameters on which all matrices depend (e.g. nucleotide rates, omega)
+	// used by matrix mixtures to recompute only the matrices whose parameters have changed
+	// a negative number means that they are not known, in which case all matrices are always recomputed
+	virtual int GetNmatrixGlobal() {return -1;}
+	virtual void GetMatrixGlobal(double* x) {}
 	// virtual void DiagonaliseMatrices() = 0;
 };
 
@@ -22,8 +22,8 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 void MatrixSBDPProfileProcess::SwapComponents(int cat1, int cat2)	{
 
 	SBDPProfileProcess::SwapComponents(cat1,cat2);
-	UpdateMatrix(cat1);
-	UpdateMatrix(cat2);
+	UpdateComponentMatrix(cat1);
+	UpdateComponentMatrix(cat2);
 }
 
 
@@ -59,13 +59,11 @@ double MatrixSBDPProfileProcess::GlobalMixMove(int nrep, int nallocrep, double e
 	MPI_Bcast(itmp,4,MPI_INT,0,MPI_COMM_WORLD);
 
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	/*
@@ -225,17 +223,15 @@ void MatrixSBDPProfileProcess::SlaveMixMove()	{
 	int K0 = itmp[2];
 	int nprofilerep = itmp[3];
 
-	double* mLogSamplingArray = new double[Ncomponent];
+	double* logprobtable = new double[(GetSiteMax() - GetSiteMin()) * K0];
 	double* cumul = new double[Ncomponent];
 	double* tmp = new double[Ncomponent * GetDim() + 1];
 
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	for (int rep=0; rep<nrep; rep++)	{
@@ -257,6 +253,9 @@ void MatrixSBDPProfileProcess::SlaveMixMove()	{
 
 		int NAccepted = 0;
 
+		// components only change during the profile move below
+		LogStatProbTable(GetSiteMin(),GetSiteMax(),K0,logprobtable);
+
 		for (int allocrep=0; allocrep<nallocrep; allocrep++)	{
 
 			for (int site=smin[GetMyid()-1]; site<smax[GetMyid()-1]; site++)	{
@@ -265,8 +264,8 @@ void MatrixSBDPProfileProcess::SlaveMixMove()	{
 
 				double max = 0;
 				// double mean = 0;
+				double* mLogSamplingArray = logprobtable + (site - GetSiteMin()) * K0;
 				for (int mode = 0; mode<K0; mode++)	{
-					mLogSamplingArray[mode] = LogStatProb(site,mode);
 					if ((!mode) || (max < mLogSamplingArray[mode]))	{
 						max = mLogSamplingArray[mode];
 					}
@@ -411,7 +410,7 @@ void MatrixSBDPProfileProcess::SlaveMixMove()	{
 	}
 
 	delete[] cumul;
-	delete[] mLogSamplingArray;
+	delete[] logprobtable;
 	delete[] tmp;
 }
 
@@ -466,8 +465,8 @@ double MatrixSBDPProfileProcess::MixMove(int nrep, int nallocrep, double epsilon
 
 				double max = 0;
 				// double mean = 0;
+				LogStatProbArray(site,K0,mLogSamplingArray);
 				for (int mode = 0; mode<K0; mode++)	{
-					mLogSamplingArray[mode] = LogStatProb(site,mode);
 					if ((!mode) || (max < mLogSamplingArray[mode]))	{
 						max = mLogSamplingArray[mode];
 					}
@@ -593,8 +592,8 @@ double MatrixSBDPProfileProcess::IncrementalDPMove(int nrep, double epsilon)	{
 
 			double max = 0;
 			double mean = 0;
+			LogStatProbArray(site,K0,mLogSamplingArray);
 			for (int mode = 0; mode<K0; mode++)	{
-				mLogSamplingArray[mode] =  LogStatProb(site,mode);
 				if ((!mode) || (max < mLogSamplingArray[mode]))	{
 					max = mLogSamplingArray[mode];
 				}
@@ -674,13 +673,11 @@ double MatrixSBDPProfileProcess::GlobalIncrementalDPMove(int nrep, double epsilo
 
 	// ShedTail();
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 
@@ -735,7 +732,6 @@ double MatrixSBDPProfileProcess::GlobalIncrementalDPMove(int nrep, double epsilo
 
 void MatrixSBDPProfileProcess::SlaveIncrementalDPMove()	{
 
-	double* mLogSamplingArray = new double[Ncomponent];
 	double* cumul = new double[Ncomponent];
 
 	int nrep;
@@ -745,6 +741,10 @@ void MatrixSBDPProfileProcess::SlaveIncrementalDPMove()	{
 
 	MPI_Bcast(allocprofile,Ncomponent*GetDim(),MPI_DOUBLE,0,MPI_COMM_WORLD);
 
+	// components do not change during the move
+	double* logprobtable = new double[(GetSiteMax() - GetSiteMin()) * K0];
+	LogStatProbTable(GetSiteMin(),GetSiteMax(),K0,logprobtable);
+
 	int NAccepted = 0;
 
 	for (int rep=0; rep<nrep; rep++)	{
@@ -768,8 +768,8 @@ void MatrixSBDPProfileProcess::SlaveIncrementalDPMove()	{
 
 			double max = 0;
 			double mean = 0;
+			double* mLogSamplingArray = logprobtable + (site - GetSiteMin()) * K0;
 			for (int mode = 0; mode<K0; mode++)	{
-				mLogSamplingArray[mode] = LogStatProb(site,mode);
 				if ((!mode) || (max < mLogSamplingArray[mode]))	{
 					max = mLogSamplingArray[mode];
 				}
@@ -821,5 +821,5 @@ void MatrixSBDPProfileProcess::SlaveIncrementalDPMove()	{
 		MPI_Send(alloc,GetNsite(),MPI_INT,0,TAG1,MPI_COMM_WORLD);
 	}
 	delete[] cumul;
-	delete[] mLogSamplingArray;
+	delete[] logprobtable;
 }
@@ -16,6 +16,22 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include "MatrixSubstitutionProcess.h"
 #include <vector>
+#include <cstdlib>
+
+static double ReadMaxExpectedTrials()	{
+	const char* tmp = getenv("PB_UNITRIALS");
+	if (! tmp)	{
+		return 20;
+	}
+	double x = atof(tmp);
+	if (x < 0)	{
+		cerr << "error: PB_UNITRIALS should be non-negative\n";
+		exit(1);
+	}
+	return x;
+}
+
+double MatrixSubstitutionProcess::maxexpectedtrials = ReadMaxExpectedTrials();
 
 //-------------------------------------------------------------------------
 //-------------------------------------------------------------------------
@@ -33,10 +49,10 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 // root case (trivial)
 BranchSitePath** MatrixSubstitutionProcess::SampleRootPaths(int* state)	{
 	// BranchSitePath** patharray = new BranchSitePath*[sitemax - sitemin];
-	BranchSitePath** patharray = new BranchSitePath*[GetNsite()];
+	BranchSitePath** patharray = pathpool.NewPathArray(GetNsite());
 	for (int i=sitemin; i<sitemax; i++)	{
 	// for (int i=0; i<GetNsite(); i++)	{
-		patharray[i] = new BranchSitePath(state[i]);
+		patharray[i] = pathpool.NewPath(state[i]);
 	}
 
 	return patharray;
@@ -45,16 +61,19 @@ BranchSitePath** MatrixSubstitutionProcess::SampleRootPaths(int* state)	{
 // general case
 BranchSitePath** MatrixSubstitutionProcess::SamplePaths(int* stateup, int* statedown, double time) 	{
 	// BranchSitePath** patharray = new BranchSitePath*[sitemax - sitemin];
-	BranchSitePath** patharray = new BranchSitePath*[GetNsite()];
+	BranchSitePath** patharray = pathpool.NewPathArray(GetNsite());
 	for (int i=sitemin; i<sitemax; i++)	{
 	// for (int i=0; i<GetNsite(); i++)	{
 		double rate = GetRate(i);
 		SubMatrix* matrix = GetMatrix(i);
-		BranchSitePath* path = ResampleAcceptReject(1000,stateup[i],statedown[i],rate,time,matrix);
-		if (! path)	{
-			path = ResampleUniformized(stateup[i],statedown[i],rate,time,matrix);
+		int ntrial = 0;
+		if (! ResampleAcceptReject(pathbuilder,1000,stateup[i],statedown[i],rate,time,matrix,ntrial))	{
+			ResampleUniformized(pathbuilder,stateup[i],statedown[i],rate,time,matrix);
+			mapunicount++;
 		}
-		patharray[i] = path;
+		maptrialcount += ntrial;
+		mapsitecount++;
+		patharray[i] = pathpool.NewPath(pathbuilder);
 	}
 	return patharray;
 }
@@ -64,15 +83,16 @@ BranchSitePath** MatrixSubstitutionProcess::SamplePaths(int* stateup, int* state
 // accept-reject sampling method for drawing a substitution mapping along a branch
 // conditional on the states at both ends
 
-BranchSitePath* MatrixSubstitutionProcess::ResampleAcceptReject(int maxtrial, int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix)	{
+// the path is built into path (overwritten at each trial)
+// returns false if no trial ended in statedown,
+// or if, after a first rejection, too many trials are expected (see maxexpectedtrials)
+// in both cases, the path should then be sampled by uniformization
+bool MatrixSubstitutionProcess::ResampleAcceptReject(PathBuilder& path, int maxtrial, int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix, int& ntrial)	{
 
-	int ntrial = 0;
-	BranchSitePath* path = 0;
+	ntrial = 0;
 	do	{
-		delete path;
-		path = new BranchSitePath();
 		ntrial++;
-		path->Reset(stateup);
+		path.Reset(stateup);
 		double t = 0;
 		int state = stateup;
 
@@ -84,7 +104,7 @@ BranchSitePath* MatrixSubstitutionProcess::ResampleAcceptReject(int maxtrial, in
 
 			t += u;
 			int newstate = matrix->DrawOneStep(state);
-			path->Append(newstate,u/totaltime);
+			path.Append(newstate,u/totaltime);
 			state = newstate;
 		}
 		while (t < totaltime)	{
@@ -96,34 +116,50 @@ BranchSitePath* MatrixSubstitutionProcess::ResampleAcceptReject(int maxtrial, in
 			t += u;
 			if (t < totaltime)	{
 				int newstate = matrix->DrawOneStep(state);
-				path->Append(newstate,u/totaltime);
+				path.Append(newstate,u/totaltime);
 				state = newstate;
 			}
 			else	{
 				t -= u;
 				u = totaltime - t;
-				path->last->SetRelativeTime(u/totaltime);
+				path.SetLastRelativeTime(u/totaltime);
 				t = totaltime;
 			}
 		}
-	} while ((ntrial < maxtrial) && (path->last->GetState() != statedown));
+		if ((ntrial == 1) && (path.GetFinalState() != statedown) && (maxexpectedtrials > 0))	{
+			if (GetAcceptRejectProb(stateup,statedown,rate,totaltime,matrix) * maxexpectedtrials < 1)	{
+				return false;
+			}
+		}
+	} while ((ntrial < maxtrial) && (path.GetFinalState() != statedown));
 
 	// if endstate does not match state at the corresponding end of the branch
 	// just force it to match
 	// however, this is really dirty !
 	// normally, in that case, one should give up with accept-reject
 	// and use a uniformized method instead (but not yet adapted to the present code, see below)
-	if (path->last->GetState() != statedown)	{
-		// fossil
-		// path->last->SetState(statedown);
-		delete path;
-		path = 0;
-	}
+	// fossil
+	// if (path.GetFinalState() != statedown)	{
+	// 	path->last->SetState(statedown);
+	// }
+
+	return (path.GetFinalState() == statedown);
+}
 
-	return path;
+// probability that a trial of ResampleAcceptReject ends in statedown
+// (the first substitution is forced whenever stateup != statedown)
+// the expected number of trials is the inverse of this probability
+double MatrixSubstitutionProcess::GetAcceptRejectProb(int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix)	{
+
+	double length = rate * totaltime;
+	double p = matrix->GetFiniteTimeTransitionProb(stateup,statedown,length);
+	if (stateup != statedown)	{
+		p /= 1 - exp((*matrix)(stateup,stateup) * length);
+	}
+	return p;
 }
 
-BranchSitePath* MatrixSubstitutionProcess::ResampleUniformized(int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix)	{
+void MatrixSubstitutionProcess::ResampleUniformized(PathBuilder& path, int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix)	{
 
 	double length = rate * totaltime;
 	int m = matrix->DrawUniformizedSubstitutionNumber(stateup, statedown, length);
@@ -137,19 +173,17 @@ BranchSitePath* MatrixSubstitutionProcess::ResampleUniformized(int stateup, int
 
 	int state = stateup;
 
-	BranchSitePath* path = new BranchSitePath();
-	path->Reset(stateup);
+	path.Reset(stateup);
 
 	double t = y[0];
 	for (int r=0; r<m; r++)	{
 		int k = (r== m-1) ? statedown : matrix->DrawUniformizedTransition(state,statedown,m-r-1);
 		if (k != state)	{
-			path->Append(k,t);
+			path.Append(k,t);
 			t = 0;
 		}
 		state = k;
 		t += y[r+1] - y[r];
 	}
-	path->last->SetRelativeTime(t);
-	return path;
+	path.SetLastRelativeTime(t);
 }
@@ -24,8 +24,10 @@ class MatrixSubstitutionProcess : public virtual SubstitutionProcess, public vir
 
 	public:
 
-	MatrixSubstitutionProcess() {}
-	virtual ~MatrixSubstitutionProcess() {}
+	MatrixSubstitutionProcess() : propsite(0), propgroupsite(0), propgroupsize(0), propdupsite(0), propduprep(0), propmatrix(0), proprate(0) {}
+	virtual ~MatrixSubstitutionProcess() {
+		DeletePropagateArrays();
+	}
 
 	virtual int GetNstate(int site) {return GetMatrix(site)->GetNstate();}
 	virtual int GetNstate() {return GetMatrix(0)->GetNstate();}
@@ -38,12 +40,32 @@ class MatrixSubstitutionProcess : public virtual SubstitutionProcess, public vir
 
 	// CPU Level 3: implementations of likelihood propagation and substitution mapping methods
 	void Propagate(double*** from, double*** to, double time, bool condalloc = false);
+	void PropagateSites(double*** from, double*** to, double time, bool condalloc, int begin, int end, int thread);
+	void CheckPropagate(int site, const double* up, double* down, int nstate, SubMatrix* matrix, double time, double length);
 	BranchSitePath** SamplePaths(int* stateup, int* statedown, double time);
 	BranchSitePath** SampleRootPaths(int* rootstate);
-	BranchSitePath* ResampleAcceptReject(int maxtrial, int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix);
-	BranchSitePath* ResampleUniformized(int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix);
+	bool ResampleAcceptReject(PathBuilder& path, int maxtrial, int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix, int& ntrial);
+	double GetAcceptRejectProb(int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix);
+	void ResampleUniformized(PathBuilder& path, int stateup, int statedown, double rate, double totaltime, SubMatrix* matrix);
 
 	void SimuPropagate(int* stateup, int* statedown, double time);
+
+	// read from the environment
+	// PB_UNITRIALS=<x> : after a first rejection, accept-reject sampling of a site path is abandoned for uniformization
+	// whenever the expected number of trials exceeds x (default 20; 0 : always try accept-reject first, up to 1000 trials)
+	static double maxexpectedtrials;
+
+	// per-slave arrays used by Propagate to group sites sharing the same transition matrix
+	void CreatePropagateArrays();
+	void DeletePropagateArrays();
+
+	int* propsite;
+	int* propgroupsite;
+	int* propgroupsize;
+	int* propdupsite;
+	int* propduprep;
+	SubMatrix** propmatrix;
+	double* proprate;
 };
 
 #endif
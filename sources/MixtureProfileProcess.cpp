@@ -230,6 +230,18 @@ double MixtureProfileProcess::LogStatPrior(int cat)	{
 	return total;
 }
 
+void MixtureProfileProcess::LogStatProbArray(int site, int ncat, double* logprob)	{
+	for (int cat=0; cat<ncat; cat++)	{
+		logprob[cat] = LogStatProb(site,cat);
+	}
+}
+
+void MixtureProfileProcess::LogStatProbTable(int begin, int end, int ncat, double* logprob)	{
+	for (int site=begin; site<end; site++)	{
+		LogStatProbArray(site,ncat,logprob + (site-begin)*ncat);
+	}
+}
+
 double MixtureProfileProcess::ProfileSuffStatLogProb()	{
 	// simply, sum over all components
 	for (int i=0; i<GetNcomponent(); i++)	{
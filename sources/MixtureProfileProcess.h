@@ -75,6 +75,15 @@ class MixtureProfileProcess: public virtual ProfileProcess	{
 	// suffstat lnL of site <site> when allocated to component <cat>
 	virtual double LogStatProb(int site, int cat) = 0;
 
+	// same thing, for all components 0 <= cat < ncat at once (stored in logprob[cat])
+	// used by reallocation moves; may be specialized for efficiency
+	virtual void LogStatProbArray(int site, int ncat, double* logprob);
+
+	// same thing, for all sites begin <= site < end (stored in logprob[(site-begin)*ncat + cat])
+	// used by the reallocation moves of the slaves, while components are fixed
+	// by default, simply calls LogStatProbArray for each site in turn
+	virtual void LogStatProbTable(int begin, int end, int ncat, double* logprob);
+
 	// the component suff stat log prob is yet to be implemented in subclasses
 	virtual double ProfileSuffStatLogProb(int cat) = 0;
 
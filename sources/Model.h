@@ -33,8 +33,10 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 #include "CodonMutSelSBDPPhyloProcess.h"
 #include "AACodonMutSelSBDPPhyloProcess.h"
 #include "Parallel.h"
+#include "OutputWriter.h"
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 using namespace std;
 
@@ -301,8 +303,12 @@ class Model	{
 		ofstream ros((name + ".run").c_str());
 		ros << 1 << '\n';
 		ros.close();
+
+		// the output of each cycle is serialized here, and written to disk by the writer thread
+		// while the next cycle is computed
+		OutputWriter writer;
 	
-		while (RunningStatus() && ((until == -1) || (GetSize() < until)))	{
+		while (writer.GetRunStatus() && ((until == -1) || (GetSize() < until)))	{
 			if (GetSize() >= burnin)	{
 				process->SetBurnin(false);
 			}
@@ -311,34 +317,41 @@ class Model	{
 			
 			process->IncSize();
 
-			ofstream os((name + ".treelist").c_str(), ios_base::app);
+			ostringstream os;
 			process->SetNamesFromLengths();
 			process->RenormalizeBranchLengths();
 			GetTree()->ToStream(os);
 			process->DenormalizeBranchLengths();
-			os.close();
+			writer.Append(name + ".treelist",os.str());
 
-			ofstream tos((name + ".trace").c_str(), ios_base::app);
+			ostringstream tos;
 			Trace(tos);
-			tos.close();
+			writer.Append(name + ".trace",tos.str());
 
-			ofstream mos((name + ".monitor").c_str());
+			ostringstream mos;
 			process->Monitor(mos);
-			mos.close();
+			writer.Replace(name + ".monitor",mos.str());
 
-			ofstream pos((name + ".param").c_str());
+			ostringstream pos;
 			pos.precision(12);
 			ToStream(pos,true);
-			pos.close();
+			writer.Replace(name + ".param",pos.str());
 
 			if (saveall)	{
-				ofstream cos((name + ".chain").c_str(),ios_base::app);
+				ostringstream cos;
 				cos.precision(12);
 				ToStream(cos,false);
-				cos.close();
+				if (saveall == 2)	{
+					writer.AppendChain(name,cos.str());
+				}
+				else	{
+					writer.Append(name + ".chain",cos.str());
+				}
 			}
 
+			writer.PollRunStatus(name + ".run");
 		}	
+		writer.Flush();
 		cerr << name << ": stopping after " << GetSize() << " points.\n";
 		cerr << '\n';
 	}
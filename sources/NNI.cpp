@@ -37,8 +37,9 @@ extern MPI_Datatype Propagate_arg;
 double PhyloProcess::GibbsNNI(double tuning, int type){
 	if(!type){tuning=0;}
 	GlobalRootAtRandom();
+	// GlobalRootAtRandom does not update the conditional likelihoods
+	// this also computes the likelihood at the root
 	GlobalUpdateConditionalLikelihoods(); // It have to be call !
-	GlobalComputeNodeLikelihood(GetRoot());
 	int success =0;
 	int moves =0;
 
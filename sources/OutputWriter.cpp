@@ -0,0 +1,186 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "OutputWriter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+
+OutputWriter::OutputWriter() : busy(false), stop(false), runstatus(1)	{
+
+	pthread_mutex_init(&mutex,0);
+	pthread_cond_init(&workcond,0);
+	pthread_cond_init(&donecond,0);
+	if (pthread_create(&thread,0,Worker,this))	{
+		cerr << "error in OutputWriter: cannot create writer thread\n";
+		exit(1);
+	}
+}
+
+OutputWriter::~OutputWriter()	{
+
+	pthread_mutex_lock(&mutex);
+	stop = true;
+	pthread_cond_signal(&workcond);
+	pthread_mutex_unlock(&mutex);
+	pthread_join(thread,0);
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&workcond);
+	pthread_cond_destroy(&donecond);
+}
+
+void OutputWriter::Append(string file, string text)	{
+	Push(APPEND,file,text);
+}
+
+void OutputWriter::Replace(string file, string text)	{
+	Push(REPLACE,file,text);
+}
+
+void OutputWriter::AppendChain(string name, string sample)	{
+	Push(CHAIN,name,sample);
+}
+
+void OutputWriter::PollRunStatus(string file)	{
+	string empty;
+	Push(POLL,file,empty);
+}
+
+void OutputWriter::Push(RequestType type, string& file, string& text)	{
+
+	pthread_mutex_lock(&mutex);
+	while (queue.size() >= maxpending)	{
+		pthread_cond_wait(&donecond,&mutex);
+	}
+	CheckError();
+	queue.push_back(Request());
+	Request& request = queue.back();
+	request.type = type;
+	request.file.swap(file);
+	request.text.swap(text);
+	pthread_cond_signal(&workcond);
+	pthread_mutex_unlock(&mutex);
+}
+
+void OutputWriter::Flush()	{
+
+	string empty1, empty2;
+	Push(CLOSECHAIN,empty1,empty2);
+	pthread_mutex_lock(&mutex);
+	while (busy || (! queue.empty()))	{
+		pthread_cond_wait(&donecond,&mutex);
+	}
+	CheckError();
+	pthread_mutex_unlock(&mutex);
+}
+
+int OutputWriter::GetRunStatus()	{
+
+	pthread_mutex_lock(&mutex);
+	CheckError();
+	int ret = runstatus;
+	pthread_mutex_unlock(&mutex);
+	return ret;
+}
+
+void OutputWriter::CheckError()	{
+
+	if (error != "")	{
+		cerr << error << '\n';
+		exit(1);
+	}
+}
+
+void* OutputWriter::Worker(void* arg)	{
+
+	OutputWriter* writer = (OutputWriter*) arg;
+	pthread_mutex_lock(&writer->mutex);
+	while (true)	{
+		while ((! writer->stop) && writer->queue.empty())	{
+			pthread_cond_wait(&writer->workcond,&writer->mutex);
+		}
+		if (writer->queue.empty())	{
+			break;
+		}
+		Request request;
+		request.type = writer->queue.front().type;
+		request.file.swap(writer->queue.front().file);
+		request.text.swap(writer->queue.front().text);
+		writer->queue.pop_front();
+		if (writer->error != "")	{
+			// an earlier request failed: drop this one
+			pthread_cond_broadcast(&writer->donecond);
+			continue;
+		}
+		writer->busy = true;
+		pthread_mutex_unlock(&writer->mutex);
+
+		string error = writer->Execute(request);
+
+		pthread_mutex_lock(&writer->mutex);
+		writer->error = error;
+		writer->busy = false;
+		pthread_cond_broadcast(&writer->donecond);
+	}
+	pthread_mutex_unlock(&writer->mutex);
+	return 0;
+}
+
+string OutputWriter::Execute(Request& request)	{
+
+	string error;
+	if (request.type == APPEND)	{
+		ofstream os(request.file.c_str(), ios_base::app);
+		os << request.text;
+		if (! os)	{
+			error = "error: cannot write to " + request.file;
+		}
+	}
+	else if (request.type == REPLACE)	{
+		string tmp = request.file + ".tmp";
+		ofstream os(tmp.c_str());
+		os << request.text;
+		os.close();
+		if ((! os) || rename(tmp.c_str(),request.file.c_str()))	{
+			error = "error: cannot write to " + request.file;
+		}
+	}
+	else if (request.type == CHAIN)	{
+		if (! chain.IsOpen())	{
+			chain.Open(request.file,error);
+		}
+		if (error == "")	{
+			chain.Append(request.text,error);
+		}
+	}
+	else if (request.type == CLOSECHAIN)	{
+		if (chain.IsOpen())	{
+			chain.Close(error);
+		}
+	}
+	else	{
+		ifstream is(request.file.c_str());
+		int i = 0;
+		is >> i;
+		pthread_mutex_lock(&mutex);
+		runstatus = i;
+		pthread_mutex_unlock(&mutex);
+	}
+	return error;
+}
+
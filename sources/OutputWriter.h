@@ -0,0 +1,104 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+using namespace std;
+
+#include "ChainIO.h"
+
+// background writer for the output files of a run (see Model::Run)
+//
+// the master serializes its output (trace, tree, parameters, ...) into strings at the end of each cycle,
+// and hands them over to a writer thread, which writes them to disk while the next cycle is computed
+// requests are executed in the order in which they were made
+//
+// the .run file (run control) is also read by the writer thread:
+// GetRunStatus returns the value read at the last call to PollRunStatus that has been executed
+// (hence, a stop request is seen with a delay of at most one cycle)
+//
+// the writer thread makes no MPI call, and does not exit on I/O errors:
+// the first error is recorded, the remaining requests are dropped,
+// and the error is reported (followed by exit) by the master, at its next call to the writer
+
+class OutputWriter	{
+
+	public:
+
+	OutputWriter();
+	// waits for all pending requests
+	~OutputWriter();
+
+	// append text to file
+	void Append(string file, string text);
+
+	// replace the contents of file by text
+	// text is first written to file.tmp, which is then renamed into file
+	// (so that file is always complete, even if the run is killed while writing)
+	void Replace(string file, string text);
+
+	// append a sample to the binary chain name.chain (see ChainWriter)
+	// the chain is opened at the first sample, and its index is written by Flush
+	void AppendChain(string name, string sample);
+
+	// read an integer from file (0 if the file cannot be read)
+	void PollRunStatus(string file);
+	int GetRunStatus();
+
+	// closes the binary chain (if any), and waits until all requests have been executed
+	void Flush();
+
+	private:
+
+	enum RequestType {APPEND, REPLACE, CHAIN, CLOSECHAIN, POLL};
+
+	struct Request	{
+		RequestType type;
+		string file;
+		string text;
+	};
+
+	void Push(RequestType type, string& file, string& text);
+	// returns an error message (empty if the request succeeded)
+	string Execute(Request& request);
+	// master only, with mutex locked
+	void CheckError();
+
+	static void* Worker(void* arg);
+
+	// at most maxpending requests are waiting: beyond that, the master waits for the writer
+	static const unsigned int maxpending = 64;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t workcond;
+	pthread_cond_t donecond;
+	deque<Request> queue;
+	// only accessed by the writer thread
+	ChainWriter chain;
+	bool busy;
+	bool stop;
+	// shared with the writer thread: accessed with mutex locked
+	int runstatus;
+	string error;
+};
+
+#endif
+
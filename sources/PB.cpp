@@ -20,7 +20,9 @@ int main(int argc, char* argv[])	{
 
 	int myid,nprocs;
 
-	MPI_Init(&argc,&argv);
+	// only the main thread makes MPI calls (see ThreadPool)
+	int threadlevel;
+	MPI_Init_thread(&argc,&argv,MPI_THREAD_FUNNELED,&threadlevel);
 	MPI_Comm_rank(MPI_COMM_WORLD,&myid);
 	MPI_Comm_size(MPI_COMM_WORLD,&nprocs);
 
@@ -166,6 +168,9 @@ int main(int argc, char* argv[])	{
 			else if (s == "-S")	{
 				saveall = 0;
 			}
+			else if (s == "-sb")	{
+				saveall = 2;
+			}
 			else if (s == "-priorinit")	{
 				incinit = 0;
 			}
@@ -455,6 +460,7 @@ int main(int argc, char* argv[])	{
 			cerr << "\t-x <every> <until>  : saving frequency, and chain length (until = -1 : forever)\n";
 			cerr << "\t-f                  : forcing checks\n";
 			cerr << "\t-s/-S               : -s : save all / -S : save only the trees\n";
+			cerr << "\t-sb                 : save all, in indexed binary format (samples can be skipped without being parsed)\n";
 			cerr << '\n';
 			
 			cerr << '\n';
@@ -572,7 +578,10 @@ int main(int argc, char* argv[])	{
 			ofstream pos((name + ".param").c_str());
 			model->ToStream(pos,true);
 			pos.close();
-			if (saveall)	{
+			if (saveall == 2)	{
+				ChainWriter::Create(name);
+			}
+			else if (saveall)	{
 				ofstream cos((name + ".chain").c_str());
 			}
 			// cerr << "create files ok\n";
@@ -1064,7 +1064,7 @@ void PBTree::RootAt0Alphabetical()	{
 			min = i;
 		}
 	}
-	bp.mArray[min] = 1;
+	bp.SetTaxon(min);
 	bp.Modulo();
 	RootAt(bp);
 }
@@ -21,7 +21,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 const int TAG1 = 91;
 
-enum MESSAGE {KILL,SCAN,UPDATE_RATE,UPDATE_RRATE,UPDATE_BLENGTH,UPDATE_SRATE,UPDATE_SPROFILE,PARAMETER_DIFFUSION,UNFOLD,COLLAPSE,LIKELIHOOD,RESET,MULTIPLY,SMULTIPLY,INITIALIZE,PROPAGATE,PROPOSE,RESTORE,UPDATE,DETACH,ATTACH,NNI,KNIT,BRANCHPROPAGATE,ROOT,REALLOC_MOVE,PROFILE_MOVE,MIX_MOVE,REALLOC_DONE,GIVEMEMORE,BCAST_TREE,GETDIV,UNCLAMP,SETDATA,SETNODESTATES,CVSCORE,SETTESTDATA,GENE_MOVE,SAMPLE,LENGTH,ALPHA,SAVETREES, LENGTHFACTOR, FROMSTREAM, TOSTREAM, SITELOGL, RESTOREDATA, WRITE_MAPPING,NONSYNMAPPING,COUNTMAPPING,SITERATE,SIMULATE,SETRATEPRIOR,SETPROFILEPRIOR,SETROOTPRIOR};
+enum MESSAGE {KILL,SCAN,UPDATE_RATE,UPDATE_RRATE,UPDATE_BLENGTH,UPDATE_SRATE,UPDATE_SPROFILE,PARAMETER_DIFFUSION,UNFOLD,COLLAPSE,LIKELIHOOD,RESET,MULTIPLY,SMULTIPLY,INITIALIZE,PROPAGATE,PROPOSE,RESTORE,UPDATE,DETACH,ATTACH,NNI,KNIT,BRANCHPROPAGATE,ROOT,REALLOC_MOVE,PROFILE_MOVE,MIX_MOVE,REALLOC_DONE,GIVEMEMORE,BCAST_TREE,GETDIV,UNCLAMP,SETDATA,SETNODESTATES,CVSCORE,SETTESTDATA,GENE_MOVE,SAMPLE,LENGTH,ALPHA,SAVETREES, LENGTHFACTOR, FROMSTREAM, TOSTREAM, SITELOGL, RESTOREDATA, WRITE_MAPPING,NONSYNMAPPING,COUNTMAPPING,SITERATE,SIMULATE,SETRATEPRIOR,SETPROFILEPRIOR,SETROOTPRIOR,SLAVECOUNTS,UPDATE_DIRTY,BRANCHLENGTHSWEEP};
 
 struct prop_arg {
   double time;
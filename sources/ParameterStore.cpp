@@ -0,0 +1,130 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "ParameterStore.h"
+#include "Parallel.h"
+
+#include <cstring>
+
+void ParameterStore::AddDoubleBlocks(int nblock, int blocksize)	{
+	for (int b=0; b<nblock; b++)	{
+		dstart.push_back(dstart.back() + blocksize);
+	}
+	dvalue.resize(dstart.back());
+}
+
+void ParameterStore::AddIntBlocks(int nblock, int blocksize)	{
+	for (int b=0; b<nblock; b++)	{
+		istart.push_back(istart.back() + blocksize);
+	}
+	ivalue.resize(istart.back());
+}
+
+// message:
+// header : number of changed double blocks and int blocks (-1 : all blocks), total number of doubles and ints sent
+// indices of the changed blocks (double blocks, then int blocks), unless all blocks are sent
+// values of the changed double blocks, then of the changed int blocks
+
+void ParameterStore::Broadcast()	{
+
+	int ndblock = dstart.size() - 1;
+	int niblock = istart.size() - 1;
+
+	vector<int> index;
+	vector<double> dbuffer;
+	vector<int> ibuffer;
+
+	int header[4];
+	if (! broadcast)	{
+		header[0] = -1;
+		header[1] = -1;
+		dbuffer = dvalue;
+		ibuffer = ivalue;
+	}
+	else	{
+		for (int b=0; b<ndblock; b++)	{
+			if (memcmp(&dvalue[dstart[b]],&dsent[dstart[b]],(dstart[b+1]-dstart[b]) * sizeof(double)))	{
+				index.push_back(b);
+				dbuffer.insert(dbuffer.end(),dvalue.begin() + dstart[b],dvalue.begin() + dstart[b+1]);
+			}
+		}
+		header[0] = index.size();
+		for (int b=0; b<niblock; b++)	{
+			if (memcmp(&ivalue[istart[b]],&isent[istart[b]],(istart[b+1]-istart[b]) * sizeof(int)))	{
+				index.push_back(b);
+				ibuffer.insert(ibuffer.end(),ivalue.begin() + istart[b],ivalue.begin() + istart[b+1]);
+			}
+		}
+		header[1] = index.size() - header[0];
+	}
+	header[2] = dbuffer.size();
+	header[3] = ibuffer.size();
+
+	MPI_Bcast(header,4,MPI_INT,0,MPI_COMM_WORLD);
+	if (index.size())	{
+		MPI_Bcast(&index[0],index.size(),MPI_INT,0,MPI_COMM_WORLD);
+	}
+	if (dbuffer.size())	{
+		MPI_Bcast(&dbuffer[0],dbuffer.size(),MPI_DOUBLE,0,MPI_COMM_WORLD);
+	}
+	if (ibuffer.size())	{
+		MPI_Bcast(&ibuffer[0],ibuffer.size(),MPI_INT,0,MPI_COMM_WORLD);
+	}
+
+	dsent = dvalue;
+	isent = ivalue;
+	broadcast = true;
+}
+
+void ParameterStore::Receive()	{
+
+	int header[4];
+	MPI_Bcast(header,4,MPI_INT,0,MPI_COMM_WORLD);
+	int nindex = ((header[0] == -1) ? 0 : header[0]) + ((header[1] == -1) ? 0 : header[1]);
+	vector<int> index(nindex);
+	vector<double> dbuffer(header[2]);
+	vector<int> ibuffer(header[3]);
+	if (nindex)	{
+		MPI_Bcast(&index[0],nindex,MPI_INT,0,MPI_COMM_WORLD);
+	}
+	if (header[2])	{
+		MPI_Bcast(&dbuffer[0],header[2],MPI_DOUBLE,0,MPI_COMM_WORLD);
+	}
+	if (header[3])	{
+		MPI_Bcast(&ibuffer[0],header[3],MPI_INT,0,MPI_COMM_WORLD);
+	}
+
+	if (header[0] == -1)	{
+		dvalue = dbuffer;
+		ivalue = ibuffer;
+		return;
+	}
+	int k = 0;
+	for (int j=0; j<header[0]; j++)	{
+		int b = index[j];
+		for (int l=dstart[b]; l<dstart[b+1]; l++)	{
+			dvalue[l] = dbuffer[k++];
+		}
+	}
+	k = 0;
+	for (int j=header[0]; j<nindex; j++)	{
+		int b = index[j];
+		for (int l=istart[b]; l<istart[b+1]; l++)	{
+			ivalue[l] = ibuffer[k++];
+		}
+	}
+}
+
@@ -0,0 +1,77 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef PARAMETERSTORE_H
+#define PARAMETERSTORE_H
+
+#include <vector>
+using namespace std;
+
+// parameter vector broadcast by the master to the slaves (see GlobalUpdateParameters / SlaveUpdateParameters)
+//
+// the vector is made of a vector of doubles and a vector of ints, each divided into blocks
+// (for instance, one block per branch length, per mixture component, or per site allocation)
+// the master fills the whole vectors (GetDoubles, GetInts) and calls Broadcast
+// only the blocks that have changed since the last broadcast are sent (indices of the blocks, then their values),
+// and the slaves update their copy of the vectors accordingly (Receive)
+// after which the whole vectors on the slaves are identical to those of the master
+//
+// the layout should be the same on all processes (same sequence of calls to AddDoubleBlocks and AddIntBlocks)
+// the first broadcast sends everything
+
+class ParameterStore	{
+
+	public:
+
+	ParameterStore() : broadcast(false) {
+		dstart.push_back(0);
+		istart.push_back(0);
+	}
+
+	// appends nblock blocks of size blocksize
+	void AddDoubleBlocks(int nblock, int blocksize);
+	void AddIntBlocks(int nblock, int blocksize);
+
+	bool IsEmpty() {return (dstart.size() == 1) && (istart.size() == 1);}
+
+	int GetNdouble() {return dvalue.size();}
+	int GetNint() {return ivalue.size();}
+	double* GetDoubles() {return dvalue.size() ? &dvalue[0] : 0;}
+	int* GetInts() {return ivalue.size() ? &ivalue[0] : 0;}
+
+	// master
+	void Broadcast();
+
+	// slaves
+	void Receive();
+
+	private:
+
+	// start of each block (plus total size at the end)
+	vector<int> dstart;
+	vector<int> istart;
+
+	vector<double> dvalue;
+	vector<int> ivalue;
+
+	// master: values at the last broadcast
+	vector<double> dsent;
+	vector<int> isent;
+	bool broadcast;
+};
+
+#endif
+
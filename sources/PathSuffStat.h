@@ -0,0 +1,192 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef PATHSUFFSTAT_H
+#define PATHSUFFSTAT_H
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+// generic sufficient statistics of a collection of substitution histories
+// (one site, or all sites allocated to a given component):
+// - number of times in each state at the root
+// - total time spent in each state
+// - number of transitions between each pair of states
+//
+// waiting times are stored in a dense array of size Nstate,
+// together with the (sorted) list of states for which a waiting time has been recorded
+// root counts and pair counts are stored as small arrays sorted by state (resp. by from*Nstate+to)
+// paths typically visit only a few states, so that loops over these statistics
+// are much shorter than loops over all Nstate or Nstate*Nstate entries
+//
+// the arrays are allocated upon first use (Create is called automatically with the number of states of the first stat added)
+
+class PathSuffStat	{
+
+	public:
+
+	PathSuffStat() : nstate(0), waitingtime(0) {}
+	~PathSuffStat()	{
+		delete[] waitingtime;
+	}
+
+	void Create(int innstate)	{
+		if (nstate)	{
+			if (nstate != innstate)	{
+				cerr << "error in PathSuffStat::Create: non matching number of states\n";
+				cerr << nstate << '\t' << innstate << '\n';
+				exit(1);
+			}
+			return;
+		}
+		nstate = innstate;
+		waitingtime = new double[nstate];
+		for (int k=0; k<nstate; k++)	{
+			waitingtime[k] = 0;
+		}
+	}
+
+	int GetNstate() {return nstate;}
+
+	void Clear()	{
+		for (unsigned int k=0; k<visited.size(); k++)	{
+			waitingtime[visited[k]] = 0;
+		}
+		visited.clear();
+		rootstate.clear();
+		rootcount.clear();
+		pairindex.clear();
+		paircount.clear();
+	}
+
+	// root counts
+
+	void AddRootState(int state, int count = 1)	{
+		Insert(rootstate,rootcount,state,count);
+	}
+
+	int GetNroot() {return rootstate.size();}
+	int GetRootState(int k) {return rootstate[k];}
+	int GetRootCount(int k) {return rootcount[k];}
+
+	// waiting times
+
+	void AddWaitingTime(int state, double time)	{
+		vector<int>::iterator i = lower_bound(visited.begin(),visited.end(),state);
+		if ((i == visited.end()) || (*i != state))	{
+			visited.insert(i,state);
+		}
+		waitingtime[state] += time;
+	}
+
+	int GetNvisited() {return visited.size();}
+	int GetVisitedState(int k) {return visited[k];}
+	double GetWaitingTime(int state) {return waitingtime[state];}
+
+	// pair counts
+
+	void AddPair(int from, int to, int count = 1)	{
+		Insert(pairindex,paircount,from*nstate + to,count);
+	}
+
+	int GetNpair() {return pairindex.size();}
+	int GetPairFrom(int k) {return pairindex[k] / nstate;}
+	int GetPairTo(int k) {return pairindex[k] % nstate;}
+	int GetPairCount(int k) {return paircount[k];}
+
+	int GetPairCount(int from, int to)	{
+		vector<int>::iterator i = lower_bound(pairindex.begin(),pairindex.end(),from*nstate + to);
+		if ((i == pairindex.end()) || (*i != from*nstate + to))	{
+			return 0;
+		}
+		return paircount[i - pairindex.begin()];
+	}
+
+	int GetTotalPairCount()	{
+		int total = 0;
+		for (unsigned int k=0; k<paircount.size(); k++)	{
+			total += paircount[k];
+		}
+		return total;
+	}
+
+	// pool the statistics of another path (e.g. a site into its component)
+	void Add(PathSuffStat& from)	{
+		Create(from.nstate);
+		for (unsigned int k=0; k<from.rootstate.size(); k++)	{
+			Insert(rootstate,rootcount,from.rootstate[k],from.rootcount[k]);
+		}
+		for (unsigned int k=0; k<from.visited.size(); k++)	{
+			AddWaitingTime(from.visited[k],from.waitingtime[from.visited[k]]);
+		}
+		for (unsigned int k=0; k<from.pairindex.size(); k++)	{
+			Insert(pairindex,paircount,from.pairindex[k],from.paircount[k]);
+		}
+	}
+
+	// exchange contents (no copy)
+	void Swap(PathSuffStat& with)	{
+		int tmpnstate = nstate;
+		nstate = with.nstate;
+		with.nstate = tmpnstate;
+		double* tmptime = waitingtime;
+		waitingtime = with.waitingtime;
+		with.waitingtime = tmptime;
+		visited.swap(with.visited);
+		rootstate.swap(with.rootstate);
+		rootcount.swap(with.rootcount);
+		pairindex.swap(with.pairindex);
+		paircount.swap(with.paircount);
+	}
+
+	private:
+
+	// owns waitingtime: not copyable
+	PathSuffStat(const PathSuffStat&);
+	PathSuffStat& operator=(const PathSuffStat&);
+
+	// add count to entry of given index, keeping the index array sorted
+	// entries are most often added in increasing order, in which case this is just a push_back
+	static void Insert(vector<int>& index, vector<int>& count, int i, int n)	{
+		if (index.empty() || (index.back() < i))	{
+			index.push_back(i);
+			count.push_back(n);
+			return;
+		}
+		vector<int>::iterator it = lower_bound(index.begin(),index.end(),i);
+		int k = it - index.begin();
+		if (*it == i)	{
+			count[k] += n;
+		}
+		else	{
+			index.insert(it,i);
+			count.insert(count.begin() + k,n);
+		}
+	}
+
+	int nstate;
+	double* waitingtime;
+	vector<int> visited;
+	vector<int> rootstate;
+	vector<int> rootcount;
+	vector<int> pairindex;
+	vector<int> paircount;
+};
+
+#endif
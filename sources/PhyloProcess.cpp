@@ -26,6 +26,24 @@ extern MPI_Datatype Propagate_arg;
 
 #include "TexTab.h"
 
+static bool ReadBatchBranchLengthMove()	{
+	const char* tmp = getenv("PB_BLMOVE");
+	if (! tmp)	{
+		return true;
+	}
+	string move = tmp;
+	if (move == "step")	{
+		return false;
+	}
+	if (move != "batch")	{
+		cerr << "error: PB_BLMOVE should be batch or step\n";
+		exit(1);
+	}
+	return true;
+}
+
+bool PhyloProcess::batchbranchlengthmove = ReadBatchBranchLengthMove();
+
 //-------------------------------------------------------------------------
 //-------------------------------------------------------------------------
 //	* PhyloProcess
@@ -78,15 +96,11 @@ void PhyloProcess::CreateMappings()	{
 
 void PhyloProcess::DeleteMappings()	{
 
+	// all paths and path arrays are owned by the pool
 	for (int j=0; j<GetNbranch(); j++)	{
-		if (submap[j])	{
-			for (int i=sitemin; i<sitemax; i++)	{
-				delete submap[j][i];
-			}
-			delete[] submap[j];
-			submap[j] = 0;
-		}
+		submap[j] = 0;
 	}
+	pathpool.Reset();
 }
 
 void PhyloProcess::CreateSuffStat()	{
@@ -288,6 +302,69 @@ void PhyloProcess::PreOrderPruning(const Link* from, double*** aux)	{
 	}
 }
 
+void PhyloProcess::UpdateDirtyConditionalLikelihoods()	{
+	DirtyPostOrderPruning(GetRoot(),condlmap[0]);
+	DirtyPreOrderPruning(GetRoot(),condlmap[0]);
+}
+
+// the conditional likelihood vector of a link depends on the subtree on the other side of the link
+// it has to be recomputed whenever this subtree contains a dirty node
+// returns true if the product of the conditional likelihoods at from has changed
+// (in which case this product is in aux)
+bool PhyloProcess::DirtyPostOrderPruning(const Link* from, double*** aux)	{
+
+	if (from->isLeaf())	{
+		return false;
+	}
+	bool changed = IsDirty(from);
+	for (const Link* link=from->Next(); link!=from; link=link->Next())	{
+		bool tmp = DirtyPostOrderPruning(link->Out(),aux);
+		if (tmp)	{
+			Propagate(aux,GetConditionalLikelihoodVector(link),GetLength(link->GetBranch()));
+			changed = true;
+		}
+		condlchanged[GetLinkIndex(link)] = tmp;
+	}
+	if (changed)	{
+		Reset(aux);
+		for (const Link* link=from->Next(); link!=from; link=link->Next())	{
+			Multiply(GetConditionalLikelihoodVector(link),aux);
+		}
+		Offset(aux);
+	}
+	return changed;
+}
+
+void PhyloProcess::DirtyPreOrderPruning(const Link* from, double*** aux)	{
+
+	for (const Link* link=from->Next(); link!=from; link=link->Next())	{
+		if (! link->Out()->isLeaf())	{
+			bool changed = IsDirty(from);
+			for (const Link* link2=link->Next(); link2!=link; link2=link2->Next())	{
+				if ((! link2->isRoot()) && condlchanged[GetLinkIndex(link2)])	{
+					changed = true;
+				}
+			}
+			if (changed)	{
+				Reset(aux);
+				for (const Link* link2=link->Next(); link2!=link; link2=link2->Next())	{
+					if (! link2->isRoot())	{
+						Multiply(GetConditionalLikelihoodVector(link2),aux);
+					}
+				}
+				Propagate(aux,GetConditionalLikelihoodVector(link->Out()),GetLength(link->GetBranch()));
+			}
+			condlchanged[GetLinkIndex(link->Out())] = changed;
+		}
+	}
+	condldirty[from->GetNode()->GetIndex()] = false;
+	for (const Link* link=from->Next(); link!=from; link=link->Next())	{
+		if (! link->Out()->isLeaf())	{
+			DirtyPreOrderPruning(link->Out(),aux);
+		}
+	}
+}
+
 void PhyloProcess::GlobalRecursiveComputeLikelihood(const Link* from, int auxindex, vector<double>& logl)	{
 
 	double lnL = GlobalComputeNodeLikelihood(from,auxindex);
@@ -381,12 +458,154 @@ void PhyloProcess::SampleSubstitutionMappings(const Link* from)	{
 // MPI master functions
 double PhyloProcess::BranchLengthMove(double tuning)	{
 
-	// uses condlmap[0] as auxiliary variable
+	long mpicountbefore = mpicount;
+	double ret = 0;
+	if (batchbranchlengthmove)	{
+		ret = GlobalBatchBranchLengthMove(tuning);
+	}
+	else	{
+		// uses condlmap[0] as auxiliary variable
+		int n = 0;
+		double total = RecursiveBranchLengthMove(GetRoot(),tuning,n);
+		ret = total / n;
+	}
+	branchlengthmpicount += mpicount - mpicountbefore;
+	nbranchlengthmove++;
+	return ret;
+}
+
+// same sequence of proposals as BranchLengthMove
+// but the whole sweep is run by all processes at once:
+// the master sends all random numbers needed for the sweep in one single message
+// then for each proposal, the slaves compute the likelihood over their sites
+// the master computes the prior and the hastings ratio
+// and everything is summed up by one MPI_Allreduce, so that all processes take the same decision
+double PhyloProcess::GlobalBatchBranchLengthMove(double tuning)	{
+
+	assert(myid == 0);
+	int nprop = 2 * (GetTree()->CountNodes(GetRoot()) - 1);
+	double* args = new double[2 + 2*nprop];
+	args[0] = tuning;
+	args[1] = logL;
+	// in the same order as in LocalBranchLengthMove:
+	// one random number for the proposal, one for the acceptance
+	for (int k=0; k<2*nprop; k++)	{
+		args[2+k] = rnd::GetRandom().Uniform();
+	}
+
+	MESSAGE signal = BRANCHLENGTHSWEEP;
+	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
+	MPI_Bcast(&nprop,1,MPI_INT,0,MPI_COMM_WORLD);
+	MPI_Bcast(args,2+2*nprop,MPI_DOUBLE,0,MPI_COMM_WORLD);
+	mpicount += 3 + nprop;
+
 	int n = 0;
-	double total = RecursiveBranchLengthMove(GetRoot(),tuning,n);
+	double total = RecursiveBatchBranchLengthMove(GetRoot(),tuning,args+2,n);
+	delete[] args;
 	return total / n;
 }
 
+void PhyloProcess::SlaveBatchBranchLengthMove()	{
+
+	assert(myid > 0);
+	int nprop;
+	MPI_Bcast(&nprop,1,MPI_INT,0,MPI_COMM_WORLD);
+	double* args = new double[2 + 2*nprop];
+	MPI_Bcast(args,2+2*nprop,MPI_DOUBLE,0,MPI_COMM_WORLD);
+	double tuning = args[0];
+	logL = args[1];
+	int n = 0;
+	RecursiveBatchBranchLengthMove(GetRoot(),tuning,args+2,n);
+	delete[] args;
+}
+
+// same recursion as RecursiveBranchLengthMove
+// executed by the master (branch lengths and priors only) and by the slaves (conditional likelihoods)
+double PhyloProcess::RecursiveBatchBranchLengthMove(const Link* from, double tuning, const double* u, int& n)	{
+
+	// uses condlmap[0] as auxiliary variable
+	double total = 0;
+
+	if (! from->isRoot())	{
+		total += LocalBatchBranchLengthMove(from,tuning,u,n);
+	}
+	
+	for (const Link* link=from->Next(); link!=from; link=link->Next())	{
+		if (myid)	{
+			Reset(condlmap[0]);
+			for (const Link* link2=link->Next(); link2!=link; link2=link2->Next())	{
+				if (! link2->isRoot())	{
+					Multiply(GetConditionalLikelihoodVector(link2),condlmap[0]);
+				}
+			}
+		}
+		total += RecursiveBatchBranchLengthMove(link->Out(),tuning,u,n);
+	}
+
+	if (myid)	{
+		if (from->isLeaf())	{
+			Initialize(condlmap[0],GetData(from));
+		}
+		else	{
+			Reset(condlmap[0]);
+			for (const Link* link=from->Next(); link!=from; link=link->Next())	{
+				if (! link->isRoot())	{
+					Multiply(GetConditionalLikelihoodVector(link),condlmap[0]);
+				}
+			}
+		}
+	}
+	
+	if (! from->isRoot())	{
+		total += LocalBatchBranchLengthMove(from->Out(),tuning,u,n);
+	}
+
+	return total;
+}
+
+double PhyloProcess::LocalBatchBranchLengthMove(const Link* from, double tuning, const double* u, int& n)	{
+
+	// uses condlmap[0] as auxiliary variable
+	// logL is the total log likelihood, on the master and on the slaves
+
+	double currentloglikelihood = logL;
+	const Branch* branch = from->GetBranch();
+	double m = tuning * (u[2*n] - 0.5);
+	double logu = log(u[2*n+1]);
+	n++;
+
+	// [0] : log likelihood (summed over slaves)
+	// [1] : log prior ratio + log hastings (master only)
+	double local[] = {0,0};
+	double global[2];
+	if (myid)	{
+		MoveBranch(branch,m);
+		Propagate(condlmap[0],GetConditionalLikelihoodVector(from),GetLength(branch));
+		Offset(GetConditionalLikelihoodVector(from));
+		local[0] = ComputeNodeLikelihood(from);
+	}
+	else	{
+		double currentlogprior = LogBranchLengthPrior(branch);
+		MoveBranch(branch,m);
+		local[1] = LogBranchLengthPrior(branch) - currentlogprior + m;
+	}
+	MPI_Allreduce(local,global,2,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+
+	double delta = global[0] + global[1] - currentloglikelihood;
+	int accepted = (logu < delta);
+	if (!accepted)	{
+		Restore(branch);
+		if (myid)	{
+			Propagate(condlmap[0],GetConditionalLikelihoodVector(from),GetLength(branch));
+			Offset(GetConditionalLikelihoodVector(from));
+			ComputeNodeLikelihood(from);
+		}
+	}
+	// on the slaves, ComputeNodeLikelihood has overwritten logL with the log likelihood over their own sites
+	logL = accepted ? global[0] : currentloglikelihood;
+	return (double) accepted;
+}
+
 // assumes aux contains the product of incoming likelihoods
 double PhyloProcess::RecursiveBranchLengthMove(const Link* from, double tuning, int& n)	{
 
@@ -583,9 +802,8 @@ double PhyloProcess::GibbsSPR(int nrep)	{
 	GlobalBroadcastTree();
 	*/
 	
-	GlobalUpdateConditionalLikelihoods();
-
-
+	// not necessary: each call to GibbsSPR() leaves the conditional likelihoods updated
+	// GlobalUpdateConditionalLikelihoods();
 
 	return naccepted / nrep;
 }
@@ -624,7 +842,8 @@ int PhyloProcess::GibbsSPR()	{
 		exit(1);
 	}
 
-	GlobalUpdateConditionalLikelihoods();
+	// only the conditional likelihoods pointing away from the pruning point need to be recomputed
+	GlobalUpdateDirtyConditionalLikelihoods();
 	// UpdateConditionalLikelihoods();
 	
 	// double* loglarray = new double[GetNbranch()];
@@ -684,7 +903,7 @@ int PhyloProcess::GibbsSPR()	{
 	}
 	GlobalAttach(down,up,i->first.first,i->first.second);
 	// GetTree()->Attach(down,up,i->first.first,i->first.second);
-	GlobalUpdateConditionalLikelihoods();
+	GlobalUpdateDirtyConditionalLikelihoods();
 	// UpdateConditionalLikelihoods();
 	// delete[] loglarray;
 	return accepted;
@@ -917,19 +1136,19 @@ void PhyloProcess::Create(Tree* intree, SequenceAlignment* indata,int indim)	{
 		data->GetEmpiricalFreq(empfreq);
 
 		loglarray = new double[GetNbranch()];
+		// MPI : master and slaves
+		// partition of the sites among slaves (normally already made by the constructor of the concrete class)
+		if (! mpipartition)	{
+			MakeMPIPartition(data);
+		}
 		// MPI : slaves only
 		// for each slave, should specify the range of sites (sitemin <= i < sitemax)
 		// SubstitutionProcess::Create(data->GetNsite(),indim, sitemin, sitemax);
 		if (myid > 0) {
-			int sitemin,sitemax,width = data->GetNsite()/(nprocs-1);
-			sitemin = (myid-1)*width;
-			if (myid == (nprocs-1)) {
-				sitemax = data->GetNsite();
-			}
-			else {
-				sitemax = myid*width;
-			} 
+			int sitemin = GetProcSiteMin(myid);
+			int sitemax = GetProcSiteMax(myid);
 			SubstitutionProcess::Create(data->GetNsite(),indim,sitemin,sitemax);
+			ComputeSitePatterns();
 
 			submap = new BranchSitePath**[GetNbranch()];
 			for (int j=0; j<GetNbranch(); j++)	{
@@ -937,6 +1156,11 @@ void PhyloProcess::Create(Tree* intree, SequenceAlignment* indata,int indim)	{
 			}
 			nodestate = new int*[GetNnode()];
 			condlmap = new double***[GetNlink()];
+			condldirty = new bool[GetNnode()];
+			for (int j=0; j<GetNnode(); j++)	{
+				condldirty[j] = false;
+			}
+			condlchanged = new bool[GetNlink()];
 			CreateNodeStates();
 			CreateMappings();
 			condflag = false;
@@ -954,21 +1178,37 @@ void PhyloProcess::Create(Tree* intree, SequenceAlignment* indata,int indim)	{
 	}
 }
 
+// test sites are partitioned like the main sites (see MakeMPIPartition)
+// except that a slave cannot be given more test sites than it has main sites (they are written over them, see SetTestData)
+// called by the master and the slaves, once the test data have been sent:
+// the master, which has the test alignment, makes the partition and sends it to the slaves
 void PhyloProcess::SetTestSiteMinAndMax()	{
 
+	int* bound = new int[nprocs];
+	if (! myid)	{
+		MPIPartition testpartition(nprocs,myid,testnsite);
+		for (int i=0; i<testnsite; i++)	{
+			testpartition.SetSiteCost(i,GetSiteCost(testdata,i));
+		}
+		int* maxwidth = new int[nprocs-1];
+		for (int proc=1; proc<nprocs; proc++)	{
+			maxwidth[proc-1] = GetProcSiteMax(proc) - GetProcSiteMin(proc);
+		}
+		testpartition.MakeMPIPartition(maxwidth);
+		delete[] maxwidth;
+		bound[0] = 0;
+		for (int proc=1; proc<nprocs; proc++)	{
+			bound[proc] = testpartition.GetSiteMax(proc);
+		}
+	}
+	MPI_Bcast(bound,nprocs,MPI_INT,0,MPI_COMM_WORLD);
+
 	bksitemax = sitemax;
 	if (myid > 0) {
-		int width = testnsite/(nprocs-1);
-		testsitemin = (myid-1)*width;
-		testsitemax = 0;
-		if (myid == (nprocs-1)) {
-			testsitemax = testnsite;
-		}
-		else {
-			testsitemax = myid*width;
-		} 
-		// sitemax = sitemin + (testsitemax - testsitemin);
+		testsitemin = bound[myid-1];
+		testsitemax = bound[myid];
 	}
+	delete[] bound;
 }
 
 
@@ -983,6 +1223,8 @@ void PhyloProcess::Delete() {
 			delete[] submap;
 			delete[] nodestate;
 			delete[] condlmap;
+			delete[] condldirty;
+			delete[] condlchanged;
 			SubstitutionProcess::Delete();
 		}
 		// MPI master and slaves
@@ -992,6 +1234,18 @@ void PhyloProcess::Delete() {
 
 		delete[] empfreq;
 	}
+	delete mpipartition;
+	mpipartition = 0;
+}
+
+void PhyloProcess::MakeMPIPartition(SequenceAlignment* indata)	{
+
+	delete mpipartition;
+	mpipartition = new MPIPartition(nprocs,myid,indata->GetNsite());
+	for (int i=0; i<indata->GetNsite(); i++)	{
+		mpipartition->SetSiteCost(i,GetSiteCost(indata,i));
+	}
+	mpipartition->MakeMPIPartition();
 }
 
 void PhyloProcess::GlobalUnclamp()	{
@@ -1016,14 +1270,12 @@ void PhyloProcess::GlobalSetDataFromLeaves()	{
 	MESSAGE signal = SETDATA;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	int maxwidth = 0;
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		if (maxwidth < (smax[i] - smin[i]))	{
 			maxwidth = smax[i] - smin[i];
 		}
@@ -1051,14 +1303,12 @@ void PhyloProcess::GlobalSetNodeStates()	{
 	MESSAGE signal = SETNODESTATES;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	int maxwidth = 0;
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		if (maxwidth < (smax[i] - smin[i]))	{
 			maxwidth = smax[i] - smin[i];
 		}
@@ -1248,6 +1498,7 @@ double PhyloProcess::GlobalComputeNodeLikelihood(const Link* from, int auxindex)
 		MPI_Recv(&sum,1,MPI_DOUBLE,MPI_ANY_SOURCE,TAG1,MPI_COMM_WORLD,&stat);
 		logL += sum;
 	}
+	mpicount += nprocs + 1;
 	return logL;
 }
 
@@ -1264,6 +1515,7 @@ void PhyloProcess::GlobalReset(const Link* link, bool condalloc)	{
 	args[0] = GetLinkIndex(link);
 	args[1] = (condalloc) ? 1 : 0;
 	MPI_Bcast(args,2,MPI_INT,0,MPI_COMM_WORLD);
+	mpicount += 2;
 }
 
 
@@ -1281,6 +1533,7 @@ void PhyloProcess::GlobalMultiply(const Link* from, const Link* to, bool condall
 	args[1] = GetLinkIndex(to);
 	args[2] = (condalloc) ? 1 : 0;
 	MPI_Bcast(args,3,MPI_INT,0,MPI_COMM_WORLD);
+	mpicount += 2;
 }
 
 void PhyloProcess::GlobalMultiplyByStationaries(const Link* from, bool condalloc)	{
@@ -1306,6 +1559,7 @@ void PhyloProcess::GlobalInitialize(const Link* from, const Link* link, bool con
 	args[1] = GetLinkIndex(link);
 	args[2] = (condalloc) ? 1 : 0;
 	MPI_Bcast(args,3,MPI_INT,0,MPI_COMM_WORLD);
+	mpicount += 2;
 }
 
 
@@ -1321,6 +1575,7 @@ void PhyloProcess::GlobalPropagate(const Link* from, const Link* to, double time
 	args.condalloc = (condalloc) ? 1 : 0;
 	args.time = time;
 	MPI_Bcast(&args,1,Propagate_arg,0,MPI_COMM_WORLD);
+	mpicount += 2;
 }
 
 double PhyloProcess::GlobalProposeMove(const Branch* branch, double tuning)	{
@@ -1337,6 +1592,7 @@ double PhyloProcess::GlobalProposeMove(const Branch* branch, double tuning)	{
 	args.time = m;
 	args.condalloc = branch->GetIndex();
 	MPI_Bcast(&args,1,Propagate_arg,0,MPI_COMM_WORLD);
+	mpicount += 2;
 	MoveBranch(branch,m);
 	return m;
 }
@@ -1350,6 +1606,7 @@ void PhyloProcess::GlobalRestore(const Branch* branch)	{
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 	int n = branch->GetIndex();
 	MPI_Bcast(&n,1,MPI_INT,0,MPI_COMM_WORLD);
+	mpicount += 2;
 	Restore(branch);
 }
 
@@ -1365,6 +1622,17 @@ void PhyloProcess::GlobalUpdateConditionalLikelihoods()	{
 	// GlobalCheckLikelihood();
 }
 
+// only valid if the tree topology is the only thing that has changed since the last update
+// (through GlobalDetach and GlobalAttach)
+void PhyloProcess::GlobalUpdateDirtyConditionalLikelihoods()	{
+
+	assert(myid == 0);
+	MESSAGE signal = UPDATE_DIRTY;
+	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
+
+	GlobalComputeNodeLikelihood(GetRoot(),0);
+}
+
 Link* PhyloProcess::GlobalDetach(Link* down, Link* up)	{
 
 	// MPI
@@ -1417,8 +1685,8 @@ void PhyloProcess::GlobalRootAtRandom()	{
 		exit(1);
 	}
 	GetTree()->RootAt(newroot);
-	GlobalUpdateConditionalLikelihoods();	
-	
+	// conditional likelihoods do not depend on the position of the root
+	// GlobalUpdateConditionalLikelihoods();	
 }
 
 
@@ -1503,6 +1771,9 @@ void PhyloProcess::SlaveExecute(MESSAGE signal)	{
 		MPI_Bcast(arg,2,MPI_INT,0,MPI_COMM_WORLD);
 		SlaveGibbsSPRScan(arg[0],arg[1]);
 		break;
+	case BRANCHLENGTHSWEEP:
+		SlaveBatchBranchLengthMove();
+		break;
 	case PROPOSE:
 		MPI_Bcast(&alpha,1,Propagate_arg,0,MPI_COMM_WORLD);
 		SlavePropose(alpha.condalloc,alpha.time);
@@ -1565,6 +1836,9 @@ void PhyloProcess::SlaveExecute(MESSAGE signal)	{
 	case 	UPDATE:
 		UpdateConditionalLikelihoods();
 		break;
+	case 	UPDATE_DIRTY:
+		UpdateDirtyConditionalLikelihoods();
+		break;
 	case UPDATE_SRATE:
 		SlaveUpdateSiteRateSuffStat();
 		break;
@@ -1616,6 +1890,9 @@ void PhyloProcess::SlaveExecute(MESSAGE signal)	{
 	case SIMULATE:
 		SimulateForward();
 		break;
+	case SLAVECOUNTS:
+		SlaveSendCounts();
+		break;
 	
 	default:
 		// or : SubstitutionProcess::SlaveExecute?
@@ -1704,7 +1981,9 @@ void PhyloProcess::SlaveDetach(int n,int m) {
 	assert(myid > 0);
 	Link* down = GetLinkForGibbs(n);
 	Link* up = GetLinkForGibbs(m);
-	GetTree()->Detach(down,up);
+	SetDirty(down->Out());
+	Link* fromdown = GetTree()->Detach(down,up);
+	SetDirty(fromdown->Out());
 }
 
 void PhyloProcess::SlaveAttach(int n,int m,int p,int q) {
@@ -1714,6 +1993,8 @@ void PhyloProcess::SlaveAttach(int n,int m,int p,int q) {
 	Link* fromdown = GetLinkForGibbs(p);
 	Link* fromup = GetLinkForGibbs(q);
 	GetTree()->Attach(down,up,fromdown,fromup);
+	SetDirty(up);
+	SetDirty(fromup);
 }
 
 
@@ -1860,18 +2141,16 @@ void PhyloProcess::GlobalUpdateSiteRateSuffStat()	{
 	// each slave computes its array for sitemin <= site < sitemax
 	// thus, one just needs to gather all arrays into the big master array 0 <= site < Nsite
 	// (gather)
-	int i,j,k,width,nalloc,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
+	int i,j,k,nalloc,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
 	MPI_Status stat;
 	MESSAGE signal = UPDATE_SRATE;
 
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 
-	width = GetNsite()/(nprocs-1);
 	nalloc = 0;
 	for(i=0; i<nprocs-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (nprocs-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		workload[i] = smax[i] - smin[i];
 		if (workload[i] > nalloc) nalloc = workload[i];
 	}
@@ -1986,17 +2265,15 @@ void PhyloProcess::GlobalGetMeanSiteRate()	{
 	}
 
 	assert(myid == 0);
-	int i,width,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
+	int i,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
 	MPI_Status stat;
 	MESSAGE signal = SITERATE;
 
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 
-	width = GetNsite()/(nprocs-1);
 	for(i=0; i<nprocs-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (nprocs-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 	for(i=1; i<nprocs; ++i) {
 		MPI_Recv(meansiterate+smin[i-1],smax[i-1]-smin[i-1],MPI_DOUBLE,i,TAG1,MPI_COMM_WORLD,&stat);
@@ -2199,11 +2476,7 @@ void PhyloProcess::ReadPB(int argc, char* argv[])	{
 
 void PhyloProcess::Read(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << '\n';
 	cerr << "burnin : " << burnin << "\n";
@@ -2213,7 +2486,7 @@ void PhyloProcess::Read(string name, int burnin, int every, int until)	{
 
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -2225,7 +2498,7 @@ void PhyloProcess::Read(string name, int burnin, int every, int until)	{
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		double alpha = GetAlpha();
 		alphalist.push_back(alpha);
@@ -2233,7 +2506,7 @@ void PhyloProcess::Read(string name, int burnin, int every, int until)	{
 		lengthlist.push_back(length);
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -2252,17 +2525,13 @@ void PhyloProcess::Read(string name, int burnin, int every, int until)	{
 
 void PhyloProcess::ReadSiteRates(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -2276,7 +2545,7 @@ void PhyloProcess::ReadSiteRates(string name, int burnin, int every, int until)
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		QuickUpdate();
@@ -2291,7 +2560,7 @@ void PhyloProcess::ReadSiteRates(string name, int burnin, int every, int until)
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -2314,11 +2583,7 @@ void PhyloProcess::PostPred(int ppredtype, string name, int burnin, int every, i
 	GlobalSetProfilePrior(inprofileprior);
 	GlobalSetRootPrior(inrootprior);
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	double* obstaxstat = new double[GetNtaxa()];
 	SequenceAlignment* datacopy  = new SequenceAlignment(GetData());
@@ -2337,7 +2602,7 @@ void PhyloProcess::PostPred(int ppredtype, string name, int burnin, int every, i
 	// cerr << "number of points : " << (until - burnin)/every << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -2359,7 +2624,7 @@ void PhyloProcess::PostPred(int ppredtype, string name, int burnin, int every, i
 	while (i < until)	{
 		cerr << ".";
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		// output tree
@@ -2422,7 +2687,7 @@ void PhyloProcess::PostPred(int ppredtype, string name, int burnin, int every, i
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -2494,6 +2759,7 @@ void PhyloProcess::GlobalSetTestData()	{
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 	MPI_Bcast(&testnsite,1,MPI_INT,0,MPI_COMM_WORLD);
 	MPI_Bcast(tmp,testnsite*GetNtaxa(),MPI_INT,0,MPI_COMM_WORLD);
+	SetTestSiteMinAndMax();
 
 	delete[] tmp;
 }
@@ -2506,17 +2772,36 @@ void PhyloProcess::SlaveSetTestData()	{
 	
 	SetTestSiteMinAndMax();
 	data->SetTestData(testnsite,sitemin,testsitemin,testsitemax,tmp);
+	ComputeSitePatterns();
 
 	delete[] tmp;
 }
 
+void PhyloProcess::ComputeSitePatterns()	{
+
+	if (! sitepattern)	{
+		sitepattern = new int[GetNsite()];
+	}
+	map<vector<int>,int> pattern;
+	vector<int> column(GetNtaxa());
+	for (int i=sitemin; i<sitemax; i++)	{
+		for (int j=0; j<GetNtaxa(); j++)	{
+			column[j] = data->GetState(j,i);
+		}
+		map<vector<int>,int>::iterator it = pattern.find(column);
+		if (it == pattern.end())	{
+			pattern[column] = i;
+			sitepattern[i] = i;
+		}
+		else	{
+			sitepattern[i] = it->second;
+		}
+	}
+}
+
 void PhyloProcess::ReadCV(string testdatafile, string name, int burnin, int every, int until, int iscodon, GeneticCodeType codetype)	{
 	
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	if (iscodon)	{
 		SequenceAlignment* tempdata = new FileSequenceAlignment(testdatafile,0,myid);
@@ -2533,7 +2818,7 @@ void PhyloProcess::ReadCV(string testdatafile, string name, int burnin, int ever
 	while ((i < until) && (i < burnin))	{
 		cout << "before FromStream...\n";
 		cout.flush();
-		FromStream(is);
+		SkipChainSample(chain);
 		cout << "after FromStream...\n";
 		cout.flush();
 		i++;
@@ -2545,7 +2830,7 @@ void PhyloProcess::ReadCV(string testdatafile, string name, int burnin, int ever
 	while (i < until)	{
 		cerr << ".";
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		QuickUpdate();
 		// Trace(cerr);
@@ -2563,7 +2848,7 @@ void PhyloProcess::ReadCV(string testdatafile, string name, int burnin, int ever
 		
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -2593,17 +2878,13 @@ void PhyloProcess::ReadCV(string testdatafile, string name, int burnin, int ever
 
 void PhyloProcess::ReadSiteLogL(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin: " << burnin << '\n';
 	cerr << "every " << every << " points until " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -2616,14 +2897,12 @@ void PhyloProcess::ReadSiteLogL(string name, int burnin, int every, int until)	{
 		mean[i] = 0;
 	}
 
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	int maxwidth = 0;
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		if (maxwidth < (smax[i] - smin[i]))	{
 			maxwidth = smax[i] - smin[i];
 		}
@@ -2632,7 +2911,7 @@ void PhyloProcess::ReadSiteLogL(string name, int burnin, int every, int until)	{
 	while (i < until)	{
 		cerr << ".";
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 		QuickUpdate();
 		// Trace(cerr);
@@ -2654,7 +2933,7 @@ void PhyloProcess::ReadSiteLogL(string name, int burnin, int every, int until)	{
 		
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -2707,35 +2986,26 @@ void PhyloProcess::ReadSiteLogL(string name, int burnin, int every, int until)	{
 
 
 void PhyloProcess::ReadMap(string name, int burnin, int every, int until){
-  	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
 	double meandiff = 0;
 	double vardiff = 0;
 	double meanobs = 0;
-	for(int i = 0; i < GetNsite(); i++){
-		stringstream osfmap;
-		osfmap << name << '_' << i << ".map";
-		ofstream osmap((osfmap.str()).c_str());
-		osmap.close();
-	}
+	MappingWriter mapfile(name,GetNsite());
 	while (i < until)	{
 		cerr << ".";
 		// cerr << i << '\t' << rnd::GetRandom().Uniform() << '\n';
 
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		// prepare file for ancestral node states
@@ -2752,7 +3022,7 @@ void PhyloProcess::ReadMap(string name, int burnin, int every, int until){
 		GlobalCollapse();
 
 		// write posterior mappings
-		GlobalWriteMappings(name);
+		GlobalWriteMappings(mapfile);
 
 		// write posterior ancestral node states
 		GlobalSetNodeStates();
@@ -2769,7 +3039,7 @@ void PhyloProcess::ReadMap(string name, int burnin, int every, int until){
 		GlobalSetDataFromLeaves();
 
 		// write posterior predictive mappings
-		GlobalWriteMappings(name);
+		GlobalWriteMappings(mapfile);
 
 		// write posterior predictive ancestral node states
 		GlobalSetNodeStates();
@@ -2787,17 +3057,9 @@ void PhyloProcess::ReadMap(string name, int burnin, int every, int until){
 		GlobalRestoreData();
 		GlobalUnfold();
 
-		for(int i = 0; i < GetNsite(); i++){
-			stringstream osfmap;
-			osfmap << name << '_' << i << ".map";
-			ofstream osmap((osfmap.str()).c_str(), ios_base::app);
-			osmap << '\n';
-			osmap.close();
-		}
-
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -2809,48 +3071,54 @@ void PhyloProcess::ReadMap(string name, int burnin, int every, int until){
 	meanobs /= samplesize;
 	cerr << "mean obs : " << meanobs << '\n';
 	cerr << meandiff << '\t' << sqrt(vardiff) << '\n';
+	cerr << "stochastic mappings in " << name << ".maps (posterior and posterior predictive mapping for each sample)\n";
+	cerr << "per-site mappings can be extracted with extractmap\n";
 }
 
-void PhyloProcess::GlobalWriteMappings(string name){
-	MPI_Status stat;
+void PhyloProcess::GlobalWriteMappings(MappingWriter& mapfile){
+
+	assert(myid == 0);
 	MESSAGE signal = WRITE_MAPPING;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 
-	 //send the chain name
-	ostringstream os;
-	os << name;
-	string s = os.str();
-	unsigned int len = s.length();
-	unsigned char* bvector = new unsigned char[len];
-	for (unsigned int i=0; i<len; i++)	{
-		bvector[i] = s[i];
+	// each slave sends the lengths of the mappings of its sites, and then their concatenated text
+	vector<string> sitemapping(GetNsite());
+	MPI_Status stat;
+	for(int i=1; i<GetNprocs(); ++i) {
+		int smin = GetProcSiteMin(i);
+		int smax = GetProcSiteMax(i);
+		int* len = new int[smax - smin];
+		MPI_Recv(len,smax-smin,MPI_INT,i,TAG1,MPI_COMM_WORLD,&stat);
+		int total = 0;
+		for (int j=smin; j<smax; j++)	{
+			total += len[j-smin];
+		}
+		char* text = new char[total];
+		MPI_Recv(text,total,MPI_CHAR,i,TAG1,MPI_COMM_WORLD,&stat);
+		int k = 0;
+		for (int j=smin; j<smax; j++)	{
+			sitemapping[j].assign(text + k, len[j-smin]);
+			k += len[j-smin];
+		}
+		delete[] text;
+		delete[] len;
 	}
-	MPI_Bcast(&len,1,MPI_INT,0,MPI_COMM_WORLD);
-	MPI_Bcast(bvector,len,MPI_UNSIGNED_CHAR,0,MPI_COMM_WORLD);
-	delete[] bvector;
-
+	mapfile.Append(sitemapping);
 }
 
 void PhyloProcess::SlaveWriteMappings(){
 
-	int len;
-	MPI_Bcast(&len,1,MPI_INT,0,MPI_COMM_WORLD);
-	unsigned char* bvector = new unsigned char[len];
-	MPI_Bcast(bvector,len,MPI_UNSIGNED_CHAR,0,MPI_COMM_WORLD);
+	int* len = new int[sitemax - sitemin];
 	ostringstream os;
-	for (int i=0; i<len; i++)	{
-		os << bvector[i];
-	}
-	string name = os.str();
-	delete[] bvector;
-
 	for(int i = sitemin; i < sitemax; i++){
-		stringstream osfmap;
-		osfmap << name << '_' << i << ".map";
-		ofstream osmap((osfmap.str()).c_str(), ios_base::app);
-		WriteTreeMapping(osmap, GetRoot(), i);
-		osmap.close();
+		long long start = os.tellp();
+		WriteTreeMapping(os, GetRoot(), i);
+		len[i-sitemin] = ((long long) os.tellp()) - start;
 	}
+	string text = os.str();
+	MPI_Send(len,sitemax-sitemin,MPI_INT,0,TAG1,MPI_COMM_WORLD);
+	MPI_Send((void*) text.data(),text.size(),MPI_CHAR,0,TAG1,MPI_COMM_WORLD);
+	delete[] len;
 }
 
 
@@ -2870,7 +3138,7 @@ void PhyloProcess::WriteTreeMapping(ostream& os, const Link* from, int i){
 	}
 	if(from->isRoot()){
 		BranchSitePath* mybsp = submap[GetBranchIndex(from->Next()->GetBranch())][i];
-		os << '_' << GetStateSpace()->GetState(mybsp->Init()->GetState()) << ";\n";     
+		os << '_' << GetStateSpace()->GetState(mybsp->GetInitState()) << ";\n";     
 		/*
 		BranchSitePath* mybsp = submap[0][i];
 		os << '_' << GetStateSpace()->GetState(mybsp->Last()->GetState()) << ";\n";		
@@ -2879,9 +3147,9 @@ void PhyloProcess::WriteTreeMapping(ostream& os, const Link* from, int i){
 	else{
 		BranchSitePath* mybsp = submap[GetBranchIndex(from->GetBranch())][i];
 		double l = GetLength(from->GetBranch());
-		os << '_' << GetStateSpace()->GetState(mybsp->Last()->GetState());
-		for(Plink* plink = mybsp->Last(); plink ; plink = plink->Prev()){
-			os << ':' << plink->GetRelativeTime() * l << ':' << GetStateSpace()->GetState(plink->GetState());
+		os << '_' << GetStateSpace()->GetState(mybsp->GetFinalState());
+		for(int k = mybsp->GetNsegment()-1; k>=0; k--){
+			os << ':' << mybsp->GetRelativeTime(k) * l << ':' << GetStateSpace()->GetState(mybsp->GetState(k));
 		}
 	}
 }
@@ -2934,3 +3202,37 @@ void PhyloProcess::SlaveCountMapping()	{
 	MPI_Send(&count,1,MPI_INT,0,TAG1,MPI_COMM_WORLD);
 
 }
+
+void PhyloProcess::GlobalGetSlaveCounts(double* count)	{
+
+	assert(myid==0);
+	MESSAGE signal = SLAVECOUNTS;
+	MPI_Status stat;
+	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
+
+	for (int k=0; k<NSLAVECOUNT; k++)	{
+		count[k] = 0;
+	}
+	double tmp[NSLAVECOUNT];
+	for (int i=1; i<nprocs; ++i)	{
+		MPI_Recv(tmp,NSLAVECOUNT,MPI_DOUBLE,MPI_ANY_SOURCE,TAG1,MPI_COMM_WORLD, &stat);
+		for (int k=0; k<NSLAVECOUNT; k++)	{
+			count[k] += tmp[k];
+		}
+	}
+}
+
+void PhyloProcess::SlaveSendCounts()	{
+
+	double count[NSLAVECOUNT];
+	GetSlaveCounts(count);
+	MPI_Send(count,NSLAVECOUNT,MPI_DOUBLE,0,TAG1,MPI_COMM_WORLD);
+}
+
+void PhyloProcess::GetSlaveCounts(double* count)	{
+
+	count[ALLOCBYTES] = GetAllocBytes();
+	count[DIAGCOUNT] = SubMatrix::GetDiagCount();
+	count[PADECOUNT] = SubMatrix::GetPadeCount();
+	GetMappingCounts(count[MAPSITES],count[MAPTRIALS],count[MAPUNI]);
+}
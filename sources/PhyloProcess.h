@@ -25,6 +25,9 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 #include "BranchProcess.h"
 
 #include "Parallel.h"
+#include "MPIPartition.h"
+#include "ChainIO.h"
+#include "MappingIO.h"
 
 #include <map>
 #include <vector>
@@ -53,7 +56,7 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 	// virtual void SlaveUpdate();
 
 	// default constructor: pointers set to nil
-	PhyloProcess() :  siteratesuffstatcount(0), siteratesuffstatbeta(0), branchlengthsuffstatcount(0), branchlengthsuffstatbeta(0), condflag(false), data(0), myid(-1), nprocs(0), size(0), version("1.6"), totaltime(0), dataclamped(1), rateprior(0), profileprior(0), rootprior(1), topoburnin(0) {}
+	PhyloProcess() :  siteratesuffstatcount(0), siteratesuffstatbeta(0), branchlengthsuffstatcount(0), branchlengthsuffstatbeta(0), condflag(false), condldirty(0), condlchanged(0), mpicount(0), branchlengthmpicount(0), nbranchlengthmove(0), mpipartition(0), data(0), myid(-1), nprocs(0), size(0), version("1.6"), totaltime(0), dataclamped(1), rateprior(0), profileprior(0), rootprior(1), topoburnin(0) {}
 	virtual ~PhyloProcess() {}
 
 	string GetVersion() {return version;}
@@ -84,7 +87,25 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 		os << "matrix uni" << '\t' << SubMatrix::GetUniSubCount() << '\n';
 		os << "inf prob  " << '\t' << GetInfProbCount() << '\n';
 		os << "stat inf  " << '\t' << GetStatInfCount() << '\n';
-	}
+		double count[NSLAVECOUNT];
+		GlobalGetSlaveCounts(count);
+		os << "alloc (Mb)" << '\t' << count[ALLOCBYTES] / 1048576 << '\n';
+		os << "diag      " << '\t' << count[DIAGCOUNT] << '\n';
+		os << "pade      " << '\t' << count[PADECOUNT] << '\n';
+		os << "trials/map" << '\t' << (count[MAPSITES] ? count[MAPTRIALS] / count[MAPSITES] : 0) << '\n';
+		os << "uni map   " << '\t' << (count[MAPSITES] ? count[MAPUNI] / count[MAPSITES] : 0) << '\n';
+		os << "mpi / bl  " << '\t' << (nbranchlengthmove ? ((double) branchlengthmpicount) / nbranchlengthmove : 0) << '\n';
+		branchlengthmpicount = 0;
+		nbranchlengthmove = 0;
+	}
+
+	// diagnostic counters accumulated by the slaves since the last call to Monitor
+	// summed over all slaves by the master
+	enum SlaveCount {ALLOCBYTES, DIAGCOUNT, PADECOUNT, MAPSITES, MAPTRIALS, MAPUNI, NSLAVECOUNT};
+	void GlobalGetSlaveCounts(double* count);
+	void SlaveSendCounts();
+	// fills count with the local counters, and resets them
+	virtual void GetSlaveCounts(double* count);
 
 	virtual void ToStreamHeader(ostream& os)	{
 		os << version << '\n';
@@ -112,6 +133,22 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 		exit(1);
 	}
 
+	// read the next sample of a chain (see ChainIO.h)
+	void ReadChainSample(ChainReader& chain)	{
+		FromStream(chain.GetNextSample());
+	}
+
+	// skip the next sample of a chain
+	// only text chains need to be parsed for that
+	void SkipChainSample(ChainReader& chain)	{
+		if (chain.IsIndexed())	{
+			chain.SkipSample();
+		}
+		else	{
+			FromStream(chain.GetNextSample());
+		}
+	}
+
 	// translation tables : from pointers of type Link* Branch* and Node* to their index and vice versa
 	// this translation is built when the Tree::RegisterWithTaxonSet method is called (in the model, in PB.cpp)
 	Link* GetLink(int linkindex)	{
@@ -163,6 +200,7 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 	const TaxonSet* GetTaxonSet() const {return data->GetTaxonSet();}
 
 	void GlobalUpdateConditionalLikelihoods();
+	void GlobalUpdateDirtyConditionalLikelihoods();
 	double GlobalComputeNodeLikelihood(const Link* from, int auxindex = -1);
 
 	protected:
@@ -268,7 +306,8 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 	// The following methids are here to write the mappings.
 	void ReadMap(string name, int burnin, int every, int until);
 	void ReadPostPredMap(string name, int burnin, int every, int until);
-	void GlobalWriteMappings(string name);
+	// the mappings of all sites are gathered on the master and appended to a single name.maps file (see MappingIO.h)
+	void GlobalWriteMappings(MappingWriter& mapfile);
 	virtual void SlaveWriteMappings();
 	void WriteTreeMapping(ostream& os, const Link* from, int i);
 
@@ -277,6 +316,10 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 	virtual void GlobalSetTestData();
 	virtual void SlaveSetTestData();
 	void SetTestSiteMinAndMax();
+
+	// identical columns of the alignment (see SubstitutionProcess::sitepattern)
+	// should be called again whenever the data are modified
+	void ComputeSitePatterns();
 	virtual void SlaveComputeCVScore() {
 		cerr << "slave compute cv score\n";
 		exit(1);
@@ -359,6 +402,21 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 	// conditional likelihood propagations
 	void PostOrderPruning(const Link* from, double*** aux);
 	void PreOrderPruning(const Link* from, double*** aux);
+
+	// same as above, but only for the conditional likelihoods depending on a node whose topology has changed
+	// (nodes are flagged by SlaveDetach and SlaveAttach)
+	// assumes that all other conditional likelihoods are up to date
+	void UpdateDirtyConditionalLikelihoods();
+	bool DirtyPostOrderPruning(const Link* from, double*** aux);
+	void DirtyPreOrderPruning(const Link* from, double*** aux);
+	void SetDirty(const Link* link)	{
+		if (link->GetNode())	{
+			condldirty[link->GetNode()->GetIndex()] = true;
+		}
+	}
+	bool IsDirty(const Link* link)	{
+		return condldirty[link->GetNode()->GetIndex()];
+	}
 	void RecursiveComputeLikelihood(const Link* from, int auxindex, vector<double>& logl);
 	void GlobalRecursiveComputeLikelihood(const Link* from, int auxindex, vector<double>& logl);
 
@@ -367,6 +425,11 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 	double LocalBranchLengthMove(const Link* from, double tuning);
 	double LocalNonMPIBranchLengthMove(const Link* from, double tuning);
 
+	double GlobalBatchBranchLengthMove(double tuning);
+	void SlaveBatchBranchLengthMove();
+	double RecursiveBatchBranchLengthMove(const Link* from, double tuning, const double* u, int& n);
+	double LocalBatchBranchLengthMove(const Link* from, double tuning, const double* u, int& n);
+
 
 
 	int GibbsSPR();
@@ -475,7 +538,39 @@ class PhyloProcess : public virtual SubstitutionProcess, public virtual BranchPr
 		return myid;
 	}
 
+	// site partition across slaves: should be made on all processes, before SubstitutionProcess::Create
+	void MakeMPIPartition(SequenceAlignment* indata);
+	MPIPartition* GetMPIPartition() {
+		return mpipartition;
+	}
+	virtual int GetProcSiteMin(int proc)	{
+		return mpipartition->GetSiteMin(proc);
+	}
+	virtual int GetProcSiteMax(int proc)	{
+		return mpipartition->GetSiteMax(proc);
+	}
+	// estimated computational cost of a site (relative units)
+	virtual double GetSiteCost(SequenceAlignment* indata, int site)	{
+		return 1.0;
+	}
+
 	double**** condlmap;
+	// per node: topology has changed since last update of the conditional likelihoods
+	bool* condldirty;
+	// per link: conditional likelihood vector has been recomputed during current partial update
+	bool* condlchanged;
+
+	// run branch length sweeps locally on each process (see GlobalBatchBranchLengthMove)
+	// read from the environment (master only)
+	// PB_BLMOVE=batch (default) : batched sweeps
+	// PB_BLMOVE=step : one series of MPI signals per proposal (RecursiveBranchLengthMove)
+	static bool batchbranchlengthmove;
+	// number of MPI calls issued by the master (only along the branch length moves, for now)
+	long mpicount;
+	// per branch length sweep, since last call to Monitor
+	long branchlengthmpicount;
+	int nbranchlengthmove;
+	MPIPartition* mpipartition;
 	BranchSitePath*** submap;
 	int** nodestate;
 
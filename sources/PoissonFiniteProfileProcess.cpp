@@ -80,13 +80,11 @@ double PoissonFiniteProfileProcess::GlobalIncrementalFiniteMove(int nrep)	{
 	MPI_Bcast(&nrep,1,MPI_INT,0,MPI_COMM_WORLD);
 
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	int NAccepted = 0;
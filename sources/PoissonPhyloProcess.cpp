@@ -48,6 +48,26 @@ void PoissonPhyloProcess::Delete()	{
 	}
 }
 
+double PoissonPhyloProcess::GetSiteCost(SequenceAlignment* indata, int site)	{
+
+	int nstate = indata->GetNstate();
+	bool* observed = new bool[nstate];
+	for (int k=0; k<nstate; k++)	{
+		observed[k] = false;
+	}
+	int zipsize = 0;
+	for (int j=0; j<indata->GetNtaxa(); j++)	{
+		int state = indata->GetState(j,site);
+		if ((state != unknown) && (! observed[state]))	{
+			observed[state] = true;
+			zipsize++;
+		}
+	}
+	delete[] observed;
+	// one more state for the orbit complement, plus a fixed cost per site
+	return 2.0 + zipsize;
+}
+
 void PoissonPhyloProcess::CreateSuffStat()	{
 
 	PhyloProcess::CreateSuffStat();
@@ -140,7 +160,7 @@ void PoissonPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 	// slaves should call : UpdateSiteProfileSuffStat
 	// then collect all suff stats
 	assert(myid == 0);
-	int i,j,k,l,width,nalloc,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
+	int i,j,k,l,nalloc,smin[nprocs-1],smax[nprocs-1],workload[nprocs-1];
 	MPI_Status stat;
 	MESSAGE signal = UPDATE_SPROFILE;
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
@@ -153,12 +173,10 @@ void PoissonPhyloProcess::GlobalUpdateSiteProfileSuffStat()	{
 	// each slave computes its array for sitemin <= site < sitemax
 	// thus, one just needs to gather all arrays into the big master array 0 <= site < Nsite
 	// (gather)
-	width = GetNsite()/(nprocs-1);
 	nalloc = 0;
 	for(i=0; i<nprocs-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (nprocs-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 		workload[i] = (smax[i] - smin[i])*GetDim();
 		if (workload[i] > nalloc) nalloc = workload[i];
 	}
@@ -222,6 +240,7 @@ void PoissonPhyloProcess::GlobalSetTestData()	{
 	MPI_Bcast(&signal,1,MPI_INT,0,MPI_COMM_WORLD);
 	MPI_Bcast(&testnsite,1,MPI_INT,0,MPI_COMM_WORLD);
 	MPI_Bcast(tmp,testnsite*GetNtaxa(),MPI_INT,0,MPI_COMM_WORLD);
+	SetTestSiteMinAndMax();
 
 	delete[] tmp;
 
@@ -38,6 +38,9 @@ class PoissonPhyloProcess : public virtual PhyloProcess, public virtual PoissonS
 	virtual void Create(Tree* intree, SequenceAlignment* indata);
 	virtual void Delete();
 
+	// the cost of a site is dominated by the size of its zipped state space
+	virtual double GetSiteCost(SequenceAlignment* indata, int site);
+
 	// in fact, same object as GetData, but now with its true type
 	ZippedSequenceAlignment* GetZipData()	{
 		if (! zipdata)	{
@@ -49,13 +49,11 @@ double PoissonSBDPProfileProcess::GlobalMixMove(int nrep, int nallocrep, double
 	MPI_Bcast(itmp,3,MPI_INT,0,MPI_COMM_WORLD);
 
 	// split Nsite among GetNprocs()-1 slaves
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	/*
@@ -144,13 +142,11 @@ void PoissonSBDPProfileProcess::SlaveMixMove()	{
 	double* cumul = new double[Ncomponent];
 	double* tmp = new double[Ncomponent * GetDim() + 1];
 
-	int width = GetNsite()/(GetNprocs()-1);
 	int smin[GetNprocs()-1];
 	int smax[GetNprocs()-1];
 	for(int i=0; i<GetNprocs()-1; ++i) {
-		smin[i] = width*i;
-		smax[i] = width*(1+i);
-		if (i == (GetNprocs()-2)) smax[i] = GetNsite();
+		smin[i] = GetProcSiteMin(i+1);
+		smax[i] = GetProcSiteMax(i+1);
 	}
 
 	for (int rep=0; rep<nrep; rep++)	{
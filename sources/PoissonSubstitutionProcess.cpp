@@ -15,6 +15,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 
 #include "PoissonSubstitutionProcess.h"
+#include "LikelihoodKernel.h"
 
 #include "Parallel.h"
 
@@ -34,31 +35,33 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 //-------------------------------------------------------------------------
 
 void PoissonSubstitutionProcess::Propagate(double*** from, double*** to, double time, bool condalloc)	{
-	for (int i=sitemin; i<sitemax; i++)	{
+	SiteLoop loop(this,SiteLoop::PROPAGATE);
+	loop.from = from;
+	loop.to = to;
+	loop.time = time;
+	loop.condalloc = condalloc;
+	RunSiteLoop(loop);
+}
+
+void PoissonSubstitutionProcess::PropagateSites(double*** from, double*** to, double time, bool condalloc, int begin, int end, int thread)	{
+	double* frombase = GetCondlBase(from);
+	double* tobase = GetCondlBase(to);
+	for (int i=begin; i<end; i++)	{
 	// for (int i=0; i<GetNsite(); i++)	{
 		const double* stat = GetStationary(i);
+		double* fromsite = GetCondlSite(frombase,i);
+		double* tosite = GetCondlSite(tobase,i);
+		int stride = GetCondlStride(i);
 		for (int j=0; j<GetNrate(i); j++)	{
 			if ((! condalloc) || (ratealloc[i] == j))	{
-				double* tmpfrom = from[i][j];
-				double* tmpto = to[i][j];
+				double* tmpfrom = fromsite + j*stride;
+				double* tmpto = tosite + j*stride;
 				double expo = exp(-GetRate(i,j) * time);
-				double tot = 0;
 				int nstate = GetNstate(i);
-				for (int k=0; k<nstate; k++)	{
-					tot += (*tmpfrom++) * (*stat++);
-					// tot += tmpfrom[k] * stat[k];
-				}
-				tmpfrom -= nstate;
-				stat -= nstate;
+				double tot = LikelihoodKernel::Dot(tmpfrom,stat,nstate);
 				tot *= (1-expo);
-				for (int k=0; k<nstate; k++)	{	
-					(*tmpto++) = expo * (*tmpfrom++) + tot;
-					// tmpto[k] = expo * tmpfrom[k] + tot;
-				}
-				(*tmpto) = (*tmpfrom);
-				tmpto -= nstate;
-				tmpfrom -= nstate;
-				// tmpto[GetNstate(i)] = tmpfrom[GetNstate(i)];
+				LikelihoodKernel::Affine(tmpto,tmpfrom,expo,tot,nstate);
+				tmpto[nstate] = tmpfrom[nstate];
 			}
 		}
 	}
@@ -128,16 +131,16 @@ void PoissonSubstitutionProcess::SimuPropagate(int* stateup, int* statedown, dou
 // root version
 BranchSitePath** PoissonSubstitutionProcess::SampleRootPaths(int* state)	{
 	// BranchSitePath** patharray = new BranchSitePath*[sitemax - sitemin];
-	BranchSitePath** patharray = new BranchSitePath*[GetNsite()];
+	BranchSitePath** patharray = pathpool.NewPathArray(GetNsite());
 	for (int i=sitemin; i<sitemax; i++)	{
-		patharray[i] = new BranchSitePath(0,state[i]);
+		patharray[i] = pathpool.NewPath(state[i]);
 	}
 	return patharray;
 }
 
 // general version
 BranchSitePath** PoissonSubstitutionProcess::SamplePaths(int* stateup, int* statedown, double time) 	{
-	BranchSitePath** patharray = new BranchSitePath*[GetNsite()];
+	BranchSitePath** patharray = pathpool.NewPathArray(GetNsite());
 	for (int i=sitemin; i<sitemax; i++)	{
 		const double* stat = GetStationary(i);
 		double rate = GetRate(i);
@@ -175,7 +178,7 @@ BranchSitePath** PoissonSubstitutionProcess::SamplePaths(int* stateup, int* stat
 				suboverflowcount ++;
 			}
 		}
-		patharray[i] = new BranchSitePath(m,ddown);
+		patharray[i] = pathpool.NewPath(ddown,m);
 	}
 	return patharray;
 }
@@ -336,7 +339,6 @@ int PoissonSubstitutionProcess::GetRandomStateFromZip(int site, int zipstate)	{
 void PoissonSubstitutionProcess::UnzipBranchSitePath(BranchSitePath** patharray, int* nodestateup, int* nodestatedown){
 	for (int i=sitemin; i<sitemax; i++)	{
 		int nsub = patharray[i]->GetNsub();
-		patharray[i]->nsub=0;
 		double* times = new double[nsub+1];
 		for(int j = 0; j < nsub; j++){
 			times[j] = rnd::GetRandom().Uniform();
@@ -357,12 +359,12 @@ void PoissonSubstitutionProcess::UnzipBranchSitePath(BranchSitePath** patharray,
 		times[nsub]=1-mem;
 
 		int previousstate = nodestateup[i];
-		patharray[i]->Init()->SetState(previousstate);
+		pathbuilder.Reset(previousstate);
 		double* pi = GetProfile(i);
 		for(int j = 0; j < nsub-1; j++){
 			int newstate = rnd::GetRandom().DrawFromDiscreteDistribution(pi, GetDim());
 			if(newstate != previousstate){
-			      patharray[i]->Append(newstate, times[j]);
+			      pathbuilder.Append(newstate, times[j]);
 			      previousstate=newstate;
 			}
 			else{
@@ -373,9 +375,11 @@ void PoissonSubstitutionProcess::UnzipBranchSitePath(BranchSitePath** patharray,
 			times[nsub] += times[nsub-1];
 		}
 		else{
-			patharray[i]->Append(nodestatedown[i], times[nsub-1]);
+			pathbuilder.Append(nodestatedown[i], times[nsub-1]);
 		}
-		patharray[i]->Last()->SetRelativeTime(times[nsub]);
+		pathbuilder.SetLastRelativeTime(times[nsub]);
+		// the unzipped path replaces the Poisson path (both owned by the pool)
+		patharray[i] = pathpool.NewPath(pathbuilder);
 		delete[] times;
 	}
 }
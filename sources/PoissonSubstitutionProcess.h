@@ -36,6 +36,7 @@ class PoissonSubstitutionProcess : public virtual SubstitutionProcess, public vi
 
 	// CPU Level 3: implementations of likelihood propagation and substitution mapping methods
 	void Propagate(double*** from, double*** to, double time, bool condalloc = false);
+	void PropagateSites(double*** from, double*** to, double time, bool condalloc, int begin, int end, int thread);
 	BranchSitePath** SamplePaths(int* stateup, int* statedown, double time);
 	BranchSitePath** SampleRootPaths(int* rootstate);
 
@@ -771,7 +771,7 @@ void PolyNode::SetFormalBranchLengths(double scale, int order)	{
 void PolyNode::GetLeafSet(Bipartition& bp)	{
 
 	if (IsLeaf())	{
-		bp.mArray[label] = 0;
+		bp.SetTaxonStatus(label,0);
 	}
 	else	{
 		PolyNode* node = down;
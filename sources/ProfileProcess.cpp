@@ -23,6 +23,19 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 //-------------------------------------------------------------------------
 //-------------------------------------------------------------------------
 
+int ProfileProcess::GetProcSiteMin(int proc)	{
+	int width = GetNsite()/(GetNprocs()-1);
+	return width * (proc-1);
+}
+
+int ProfileProcess::GetProcSiteMax(int proc)	{
+	int width = GetNsite()/(GetNprocs()-1);
+	if (proc == GetNprocs()-1)	{
+		return GetNsite();
+	}
+	return width * proc;
+}
+
 void ProfileProcess::Create(int innsite, int indim)	{
 	if (nsite || dim)	{
 		if (nsite != innsite)	{
@@ -118,6 +118,12 @@ class ProfileProcess {
 	virtual int GetSiteMin() = 0;
 	virtual int GetSiteMax() = 0;
 
+	// range of sites handled by slave proc (1 <= proc < GetNprocs())
+	// by default, Nsite / (GetNprocs()-1) sites per slave, and the remainder to the last slave
+	// overridden by PhyloProcess (see MPIPartition)
+	virtual int GetProcSiteMin(int proc);
+	virtual int GetProcSiteMax(int proc);
+
 	virtual double* GetEmpiricalFreq() = 0;
 
 	int nsite;
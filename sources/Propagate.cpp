@@ -15,42 +15,59 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 
 #include "MatrixSubstitutionProcess.h"
+#include "LikelihoodKernel.h"
 #include "Random.h"
 
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 
 void MatrixSubstitutionProcess::SimuPropagate(int* stateup, int* statedown, double time)	{
 
 	const int nstate = GetMatrix(sitemin)->GetNstate();
+	const int ld = GetMatrix(sitemin)->GetPaddedNstate();
 	double cumul[nstate];
 	double expdiag[nstate];
+	// transposed transition matrix, when the eigen system cannot be used (see SubMatrix::GetTransitionMatrix)
+	double* trans = 0;
 	for(int i=sitemin; i<sitemax; i++)	{
 
 		int up = stateup[i];
 
 		SubMatrix* matrix = GetMatrix(i);
-		double** eigenvect = matrix->GetEigenVect();
-		double** inveigenvect = matrix->GetInvEigenVect();
-		double* eigenval = matrix->GetEigenVal();
-
 		int j = ratealloc[i];
 		double length = time * GetRate(i,j);
-		for (int k=0; k<nstate; k++)	{
-			expdiag[k] = exp(length * eigenval[k]);
-		}
 
 		double totprob = 0;
-		for (int k=0; k<nstate; k++)	{
-			double tot = 0;
-			for (int l=0; l<nstate; l++)	{
-				tot += eigenvect[up][l] * expdiag[l] * inveigenvect[l][k];
+		if (matrix->UseEigenSystem())	{
+			double** eigenvect = matrix->GetEigenVect();
+			double** inveigenvect = matrix->GetInvEigenVect();
+			double* eigenval = matrix->GetEigenVal();
+			for (int k=0; k<nstate; k++)	{
+				expdiag[k] = exp(length * eigenval[k]);
+			}
+			for (int k=0; k<nstate; k++)	{
+				double tot = 0;
+				for (int l=0; l<nstate; l++)	{
+					tot += eigenvect[up][l] * expdiag[l] * inveigenvect[l][k];
+				}
+				totprob += tot;
+				cumul[k] = totprob;
+			}
+		}
+		else	{
+			if (! trans)	{
+				trans = new double[nstate * ld];
+			}
+			matrix->GetTransitionMatrix(length,trans);
+			for (int k=0; k<nstate; k++)	{
+				totprob += trans[k*ld + up];
+				cumul[k] = totprob;
 			}
-			totprob += tot;
-			cumul[k] = totprob;
 		}
 		if (fabs(totprob - 1) > 1e-6)	{
 			cerr << "error in MatrixSubstitutionProcess::SimuPropagate: tot prob is not 1\n";
@@ -69,6 +86,7 @@ void MatrixSubstitutionProcess::SimuPropagate(int* stateup, int* statedown, doub
 		}
 		statedown[i] = k;
 	}
+	delete[] trans;
 }
 
 //-------------------------------------------------------------------------
@@ -79,152 +97,326 @@ void MatrixSubstitutionProcess::SimuPropagate(int* stateup, int* statedown, doub
 //	(CPU level 3)
 //-------------------------------------------------------------------------
 
+// substitution matrix Q = P L P^{-1} where L is diagonal (eigenvalues) and P is the eigenvector matrix
+// for each site, we need to compute 
+// down = exp(length * Q) . up
+//
+// in mixture models, many sites share the same matrix (and the same rate category)
+// for those sites, the transition matrix exp(length * Q) is computed once
+// and then applied to all sites of the group (matrix-matrix product)
+// for small groups, it is cheaper to directly compute, for each site
+// down = P ( exp(length * L) . (P^{-1} . up) )  
+// (transition matrices are cached by the SubMatrix, see SubMatrix::GetTransitionMatrix,
+// and are also the only option for matrices whose eigen system is ill-conditioned)
+//
+// finally, sites with identical columns in the alignment, and sharing the same matrix and rate,
+// generally have the same conditional likelihoods: in that case, down is computed for only one of them
+// and then copied (this is checked on the up vectors, so that the result is exactly the same)
+
+// sorts sites by matrix, then by rate (so that sites sharing the same transition matrix are contiguous)
+// and then by data pattern (so that identical sites are contiguous)
+struct PropagateSiteOrder	{
+
+	SubMatrix** matrix;
+	double* rate;
+	int* pattern;
+	int sitemin;
+
+	bool operator()(int i, int j) const	{
+		if (matrix[i-sitemin] != matrix[j-sitemin])	{
+			return matrix[i-sitemin] < matrix[j-sitemin];
+		}
+		if (rate[i-sitemin] != rate[j-sitemin])	{
+			return rate[i-sitemin] < rate[j-sitemin];
+		}
+		if (pattern && (pattern[i] != pattern[j]))	{
+			return pattern[i] < pattern[j];
+		}
+		return i < j;
+	}
+};
+
+void MatrixSubstitutionProcess::CreatePropagateArrays()	{
+	if (! propsite)	{
+		int n = sitemax - sitemin;
+		propsite = new int[n];
+		propgroupsite = new int[n];
+		propgroupsize = new int[n];
+		propdupsite = new int[n];
+		propduprep = new int[n];
+		propmatrix = new SubMatrix*[n];
+		proprate = new double[n];
+		allocbytes += n * (5 * sizeof(int) + sizeof(SubMatrix*) + sizeof(double));
+	}
+}
+
+void MatrixSubstitutionProcess::DeletePropagateArrays()	{
+	delete[] propsite;
+	delete[] propgroupsite;
+	delete[] propgroupsize;
+	delete[] propdupsite;
+	delete[] propduprep;
+	delete[] propmatrix;
+	delete[] proprate;
+	propsite = 0;
+	propgroupsite = 0;
+	propmatrix = 0;
+	proprate = 0;
+	propgroupsize = 0;
+	propdupsite = 0;
+	propduprep = 0;
+}
+
 void MatrixSubstitutionProcess::Propagate(double*** from, double*** to, double time, bool condalloc)	{
 
 	// propchrono.Start();
-	int i,j,k,l,offset;
-	double length,max,maxup;
+	if (sitemax <= sitemin)	{
+		return;
+	}
 	const int nstate = GetMatrix(sitemin)->GetNstate();
-	// double* bigaux = new double[(sitemax - sitemin) * GetNrate(0) * nstate];
-	double* aux = new double[GetNsite() * GetNrate(0) * nstate];
-	for(i=sitemin; i<sitemax; i++)	{
-		SubMatrix* matrix = GetMatrix(i);
-		double** eigenvect = matrix->GetEigenVect();
-		double** inveigenvect = matrix->GetInvEigenVect();
-		double* eigenval = matrix->GetEigenVal();
-		for(j=0; j<GetNrate(i); j++)	{
-			if ((!condalloc) || (ratealloc[i] == j))	{
-				double* up = from[i][j];
-				double* down = to[i][j];
-				//SubMatrix* matrix = GetMatrix(i);
-				length = time * GetRate(i,j);
-
-				//double** eigenvect = matrix->GetEigenVect();
-				//double** inveigenvect= matrix->GetInvEigenVect();
-				//double* eigenval = matrix->GetEigenVal();
-
-				// substitution matrix Q = P L P^{-1} where L is diagonal (eigenvalues) and P is the eigenvector matrix
-				// we need to compute 
-				// down = exp(length * Q) . up
-				// which we express as 
-				// down = P ( exp(length * L) . (P^{-1} . up) )  
-		
-				// thus we successively do the following matrix.vector products
-
-				// P^{-1} . up  -> aux
-				// exp(length * L) . aux  -> aux 	(where exp(length*L) is diagonal, so this is linear)
-				// P . aux -> down
-
-				/*
-				int nstate = GetNstate();
-				double* aux = new double[nstate];
-				*/
-				//double* aux = bigaux + nstate * (i*GetNrate(0)  + j);
-				offset = nstate*(i*GetNrate(0) + j);
-				// P^{-1} . up  -> aux
-				//double* tmpaux = aux;
-				for(k=0; k<nstate; k++)	{
-					//(*tmpaux++) = 0;
-					aux[offset+k] = 0.0;
-				}
-				//tmpaux -= nstate;
-				//double* tmpup = up;
-				for(k=0; k<nstate; k++)	{
-					//double* tmpinveigen = inveigenvect[i];
-					for(l=0; l<nstate; l++)	{
-						//(*tmpaux) += (*tmpinveigen++) * (*tmpup++);
-						aux[offset+k] += inveigenvect[k][l] * up[l];
-					}
-					//tmpaux++;
-					//tmpup -= nstate;
-				}
-				//tmpaux -= nstate;
+	CreatePropagateArrays();
 
-				// exp(length * L) . aux  -> aux
-				//double* tmpval = eigenval;
-				for(k=0; k<nstate; k++)	{
-					//(*tmpaux++) *= exp(length * (*tmpval++));
-					aux[offset+k] *= exp(length * eigenval[k]);
-				}
-				//tmpaux -= nstate;
-				//tmpval -= nstate;
-
-				// P . aux -> down
-				//double* tmpdown = down;
-				for(k=0; k<nstate; k++)	{
-					//(*tmpdown++) = 0;
-					down[k] = 0.0;
-				}
-				//tmpdown -= nstate;
+	// scratch arrays of each thread, allocated once and reused across calls (see PropagateSites)
+	const int ld = ((nstate + 7) / 8) * 8;
+	for (int t=0; t<ThreadPool::GetNthread(); t++)	{
+		GetWorkspace(nstate * ld + 2 * nstate, t);
+	}
+
+	// group sites sharing the same matrix and the same rate
+	int nsite = sitemax - sitemin;
+	for (int i=sitemin; i<sitemax; i++)	{
+		propsite[i-sitemin] = i;
+		propmatrix[i-sitemin] = GetMatrix(i);
+		proprate[i-sitemin] = GetRate(i,0);
+	}
+	PropagateSiteOrder order;
+	order.matrix = propmatrix;
+	order.rate = proprate;
+	order.pattern = sitepattern;
+	order.sitemin = sitemin;
+	sort(propsite, propsite + nsite, order);
+
+	// for each site (in sorted order): number of sites of its group propagated together with it
+	// (the choice between the two methods below is made on the whole group,
+	// so that the result does not depend on how the groups are split among threads)
+	// the matrices are diagonalized here, before the threads share them
+	int g = 0;
+	vector<int> count;
+	while (g < nsite)	{
+		int first = propsite[g];
+		SubMatrix* matrix = propmatrix[first-sitemin];
+		int gend = g+1;
+		while ((gend < nsite) && (propmatrix[propsite[gend]-sitemin] == matrix) && (proprate[propsite[gend]-sitemin] == proprate[first-sitemin]))	{
+			gend++;
+		}
+		matrix->UseEigenSystem();
+		if (condalloc)	{
+			count.assign(GetNrate(first),0);
+			for (int s=g; s<gend; s++)	{
+				count[ratealloc[propsite[s]]]++;
+			}
+			for (int s=g; s<gend; s++)	{
+				propgroupsize[s] = count[ratealloc[propsite[s]]];
+			}
+		}
+		else	{
+			for (int s=g; s<gend; s++)	{
+				propgroupsize[s] = gend - g;
+			}
+		}
+		g = gend;
+	}
+
+	// blocks of sorted sites: big enough for the transition matrices computed by each block to pay off
+	int blocksize = nsite / (8 * ThreadPool::GetNthread());
+	if (blocksize < 4 * nstate)	{
+		blocksize = 4 * nstate;
+	}
+	SiteLoop loop(this,SiteLoop::PROPAGATE);
+	loop.from = from;
+	loop.to = to;
+	loop.time = time;
+	loop.condalloc = condalloc;
+	ThreadPool::ParallelFor(loop,0,nsite,blocksize);
+	// propchrono.Stop();
+}
+
+// propagate sites propsite[begin] to propsite[end-1]
+void MatrixSubstitutionProcess::PropagateSites(double*** from, double*** to, double time, bool condalloc, int begin, int end, int thread)	{
+
+	const int nstate = GetMatrix(sitemin)->GetNstate();
+
+	// transposed transition matrix (nstate rows, zero-padded up to ld)
+	// then exp(length * L) (nstate) and P^{-1}.up (nstate)
+	const int ld = ((nstate + 7) / 8) * 8;
+	double* trans = GetWorkspace(nstate * ld + 2 * nstate, thread);
+	double* expdiag = trans + nstate * ld;
+	double* aux = expdiag + nstate;
 
-				for(k=0; k<nstate; k++)	{
-					//double* tmpeigen = eigenvect[i];
-					for(l=0; l<nstate; l++)	{
-						//(*tmpdown) += (*tmpeigen++) * (*tmpaux++);
-						down[k] += eigenvect[k][l] * aux[offset+l]; 
+	double* frombase = GetCondlBase(from);
+	double* tobase = GetCondlBase(to);
+
+	// sites of the current group and rate category are listed in propgroupsite[begin...]
+	// except for the copies of identical sites, listed in propdupsite[begin...]
+	// together with the site they are copied from, in propduprep[begin...]
+	int* groupsite = propgroupsite + begin;
+	int* dupsite = propdupsite + begin;
+	int* duprep = propduprep + begin;
+
+	int g = begin;
+	while (g < end)	{
+
+		int first = propsite[g];
+		SubMatrix* matrix = propmatrix[first-sitemin];
+		int gend = g+1;
+		while ((gend < end) && (propmatrix[propsite[gend]-sitemin] == matrix) && (proprate[propsite[gend]-sitemin] == proprate[first-sitemin]))	{
+			gend++;
+		}
+
+		bool eigen = matrix->UseEigenSystem();
+
+		// rates of a given category are the same for all sites when summing over rate allocations
+		// (and there is only one category per site otherwise)
+		for (int j=0; j<GetNrate(first); j++)	{
+
+			int n = 0;
+			int ndup = 0;
+			int groupsize = 0;
+			for (int s=g; s<gend; s++)	{
+				int i = propsite[s];
+				if ((!condalloc) || (ratealloc[i] == j))	{
+					groupsize = propgroupsize[s];
+					if (n && sitepattern && (sitepattern[i] == sitepattern[groupsite[n-1]]) && (! memcmp(GetCondlSite(frombase,i) + j*GetCondlStride(i), GetCondlSite(frombase,groupsite[n-1]) + j*GetCondlStride(groupsite[n-1]), (nstate+1) * sizeof(double))))	{
+						dupsite[ndup] = i;
+						duprep[ndup] = groupsite[n-1];
+						ndup++;
 					}
-					//tmpdown++;
-					//tmpaux -= nstate;
-				}
-				//tmpdown -= nstate;
-
-				// exit in case of numerical errors
-				for(k=0; k<nstate; k++)	{
-					if (isnan(down[k]))	{
-						cerr << "error in back prop\n";
-						for(l=0; l<nstate; l++)	{
-							cerr << up[l] << '\t' << down[l] << '\t' << matrix->Stationary(l) << '\n';
-						}
-						exit(1);
+					else	{
+						groupsite[n++] = i;
 					}
 				}
-				maxup = 0.0;
-				for(k=0; k<nstate; k++)	{
-					if (up[k] < 0.0)	{
-						cerr << "error in backward propagate: negative prob : " << up[k] << "\n";
-						exit(1);
-					}
-					if (maxup < up[k])	{
-						maxup = up[k];
-					}
+			}
+			if (! n)	{
+				continue;
+			}
+
+			double length = time * GetRate(first,j);
+
+			// building the transition matrix costs nstate^3
+			// and then saves roughly nstate^2 + nstate exponentials per site
+			if ((! eigen) || (groupsize * (nstate + 20) > nstate * nstate))	{
+
+				matrix->GetTransitionMatrix(length,trans);
+
+				// down = trans . up, for all sites of the group
+				for (int s=0; s<n; s++)	{
+					const double* up = GetCondlSite(frombase,groupsite[s]) + j*GetCondlStride(groupsite[s]);
+					double* down = GetCondlSite(tobase,groupsite[s]) + j*GetCondlStride(groupsite[s]);
+					LikelihoodKernel::MatVec(trans,ld,up,down,nstate);
 				}
-				max = 0.0;
-				for(k=0; k<nstate; k++)	{
-					if (down[k] < 0.0)	{
-						infprobcount++;
-						down[k] = 0.0;
-					}
-					if (max < down[k])	{
-						max = down[k];
-					}
+			}
+
+			else	{
+				double** eigenvect = matrix->GetEigenVect();
+				double** inveigenvect = matrix->GetInvEigenVect();
+				double* eigenval = matrix->GetEigenVal();
+				for (int k=0; k<nstate; k++)	{
+					expdiag[k] = exp(length * eigenval[k]);
 				}
-				if (maxup == 0.0)	{
-					cerr << "error in backward propagate: null up array\n";
-					cerr << "site : " << i << '\n';
-					for(l=0; l<nstate; l++)	{
-						cerr << matrix->Stationary(l) << '\n';
+				for (int s=0; s<n; s++)	{
+					const double* up = GetCondlSite(frombase,groupsite[s]) + j*GetCondlStride(groupsite[s]);
+					double* down = GetCondlSite(tobase,groupsite[s]) + j*GetCondlStride(groupsite[s]);
+
+					// P^{-1} . up  -> aux
+					// exp(length * L) . aux  -> aux 	(where exp(length*L) is diagonal, so this is linear)
+					for (int k=0; k<nstate; k++)	{
+						aux[k] = LikelihoodKernel::Dot(inveigenvect[k],up,nstate) * expdiag[k];
 					}
-					cerr << time << '\t' << length << '\n';
-					cerr << GetDim() << '\n';
-					exit(1);
-				}
-				if (max == 0.0)	{
-					cerr << "error in backward propagate: null array\n";
-					for(k=0; k<nstate; k++)	{
-						cerr << up[k] << '\t' << down[k] << '\n';
+
+					// P . aux -> down
+					for (int k=0; k<nstate; k++)	{
+						down[k] = LikelihoodKernel::Dot(eigenvect[k],aux,nstate);
 					}
-					cerr << length << '\n';
-					cerr << '\n';
-					exit(1);
 				}
+			}
+
+			for (int s=0; s<n; s++)	{
+				int i = groupsite[s];
+				CheckPropagate(i, GetCondlSite(frombase,i) + j*GetCondlStride(i), GetCondlSite(tobase,i) + j*GetCondlStride(i), nstate, matrix, time, length);
+			}
 
+			for (int s=0; s<ndup; s++)	{
+				memcpy(GetCondlSite(tobase,dupsite[s]) + j*GetCondlStride(dupsite[s]), GetCondlSite(tobase,duprep[s]) + j*GetCondlStride(duprep[s]), (nstate+1) * sizeof(double));
+			}
+		}
+		g = gend;
+	}
+}
+
+// exit in case of numerical errors
+// negative probabilities (numerical errors) are set to 0
+// and the offset (in log) is copied from up to down
+void MatrixSubstitutionProcess::CheckPropagate(int site, const double* up, double* down, int nstate, SubMatrix* matrix, double time, double length)	{
 
-				// this is the offset (in log)
-				down[nstate] = up[nstate];
+	// fast path: nothing to report or to correct
+	double upmin, upmax, downmin, downmax;
+	if (LikelihoodKernel::Range(down,nstate,downmin,downmax) && LikelihoodKernel::Range(up,nstate,upmin,upmax))	{
+		if ((upmin >= 0) && (upmax > 0) && (downmin >= 0) && (downmax > 0))	{
+			down[nstate] = up[nstate];
+			return;
+		}
+	}
+
+
+	for (int k=0; k<nstate; k++)	{
+		if (isnan(down[k]))	{
+			cerr << "error in back prop\n";
+			for (int l=0; l<nstate; l++)	{
+				cerr << up[l] << '\t' << down[l] << '\t' << matrix->Stationary(l) << '\n';
 			}
+			exit(1);
 		}
 	}
+	double maxup = 0.0;
+	for (int k=0; k<nstate; k++)	{
+		if (up[k] < 0.0)	{
+			cerr << "error in backward propagate: negative prob : " << up[k] << "\n";
+			exit(1);
+		}
+		if (maxup < up[k])	{
+			maxup = up[k];
+		}
+	}
+	double max = 0.0;
+	for (int k=0; k<nstate; k++)	{
+		if (down[k] < 0.0)	{
+			__sync_fetch_and_add(&infprobcount,1);
+			down[k] = 0.0;
+		}
+		if (max < down[k])	{
+			max = down[k];
+		}
+	}
+	if (maxup == 0.0)	{
+		cerr << "error in backward propagate: null up array\n";
+		cerr << "site : " << site << '\n';
+		for (int l=0; l<nstate; l++)	{
+			cerr << matrix->Stationary(l) << '\n';
+		}
+		cerr << time << '\t' << length << '\n';
+		cerr << GetDim() << '\n';
+		exit(1);
+	}
+	if (max == 0.0)	{
+		cerr << "error in backward propagate: null array\n";
+		for (int k=0; k<nstate; k++)	{
+			cerr << up[k] << '\t' << down[k] << '\n';
+		}
+		cerr << length << '\n';
+		cerr << '\n';
+		exit(1);
+	}
 
-	delete[] aux;
-	// propchrono.Stop();
+	// this is the offset (in log)
+	down[nstate] = up[nstate];
 }
@@ -467,17 +467,13 @@ void RASCATGTRFiniteGammaPhyloProcess::SlaveComputeSiteLogL()	{
 
 void RASCATGTRFiniteGammaPhyloProcess::ReadRelRates(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -491,7 +487,7 @@ void RASCATGTRFiniteGammaPhyloProcess::ReadRelRates(string name, int burnin, int
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		double total = 0;
@@ -506,7 +502,7 @@ void RASCATGTRFiniteGammaPhyloProcess::ReadRelRates(string name, int burnin, int
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -539,17 +535,13 @@ void RASCATGTRFiniteGammaPhyloProcess::ReadSiteProfiles(string name, int burnin,
 			sitestat[i][k] = 0;
 		}
 	}
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -558,7 +550,7 @@ void RASCATGTRFiniteGammaPhyloProcess::ReadSiteProfiles(string name, int burnin,
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		for (int i=0; i<GetNsite(); i++)	{
@@ -569,7 +561,7 @@ void RASCATGTRFiniteGammaPhyloProcess::ReadSiteProfiles(string name, int burnin,
 		}
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -448,17 +448,13 @@ double RASCATGTRSBDPGammaPhyloProcess::ProfileProposal(double* profile, int cat,
 
 void RASCATGTRSBDPGammaPhyloProcess::ReadTestProfile(string name, int nrep, double tuning, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -473,7 +469,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadTestProfile(string name, int nrep, doub
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		QuickUpdate();
@@ -520,7 +516,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadTestProfile(string name, int nrep, doub
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -538,17 +534,13 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadTestProfile(string name, int nrep, doub
 
 void RASCATGTRSBDPGammaPhyloProcess::ReadRelRates(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -562,7 +554,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadRelRates(string name, int burnin, int e
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		double total = 0;
@@ -577,7 +569,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadRelRates(string name, int burnin, int e
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -603,17 +595,13 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadRelRates(string name, int burnin, int e
 
 void RASCATGTRSBDPGammaPhyloProcess::ReadNocc(string name, int burnin, int every, int until)	{
 
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -624,7 +612,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadNocc(string name, int burnin, int every
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		UpdateOccupancyNumbers();
@@ -633,7 +621,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadNocc(string name, int burnin, int every
 
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -653,17 +641,13 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadSiteProfiles(string name, int burnin, i
 			sitestat[i][k] = 0;
 		}
 	}
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -672,7 +656,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadSiteProfiles(string name, int burnin, i
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		for (int i=0; i<GetNsite(); i++)	{
@@ -683,7 +667,7 @@ void RASCATGTRSBDPGammaPhyloProcess::ReadSiteProfiles(string name, int burnin, i
 		}
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
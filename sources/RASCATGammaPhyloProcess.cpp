@@ -340,17 +340,13 @@ void RASCATGammaPhyloProcess::ReadSiteProfiles(string name, int burnin, int ever
 			sitestat[i][k] = 0;
 		}
 	}
-	ifstream is((name + ".chain").c_str());
-	if (!is)	{
-		cerr << "error: no .chain file found\n";
-		exit(1);
-	}
+	ChainReader chain(name);
 
 	cerr << "burnin : " << burnin << "\n";
 	cerr << "until : " << until << '\n';
 	int i=0;
 	while ((i < until) && (i < burnin))	{
-		FromStream(is);
+		SkipChainSample(chain);
 		i++;
 	}
 	int samplesize = 0;
@@ -359,7 +355,7 @@ void RASCATGammaPhyloProcess::ReadSiteProfiles(string name, int burnin, int ever
 		cerr << ".";
 		cerr.flush();
 		samplesize++;
-		FromStream(is);
+		ReadChainSample(chain);
 		i++;
 
 		for (int i=0; i<GetNsite(); i++)	{
@@ -370,7 +366,7 @@ void RASCATGammaPhyloProcess::ReadSiteProfiles(string name, int burnin, int ever
 		}
 		int nrep = 1;
 		while ((i<until) && (nrep < every))	{
-			FromStream(is);
+			SkipChainSample(chain);
 			i++;
 			nrep++;
 		}
@@ -22,7 +22,9 @@ int main(int argc, char* argv[])	{
 
 	int myid,nprocs;
 
-	MPI_Init(&argc,&argv);
+	// only the main thread makes MPI calls (see ThreadPool)
+	int threadlevel;
+	MPI_Init_thread(&argc,&argv,MPI_THREAD_FUNNELED,&threadlevel);
 	MPI_Comm_rank(MPI_COMM_WORLD,&myid);
 	MPI_Comm_size(MPI_COMM_WORLD,&nprocs);
 
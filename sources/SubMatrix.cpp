@@ -15,15 +15,78 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include "linalg.h"
 #include "SubMatrix.h"
+#include "LikelihoodKernel.h"
 
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <string>
 #include <iostream>
 using namespace std;
 
 int SubMatrix::nuni = 0;
 int SubMatrix::nunimax = 0;
 int SubMatrix::nunisubcount = 0;
+int SubMatrix::ndiag = 0;
+int SubMatrix::npade = 0;
+
+static bool ReadForcePade()	{
+	const char* tmp = getenv("PB_EXPO");
+	if (! tmp)	{
+		return false;
+	}
+	string expo = tmp;
+	if (expo == "pade")	{
+		return true;
+	}
+	if (expo != "eigen")	{
+		cerr << "error: PB_EXPO should be eigen or pade\n";
+		exit(1);
+	}
+	return false;
+}
+
+static int ReadTransCacheSize()	{
+	const char* tmp = getenv("PB_TRANSCACHE");
+	if (! tmp)	{
+		return 16;
+	}
+	int n = atoi(tmp);
+	if (n < 0)	{
+		cerr << "error: PB_TRANSCACHE should be a non-negative integer\n";
+		exit(1);
+	}
+	return n;
+}
+
+bool SubMatrix::forcepade = ReadForcePade();
+int SubMatrix::transcachesize = ReadTransCacheSize();
+
+// beyond this value of max|u| * max|invu|,
+// the eigen system is considered too ill-conditioned for computing transition probabilities
+static const double maxeigencondition = 1e12;
+
+// per-thread arrays, grown as needed and kept across calls
+// threadscratch : work space of ComputeTransitionMatrix and ComputePadeExponential
+// threadtrans : uncached transition matrix of GetTransitionProb
+// (kept apart, since growing threadscratch while computing the transition matrix would free it)
+static __thread double* threadscratch = 0;
+static __thread int threadscratchsize = 0;
+static __thread double* threadtrans = 0;
+static __thread int threadtranssize = 0;
+
+static double* GetThreadArray(double*& array, int& arraysize, int size)	{
+	if (arraysize < size)	{
+		delete[] array;
+		array = new double[size];
+		arraysize = size;
+	}
+	return array;
+}
+
+static double* GetThreadScratch(int size)	{
+	return GetThreadArray(threadscratch,threadscratchsize,size);
+}
 
 // ---------------------------------------------------------------------------
 //		 SubMatrix()
@@ -49,6 +112,11 @@ SubMatrix& SubMatrix::operator=(const SubMatrix& from)	{
 */
 SubMatrix::SubMatrix(int inNstate, bool innormalise) : Nstate(inNstate), normalise(innormalise)	{
 	ndiagfailed = 0;
+	illcond = false;
+	transcache = 0;
+	translength = 0;
+	transflag = 0;
+	pthread_mutex_init(&transmutex,0);
 	Create();
 }
 
@@ -74,17 +142,19 @@ void SubMatrix::Create()	{
 
 	mStationary = new double[Nstate];
 
+	logQ = 0;
+	logflagarray = 0;
+	mLogStationary = 0;
+	logstatflag = false;
+
 	UniMu = 1;
-	mPow = new double**[UniSubNmax];
+	mPow = new double*[UniSubNmax];
 	for (int n=0; n<UniSubNmax; n++)	{
 		mPow[n] = 0;
-		/*
-		mPow[n] = new double*[Nstate];
-		for (int i=0; i<Nstate; i++)	{
-			mPow[n][i] = new double[Nstate];
-		}
-		*/
 	}
+	npowalloc = 0;
+	npow = 0;
+	unicumul = new double[Nstate];
 
 	flagarray = new bool[Nstate];
 	diagflag = false;
@@ -113,20 +183,28 @@ SubMatrix::~SubMatrix()	{
 	delete[] invu;
 
 	if (mPow)	{
-		for (int n=0; n<UniSubNmax; n++)	{
-			if (mPow[n])	{
-				for (int i=0; i<Nstate; i++)	{
-					delete[] mPow[n][i];
-				}
-				delete[] mPow[n];
-			}
+		for (int n=0; n<npowalloc; n++)	{
+			delete[] mPow[n];
 		}
 		delete[] mPow;
 	}
+	delete[] unicumul;
+	if (logQ)	{
+		for (int i=0; i<Nstate; i++)	{
+			delete[] logQ[i];
+		}
+		delete[] logQ;
+		delete[] logflagarray;
+	}
+	delete[] mLogStationary;
 	delete[] mStationary;
 	delete[] flagarray;
 	delete[] v;
 	delete[] vi;
+	delete[] transcache;
+	delete[] translength;
+	delete[] transflag;
+	pthread_mutex_destroy(&transmutex);
 
 
 }
@@ -149,6 +227,59 @@ void	SubMatrix::ScalarMul(double e)	{
 //		 Diagonalise()
 // ---------------------------------------------------------------------------
 
+// per-thread workspace for diagonalizing the matrix restricted to the states of non-null stationary probability
+// grown as needed and kept across calls
+struct ReducedWorkspace	{
+	int dim;
+	double** Q;
+	double** u;
+	double** invu;
+	double* v;
+	double* pi;
+};
+
+static __thread ReducedWorkspace* reducedworkspace = 0;
+
+static double** NewReducedMatrix(int dim)	{
+	double** m = new double*[dim];
+	m[0] = new double[dim*dim];
+	for (int i=1; i<dim; i++)	{
+		m[i] = m[0] + i*dim;
+	}
+	return m;
+}
+
+static void DeleteReducedMatrix(double** m)	{
+	delete[] m[0];
+	delete[] m;
+}
+
+static ReducedWorkspace* GetReducedWorkspace(int dim)	{
+
+	ReducedWorkspace* w = reducedworkspace;
+	if (w && (w->dim >= dim))	{
+		return w;
+	}
+	if (w)	{
+		DeleteReducedMatrix(w->Q);
+		DeleteReducedMatrix(w->u);
+		DeleteReducedMatrix(w->invu);
+		delete[] w->v;
+		delete[] w->pi;
+	}
+	else	{
+		w = new ReducedWorkspace;
+		reducedworkspace = w;
+	}
+	w->dim = dim;
+	w->Q = NewReducedMatrix(dim);
+	w->u = NewReducedMatrix(dim);
+	w->invu = NewReducedMatrix(dim);
+	w->v = new double[dim];
+	w->pi = new double[dim];
+	return w;
+}
+
 int SubMatrix::Diagonalise()	{
 
 	if (! ArrayUpdated())	{
@@ -157,6 +288,8 @@ int SubMatrix::Diagonalise()	{
 
 	// CheckQ();
 
+	__sync_fetch_and_add(&ndiag,1);
+
 	int nmax = 1000;
 	double epsilon = 1e-20;
 	double temptoosmall = 1e-20;
@@ -185,17 +318,12 @@ int SubMatrix::Diagonalise()	{
 	}
 	else {	
 
-		double** reducedQ = new double*[reducedStateCount];
-		double** reducedu = new double*[reducedStateCount];
-		double** reducedinvu = new double*[reducedStateCount];
-		double* reducedv = new double[reducedStateCount];
-		double* reducedPi = new double[reducedStateCount];
-
-		for (int i=0; i<reducedStateCount; i++)	{
-			reducedQ[i] = new double[reducedStateCount];
-			reducedu[i] = new double[reducedStateCount];
-			reducedinvu[i] = new double[reducedStateCount];
-		}
+		ReducedWorkspace* w = GetReducedWorkspace(reducedStateCount);
+		double** reducedQ = w->Q;
+		double** reducedu = w->u;
+		double** reducedinvu = w->invu;
+		double* reducedv = w->v;
+		double* reducedPi = w->pi;
 
 		int counti = 0;
 		int countj;
@@ -277,24 +405,33 @@ int SubMatrix::Diagonalise()	{
 		}
 
 		//LinAlg::Gauss(u, Nstate, invu);
+	}
 
-		for (int i=0; i<reducedStateCount; i++)	{
-			delete[] reducedQ[i];
-			delete[] reducedu[i];
-			delete[] reducedinvu[i];
+	// ill-conditioned eigen systems are not used for computing transition probabilities
+	// (Pade exponentials are used instead, see UseEigenSystem)
+	illcond = failed;
+	if (! failed)	{
+		double maxu = 0;
+		double maxinvu = 0;
+		for (int i=0; i<Nstate; i++)	{
+			for (int j=0; j<Nstate; j++)	{
+				if (isnan(u[i][j]) || isnan(invu[i][j]))	{
+					illcond = true;
+				}
+				if (maxu < fabs(u[i][j]))	{
+					maxu = fabs(u[i][j]);
+				}
+				if (maxinvu < fabs(invu[i][j]))	{
+					maxinvu = fabs(invu[i][j]);
+				}
+			}
+		}
+		if (maxu * maxinvu > maxeigencondition)	{
+			illcond = true;
 		}
-		delete[] reducedQ;
-		delete[] reducedu;
-		delete[] reducedinvu;
-		delete[] reducedv;
-		delete[] reducedPi;
 	}
-
 	if (failed)	{
-		cerr << "error in SubMatrix::Diagonalise\n";
-		CheckReversibility();
-		ToStream(cerr);
-		exit(1);
+		ndiagfailed++;
 	}
 
 	diagflag = true;
@@ -302,6 +439,257 @@ int SubMatrix::Diagonalise()	{
 	return failed;
 }
 
+bool SubMatrix::UseEigenSystem()	{
+
+	if (forcepade)	{
+		if (! ArrayUpdated())	{
+			UpdateMatrix();
+		}
+		return false;
+	}
+	if (! diagflag)	{
+		Diagonalise();
+	}
+	return ! illcond;
+}
+
+// ---------------------------------------------------------------------------
+//		 transition matrices
+// ---------------------------------------------------------------------------
+
+void SubMatrix::GetTransitionMatrix(double length, double* trans)	{
+
+	int size = Nstate * GetPaddedNstate();
+	if (! transcachesize)	{
+		ComputeTransitionMatrix(length,trans);
+		return;
+	}
+	pthread_mutex_lock(&transmutex);
+	memcpy(trans,FindTransitionMatrix(length),size * sizeof(double));
+	pthread_mutex_unlock(&transmutex);
+}
+
+double SubMatrix::GetTransitionProb(int from, int to, double length)	{
+
+	int ld = GetPaddedNstate();
+	if (! transcachesize)	{
+		double* trans = GetThreadArray(threadtrans,threadtranssize,Nstate * ld);
+		ComputeTransitionMatrix(length,trans);
+		return trans[to*ld + from];
+	}
+	pthread_mutex_lock(&transmutex);
+	double tmp = FindTransitionMatrix(length)[to*ld + from];
+	pthread_mutex_unlock(&transmutex);
+	return tmp;
+}
+
+// to be called with transmutex locked
+double* SubMatrix::FindTransitionMatrix(double length)	{
+
+	int size = Nstate * GetPaddedNstate();
+	if (! transcache)	{
+		transcache = new double[transcachesize * size];
+		translength = new double[transcachesize];
+		transflag = new bool[transcachesize];
+		for (int c=0; c<transcachesize; c++)	{
+			transflag[c] = false;
+		}
+	}
+
+	unsigned long long h;
+	memcpy(&h,&length,sizeof(double));
+	h ^= h >> 31;
+	h *= 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 29;
+	int c = h % transcachesize;
+
+	double* trans = transcache + c * size;
+	if ((! transflag[c]) || (translength[c] != length))	{
+		ComputeTransitionMatrix(length,trans);
+		translength[c] = length;
+		transflag[c] = true;
+	}
+	return trans;
+}
+
+void SubMatrix::ComputeTransitionMatrix(double length, double* trans)	{
+
+	if (! UseEigenSystem())	{
+		ComputePadeExponential(length,trans);
+		return;
+	}
+
+	// trans = P . exp(length * L) . P^{-1}, stored transposed:
+	// trans[l*ld + k] = sum_m P[k][m] exp(length * L[m]) P^{-1}[m][l]
+	int ld = GetPaddedNstate();
+	double* eigenT = GetThreadScratch(Nstate * ld + 2 * Nstate);
+	double* expdiag = eigenT + Nstate * ld;
+	double* col = expdiag + Nstate;
+
+	for (int k=0; k<Nstate; k++)	{
+		expdiag[k] = exp(length * v[k]);
+	}
+	for (int m=0; m<Nstate; m++)	{
+		double* row = eigenT + m*ld;
+		for (int k=0; k<Nstate; k++)	{
+			row[k] = u[k][m];
+		}
+		for (int k=Nstate; k<ld; k++)	{
+			row[k] = 0;
+		}
+	}
+	for (int l=0; l<Nstate; l++)	{
+		for (int m=0; m<Nstate; m++)	{
+			col[m] = expdiag[m] * invu[m][l];
+		}
+		double* row = trans + l*ld;
+		LikelihoodKernel::MatVec(eigenT,ld,col,row,Nstate);
+		for (int k=Nstate; k<ld; k++)	{
+			row[k] = 0;
+		}
+	}
+}
+
+// exp(length * Q) by diagonal Pade approximation of degree 6, with scaling and squaring
+// (see Moler and Van Loan, 2003, Nineteen dubious ways to compute the exponential of a matrix, twenty-five years later)
+void SubMatrix::ComputePadeExponential(double length, double* trans)	{
+
+	const int degree = 6;
+	int n = Nstate;
+	int ld = GetPaddedNstate();
+	__sync_fetch_and_add(&npade,1);
+
+	// a, x, num, den, tmp : n*n each, row-major
+	double* a = GetThreadScratch(5 * n * n);
+	double* x = a + n*n;
+	double* num = x + n*n;
+	double* den = num + n*n;
+	double* tmp = den + n*n;
+
+	// scaling: a = length * Q / 2^s, with |a|_inf <= 1/2
+	double norm = 0;
+	for (int i=0; i<n; i++)	{
+		double tot = 0;
+		for (int j=0; j<n; j++)	{
+			tot += fabs(Q[i][j]);
+		}
+		if (norm < tot)	{
+			norm = tot;
+		}
+	}
+	norm *= length;
+	int s = 0;
+	if (norm > 0.5)	{
+		s = ((int) (log(norm) / log(2.0))) + 2;
+	}
+	double scale = length / pow(2.0,s);
+	for (int i=0; i<n; i++)	{
+		for (int j=0; j<n; j++)	{
+			a[i*n+j] = scale * Q[i][j];
+		}
+	}
+
+	// num = sum_k c_k a^k, den = sum_k (-1)^k c_k a^k
+	for (int i=0; i<n*n; i++)	{
+		x[i] = a[i];
+	}
+	double c = 0.5;
+	for (int i=0; i<n; i++)	{
+		for (int j=0; j<n; j++)	{
+			double id = (i == j) ? 1.0 : 0;
+			num[i*n+j] = id + c * a[i*n+j];
+			den[i*n+j] = id - c * a[i*n+j];
+		}
+	}
+	for (int k=2; k<=degree; k++)	{
+		c *= ((double) (degree - k + 1)) / (k * (2*degree - k + 1));
+		for (int i=0; i<n; i++)	{
+			for (int j=0; j<n; j++)	{
+				double tot = 0;
+				for (int l=0; l<n; l++)	{
+					tot += a[i*n+l] * x[l*n+j];
+				}
+				tmp[i*n+j] = tot;
+			}
+		}
+		for (int i=0; i<n*n; i++)	{
+			x[i] = tmp[i];
+			num[i] += c * x[i];
+			den[i] += (k % 2) ? -c * x[i] : c * x[i];
+		}
+	}
+
+	// num = den^{-1} . num (Gauss elimination with partial pivoting)
+	for (int k=0; k<n; k++)	{
+		int imax = k;
+		for (int i=k+1; i<n; i++)	{
+			if (fabs(den[i*n+k]) > fabs(den[imax*n+k]))	{
+				imax = i;
+			}
+		}
+		if (den[imax*n+k] == 0)	{
+			cerr << "error in SubMatrix::ComputePadeExponential: singular matrix\n";
+			exit(1);
+		}
+		if (imax != k)	{
+			for (int j=0; j<n; j++)	{
+				double t = den[k*n+j];
+				den[k*n+j] = den[imax*n+j];
+				den[imax*n+j] = t;
+				t = num[k*n+j];
+				num[k*n+j] = num[imax*n+j];
+				num[imax*n+j] = t;
+			}
+		}
+		for (int i=k+1; i<n; i++)	{
+			double f = den[i*n+k] / den[k*n+k];
+			if (f != 0)	{
+				for (int j=k; j<n; j++)	{
+					den[i*n+j] -= f * den[k*n+j];
+				}
+				for (int j=0; j<n; j++)	{
+					num[i*n+j] -= f * num[k*n+j];
+				}
+			}
+		}
+	}
+	for (int k=n-1; k>=0; k--)	{
+		for (int j=0; j<n; j++)	{
+			double tot = num[k*n+j];
+			for (int l=k+1; l<n; l++)	{
+				tot -= den[k*n+l] * num[l*n+j];
+			}
+			num[k*n+j] = tot / den[k*n+k];
+		}
+	}
+
+	// squaring
+	for (int r=0; r<s; r++)	{
+		for (int i=0; i<n; i++)	{
+			for (int j=0; j<n; j++)	{
+				double tot = 0;
+				for (int l=0; l<n; l++)	{
+					tot += num[i*n+l] * num[l*n+j];
+				}
+				tmp[i*n+j] = tot;
+			}
+		}
+		for (int i=0; i<n*n; i++)	{
+			num[i] = tmp[i];
+		}
+	}
+
+	for (int l=0; l<n; l++)	{
+		double* row = trans + l*ld;
+		for (int k=0; k<n; k++)	{
+			row[k] = num[k*n+l];
+		}
+		for (int k=n; k<ld; k++)	{
+			row[k] = 0;
+		}
+	}
+}
+
 void	SubMatrix::ComputeExponential(double range, double** expo, double** temp)	{
 
 	Diagonalise();
@@ -354,10 +742,20 @@ double SubMatrix::GetRate()	{
 }
 
 
+static void EigenSystemError(SubMatrix* matrix)	{
+	cerr << "error in SubMatrix::Diagonalise\n";
+	matrix->CheckReversibility();
+	matrix->ToStream(cerr);
+	exit(1);
+}
+
 double* SubMatrix::GetEigenVal() {
 	if (! diagflag)	{
 		Diagonalise();
 	}
+	if (illcond)	{
+		EigenSystemError(this);
+	}
 	return v;
 }
 
@@ -365,11 +763,17 @@ double** SubMatrix::GetEigenVect() {
 	if (! diagflag)	{
 		Diagonalise();
 	}
+	if (illcond)	{
+		EigenSystemError(this);
+	}
 	return u;
 }
 
 double** SubMatrix::GetInvEigenVect() {
 	if (! diagflag) Diagonalise();
+	if (illcond)	{
+		EigenSystemError(this);
+	}
 	return invu;
 }
 
@@ -388,9 +792,47 @@ void SubMatrix::UpdateMatrix()	{
 	if (isNormalised())	{
 		Normalise();
 	}
+	CorruptLogArrays();
+	CorruptTransitionMatrices();
 	// CheckReversibility();
 }
 
+// ---------------------------------------------------------------------------
+//		 log arrays
+// ---------------------------------------------------------------------------
+
+void SubMatrix::UpdateLogRow(int state)	{
+
+	if (! logQ)	{
+		logQ = new double*[Nstate];
+		logflagarray = new bool[Nstate];
+		for (int k=0; k<Nstate; k++)	{
+			logQ[k] = 0;
+			logflagarray[k] = false;
+		}
+	}
+	if (! logQ[state])	{
+		logQ[state] = new double[Nstate];
+	}
+	double* q = Q[state];
+	double* logq = logQ[state];
+	for (int k=0; k<Nstate; k++)	{
+		logq[k] = (k == state) ? 0 : log(q[k]);
+	}
+	logflagarray[state] = true;
+}
+
+void SubMatrix::UpdateLogStationary()	{
+
+	if (! mLogStationary)	{
+		mLogStationary = new double[Nstate];
+	}
+	for (int k=0; k<Nstate; k++)	{
+		mLogStationary[k] = log(mStationary[k]);
+	}
+	logstatflag = true;
+}
+
 
 
 // ---------------------------------------------------------------------------
@@ -428,20 +870,21 @@ void SubMatrix::ActivatePowers()	{
 		}
 
 		CreatePowers(0);
+		double* r = mPow[0];
 		for (int i=0; i<Nstate; i++)	{
 			for (int j=0; j<Nstate; j++)	{
-				mPow[0][i][j] = 0;
+				r[i*Nstate+j] = 0;
 			}
 		}
 		for (int i=0; i<Nstate; i++)	{
-			mPow[0][i][i] = 1;
+			r[i*Nstate+i] = 1;
 		}
 		for (int i=0; i<Nstate; i++)	{
 			for (int j=0; j<Nstate; j++)	{
-				mPow[0][i][j] += Q[i][j] / UniMu;
-				if (mPow[0][i][j] < 0)	{
+				r[i*Nstate+j] += Q[i][j] / UniMu;
+				if (r[i*Nstate+j] < 0)	{
 					cerr << "error in SubMatrix::ComputePowers: negative prob : ";
-					cerr << i << '\t' << j << '\t' << mPow[0][i][j] << '\n';
+					cerr << i << '\t' << j << '\t' << r[i*Nstate+j] << '\n';
 					cerr << "Nstate : " << Nstate << '\n';
 					exit(1);
 				}
@@ -455,15 +898,6 @@ void SubMatrix::ActivatePowers()	{
 void SubMatrix::InactivatePowers()	{
 
 	if (powflag)	{
-		for (int n=0; n<UniSubNmax; n++)	{
-			if (mPow[n])	{
-				for (int i=0; i<Nstate; i++)	{
-					delete[] mPow[n][i];
-				}
-				delete [] mPow[n];
-				mPow[n] = 0;
-			}
-		}
 		nunimax += npow;
 		nuni++;
 
@@ -474,11 +908,9 @@ void SubMatrix::InactivatePowers()	{
 
 void SubMatrix::CreatePowers(int n)	{
 
-	if (! mPow[n])	{
-		mPow[n] = new double*[Nstate];
-		for (int i=0; i<Nstate; i++)	{
-			mPow[n][i] = new double[Nstate];
-		}
+	while (npowalloc <= n)	{
+		mPow[npowalloc] = new double[Nstate*Nstate];
+		npowalloc++;
 	}
 }
 
@@ -505,24 +937,42 @@ double SubMatrix::Power(int n, int i, int j)	{
 	if (n > npow)	{
 		ComputePowers(n);
 	}
-	return mPow[n-1][i][j];
+	return mPow[n-1][i*Nstate+j];
 }
 
 
+// mPow[n] = mPow[n-1] * mPow[0], by blocks of rows
+// each entry is accumulated over k in increasing order, as in the plain triple loop
+// but the rows of mPow[0] are streamed contiguously, and reused across the whole block
+
+static const int powblock = 8;
+
 void SubMatrix::ComputePowers(int N)	{
 
 	if (! powflag)	{
 		ActivatePowers();
 	}
 	if (N>npow)	{
+		const double* b = mPow[0];
 		for (int n=npow; n<N; n++)	{
 			CreatePowers(n);
-			for (int i=0; i<Nstate; i++)	{
-				for (int j=0; j<Nstate; j++)	{
-					double& t = mPow[n][i][j];
-					t = 0;
-					for (int k=0; k<Nstate; k++)	{
-						t += mPow[n-1][i][k] * mPow[0][k][j];
+			const double* a = mPow[n-1];
+			double* c = mPow[n];
+			for (int i0=0; i0<Nstate; i0+=powblock)	{
+				int i1 = (i0 + powblock < Nstate) ? i0 + powblock : Nstate;
+				for (int i=i0; i<i1; i++)	{
+					for (int j=0; j<Nstate; j++)	{
+						c[i*Nstate+j] = 0;
+					}
+				}
+				for (int k=0; k<Nstate; k++)	{
+					const double* bk = b + k*Nstate;
+					for (int i=i0; i<i1; i++)	{
+						double aik = a[i*Nstate+k];
+						double* ci = c + i*Nstate;
+						for (int j=0; j<Nstate; j++)	{
+							ci[j] += aik * bk[j];
+						}
 					}
 				}
 			}
@@ -41,6 +41,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <cmath>
+#include <pthread.h>
 using namespace std;
 
 #include "Random.h"
@@ -79,6 +80,21 @@ class SubMatrix  	{
 
 	static int		GetUniSubCount() {return nunisubcount;}
 
+	// number of diagonalizations since last call
+	static int		ndiag;
+	static int		GetDiagCount() {int tmp = ndiag; ndiag = 0; return tmp;}
+
+	// number of Pade exponentials computed since last call
+	// (for ill-conditioned eigen systems, or with PB_EXPO=pade, see UseEigenSystem)
+	static int		npade;
+	static int		GetPadeCount() {int tmp = npade; npade = 0; return tmp;}
+
+	// read from the environment
+	// PB_EXPO=pade : never use the eigen system for computing transition probabilities (see UseEigenSystem)
+	// PB_TRANSCACHE=<n> : number of transition matrices cached per matrix (default 16, 0 : no cache)
+	static bool		forcepade;
+	static int		transcachesize;
+
 	static double		GetMeanUni() {return ((double) nunimax) / nuni;}
 
 				SubMatrix(int Nstate, bool innormalise = false);
@@ -92,6 +108,12 @@ class SubMatrix  	{
 	virtual const double* 	GetStationary();
 	double 			Stationary(int i);
 
+	// logarithms of the off-diagonal rates of row i (diagonal entry is set to 0)
+	// and of the stationary probabilities
+	// computed upon first request, and kept until the matrix is modified (CorruptMatrix or UpdateMatrix)
+	const double*		GetLogRow(int i);
+	const double*		GetLogStationary();
+
 	int 			GetNstate() {return Nstate;}
 
 	virtual double		GetRate();
@@ -112,6 +134,22 @@ class SubMatrix  	{
 	double** 		GetEigenVect();
 	double** 		GetInvEigenVect();
 
+	// true if transition probabilities can be computed from the eigen system (diagonalizes the matrix if needed)
+	// false if the diagonalization failed or the eigen system is ill-conditioned (see Diagonalise),
+	// or if Pade exponentials are requested (PB_EXPO)
+	// in that case, only GetTransitionMatrix, GetTransitionProb and GetFiniteTimeTransitionProb should be used
+	bool			UseEigenSystem();
+
+	// transition probabilities exp(length * Q)
+	// from the eigen system, or by Pade approximation with scaling and squaring (see UseEigenSystem)
+	// stored transposed, with rows padded with zeros up to GetPaddedNstate():
+	// trans[l*ld + k] = probability of going from k to l
+	// the matrices are cached by length until the matrix is modified
+	// can be called concurrently by several threads, once UseEigenSystem has been called
+	void			GetTransitionMatrix(double length, double* trans);
+	double			GetTransitionProb(int from, int to, double length);
+	int			GetPaddedNstate() {return ((Nstate + 7) / 8) * 8;}
+
 
 	// uniformization resampling methods
 	// CPU level 1
@@ -134,6 +172,9 @@ class SubMatrix  	{
 
 	void 			UpdateRow(int state);
 	void 			UpdateStationary();
+	void			UpdateLogRow(int state);
+	void			UpdateLogStationary();
+	void			CorruptLogArrays();
 
 
 	void 			ComputePowers(int n);
@@ -143,6 +184,11 @@ class SubMatrix  	{
 
 	int 			Diagonalise();
 
+	void			CorruptTransitionMatrices();
+	double*			FindTransitionMatrix(double length);
+	void			ComputeTransitionMatrix(double length, double* trans);
+	void			ComputePadeExponential(double length, double* trans);
+
 	// data members
 	
 	bool powflag;
@@ -154,7 +200,13 @@ class SubMatrix  	{
 	int npow;
 	double UniMu;
 
-	double*** mPow;
+	// uniformized powers: mPow[n-1][i*Nstate+j] = (I + Q/UniMu)^n (i,j), for 0 < n <= npow
+	// computed upon request, and kept until the matrix is modified
+	// the arrays themselves are kept for the next activation (npowalloc of them are allocated)
+	double** mPow;
+	int npowalloc;
+	// scratch array used by DrawUniformizedTransition
+	double* unicumul;
 	
 	// Q : the infinitesimal generator matrix
 	double ** Q;
@@ -162,6 +214,12 @@ class SubMatrix  	{
 	// the stationary probabilities of the matrix
 	double* mStationary;
 
+	// log Q and log stationary (allocated upon first use)
+	double** logQ;
+	double* mLogStationary;
+	bool* logflagarray;
+	bool logstatflag;
+
 	bool normalise;
 
 	private:
@@ -178,6 +236,15 @@ class SubMatrix  	{
 	double * vi;
 
 	int ndiagfailed;
+
+	bool illcond;
+
+	// cache of transition matrices (direct-mapped on length)
+	// allocated upon first use
+	double* transcache;
+	double* translength;
+	bool* transflag;
+	pthread_mutex_t transmutex;
 };
 
 
@@ -214,12 +281,51 @@ inline double SubMatrix::Stationary(int i)	{
 }
 
 
+inline const double* SubMatrix::GetLogRow(int i)	{
+	if (! flagarray[i])	{
+		UpdateRow(i);
+	}
+	if ((! logQ) || (! logflagarray[i]))	{
+		UpdateLogRow(i);
+	}
+	return logQ[i];
+}
+
+inline const double* SubMatrix::GetLogStationary()	{
+	if (! statflag)	{
+		UpdateStationary();
+	}
+	if (! logstatflag)	{
+		UpdateLogStationary();
+	}
+	return mLogStationary;
+}
+
+inline void SubMatrix::CorruptLogArrays()	{
+	if (logQ)	{
+		for (int k=0; k<Nstate; k++)	{
+			logflagarray[k] = false;
+		}
+	}
+	logstatflag = false;
+}
+
+inline void SubMatrix::CorruptTransitionMatrices()	{
+	if (transflag)	{
+		for (int c=0; c<transcachesize; c++)	{
+			transflag[c] = false;
+		}
+	}
+}
+
 inline void SubMatrix::CorruptMatrix()	{
 	diagflag = false;
 	statflag = false;
 	for (int k=0; k<Nstate; k++)	{
 		flagarray[k] = false;
 	}
+	CorruptLogArrays();
+	CorruptTransitionMatrices();
 	InactivatePowers();
 }
 
@@ -235,6 +341,7 @@ inline bool SubMatrix::ArrayUpdated()	{
 inline void SubMatrix::UpdateStationary()	{
 	ComputeStationary();
 	statflag = true;
+	logstatflag = false;
 }
 	
 inline void SubMatrix::UpdateRow(int state)	{
@@ -248,10 +355,16 @@ inline void SubMatrix::UpdateRow(int state)	{
 		}
 		ComputeArray(state);
 		flagarray[state] = true;
+		if (logQ)	{
+			logflagarray[state] = false;
+		}
 	}
 }
 
 inline double SubMatrix::GetFiniteTimeTransitionProb(int stateup, int statedown, double efflength)	{
+	if (! UseEigenSystem())	{
+		return GetTransitionProb(stateup,statedown,efflength);
+	}
 	double** invp = GetInvEigenVect();
 	double** p = GetEigenVect();
 	double* l = GetEigenVal();
@@ -264,7 +377,7 @@ inline double SubMatrix::GetFiniteTimeTransitionProb(int stateup, int statedown,
 
 inline int SubMatrix::DrawUniformizedTransition(int state, int statedown, int n)	{
 
-	double* p = new double[GetNstate()];
+	double* p = unicumul;
 	double tot = 0;
 	for (int l=0; l<GetNstate(); l++)	{
 		tot += Power(1,state,l) * Power(n,l,statedown);
@@ -280,7 +393,6 @@ inline int SubMatrix::DrawUniformizedTransition(int state, int statedown, int n)
 		cerr << "error in DrawUniformizedTransition: overflow\n";
 		throw;
 	}
-	delete[] p;
 	return k;
 }
 
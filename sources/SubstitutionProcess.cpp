@@ -14,9 +14,12 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 **********************/
 
 #include "SubstitutionProcess.h"
+#include "LikelihoodKernel.h"
+#include "ThreadPool.h"
 #include "Random.h"
 
 #include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -35,6 +38,8 @@ using namespace std;
 void SubstitutionProcess::Create(int site, int dim, int insitemin, int insitemax)	{
 	sitemin = insitemin;
 	sitemax = insitemax;
+	LikelihoodKernel::Init();
+	ThreadPool::Init();
 	//cout << sitemin << "  " << sitemax << endl;
 	if (! ratealloc)	{
 		RateProcess::Create(site);
@@ -48,6 +53,21 @@ void SubstitutionProcess::Delete() {
 	if (ratealloc)	{
 		delete[] ratealloc;
 		ratealloc = 0;
+		delete[] sitepattern;
+		sitepattern = 0;
+		delete[] condloffset;
+		delete[] condlstride;
+		condloffset = 0;
+		condlstride = 0;
+		if (workspace)	{
+			for (int t=0; t<ThreadPool::GetNthread(); t++)	{
+				delete[] workspace[t];
+			}
+		}
+		delete[] workspace;
+		delete[] workspacesize;
+		workspace = 0;
+		workspacesize = 0;
 		ProfileProcess::Delete();
 		RateProcess::Delete();
 	}
@@ -83,20 +103,60 @@ void SubstitutionProcess::DeleteCondSiteLogL()	{
 	}
 }
 
+// computes the offset of each site within the contiguous block, and the (padded) length of its rows
+// the layout depends on the current number of rate categories, and is therefore recomputed
+// each time a vector is created while no other vector is alive
+void SubstitutionProcess::MakeConditionalLikelihoodLayout()	{
+	if (! condloffset)	{
+		condloffset = new long[GetNsite()];
+		condlstride = new int[GetNsite()];
+	}
+	condlsize = 0;
+	for (int i=sitemin; i<sitemax; i++)	{
+		condloffset[i] = condlsize;
+		condlstride[i] = ((GetNstate(i) + 1 + condlpad - 1) / condlpad) * condlpad;
+		condlsize += GetNrate(i) * condlstride[i];
+	}
+}
+
 double*** SubstitutionProcess::CreateConditionalLikelihoodVector()	{
 	//cout << "VECTOR ALLOCATION: " << sitemax << "  " << sitemin << endl;
-	// double*** condl = new double**[sitemax - sitemin];
+	if (! condlcount)	{
+		MakeConditionalLikelihoodLayout();
+	}
+	condlcount++;
+
 	double*** condl = new double**[GetNsite()];
+	if (sitemax <= sitemin)	{
+		return condl;
+	}
+
+	int nrow = 0;
 	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
-		condl[i] = new double*[GetNrate(i)];
+		nrow += GetNrate(i);
+	}
+	double** row = new double*[nrow];
+	allocbytes += nrow * sizeof(double*) + condlsize * sizeof(double);
+	void* mem = 0;
+	if (posix_memalign(&mem, condlpad * sizeof(double), condlsize * sizeof(double)))	{
+		cerr << "error in SubstitutionProcess::CreateConditionalLikelihoodVector: could not allocate " << condlsize * sizeof(double) << " bytes\n";
+		exit(1);
+	}
+	double* base = (double*) mem;
+
+	for (int i=sitemin; i<sitemax; i++)	{
+		condl[i] = row;
+		double* tmp = GetCondlSite(base,i);
+		int nstate = GetNstate(i);
 		for (int j=0; j<GetNrate(i); j++)	{
-			condl[i][j] = new double[GetNstate(i) + 1];
-			double* tmp = condl[i][j];
-			for (int k=0; k<GetNstate(i); k++)	{
+			(*row++) = tmp;
+			for (int k=0; k<nstate; k++)	{
 				tmp[k] = 1.0;
 			}
-			tmp[GetNstate(i)] = 0;
+			for (int k=nstate; k<condlstride[i]; k++)	{
+				tmp[k] = 0;
+			}
+			tmp += condlstride[i];
 		}
 	}
 	//cout << "Test element " << condl[0][1][0] << endl;
@@ -104,15 +164,101 @@ double*** SubstitutionProcess::CreateConditionalLikelihoodVector()	{
 }
 
 void SubstitutionProcess::DeleteConditionalLikelihoodVector(double*** condl)	{
-	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
-		for (int j=0; j<GetNrate(i); j++)	{
-			delete[] condl[i][j];
-		}
-		delete[] condl[i];
+	if (sitemax > sitemin)	{
+		free(GetCondlBase(condl));
+		delete[] condl[sitemin];
 	}
 	delete[] condl;
 	condl = 0;
+	condlcount--;
+}
+
+double* SubstitutionProcess::GetWorkspace(long size, int thread)	{
+	if (! workspace)	{
+		int nthread = ThreadPool::GetNthread();
+		workspace = new double*[nthread];
+		workspacesize = new long[nthread];
+		for (int t=0; t<nthread; t++)	{
+			workspace[t] = 0;
+			workspacesize[t] = 0;
+		}
+	}
+	if (size > workspacesize[thread])	{
+		delete[] workspace[thread];
+		workspace[thread] = new double[size];
+		workspacesize[thread] = size;
+		allocbytes += size * sizeof(double);
+	}
+	return workspace[thread];
+}
+
+//-------------------------------------------------------------------------
+//	* site loops
+//	each of the methods below is applied to blocks of sites [begin,end)
+//	shared out among the threads of the pool (see ThreadPool)
+//-------------------------------------------------------------------------
+
+void SiteLoop::Run(int begin, int end, int thread)	{
+	switch(method)	{
+		case RESET:
+			process->ResetSites(to,condalloc,begin,end);
+			break;
+		case INITIALIZE:
+			process->InitializeSites(to,state,condalloc,begin,end);
+			break;
+		case MULTIPLY:
+			process->MultiplySites(from,to,condalloc,begin,end);
+			break;
+		case OFFSET:
+			process->OffsetSites(to,condalloc,begin,end);
+			break;
+		case LIKELIHOOD:
+			process->ComputeLikelihoodSites(to,condalloc,begin,end);
+			break;
+		case PROPAGATE:
+			process->PropagateSites(from,to,time,condalloc,begin,end,thread);
+			break;
+	}
+}
+
+int SubstitutionProcess::GetSiteBlockSize()	{
+	// about 8 blocks per thread, so that there is something to steal, but not too small
+	int size = (sitemax - sitemin) / (8 * ThreadPool::GetNthread());
+	return (size < minsiteblock) ? minsiteblock : size;
+}
+
+void SubstitutionProcess::RunSiteLoop(ParallelTask& loop)	{
+	ThreadPool::ParallelFor(loop,sitemin,sitemax,GetSiteBlockSize());
+}
+
+void SubstitutionProcess::Reset(double*** t, bool condalloc)	{
+	SiteLoop loop(this,SiteLoop::RESET);
+	loop.to = t;
+	loop.condalloc = condalloc;
+	RunSiteLoop(loop);
+}
+
+void SubstitutionProcess::Initialize(double*** t, const int* state, bool condalloc)	{
+	SiteLoop loop(this,SiteLoop::INITIALIZE);
+	loop.to = t;
+	loop.state = state;
+	loop.condalloc = condalloc;
+	RunSiteLoop(loop);
+}
+
+void SubstitutionProcess::Multiply(double*** from, double*** to, bool condalloc)	{
+	SiteLoop loop(this,SiteLoop::MULTIPLY);
+	loop.from = from;
+	loop.to = to;
+	loop.condalloc = condalloc;
+	RunSiteLoop(loop);
+}
+
+void SubstitutionProcess::Offset(double*** t, bool condalloc)	{
+	SiteLoop loop(this,SiteLoop::OFFSET);
+	loop.to = t;
+	loop.condalloc = condalloc;
+	RunSiteLoop(loop);
 }
 
 //-------------------------------------------------------------------------
@@ -121,20 +267,19 @@ void SubstitutionProcess::DeleteConditionalLikelihoodVector(double*** condl)	{
 //-------------------------------------------------------------------------
 
 // set the vector uniformly to 1 
-void SubstitutionProcess::Reset(double*** t, bool condalloc)	{
-	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
+void SubstitutionProcess::ResetSites(double*** t, bool condalloc, int begin, int end)	{
+	double* base = GetCondlBase(t);
+	for (int i=begin; i<end; i++)	{
+		double* site = GetCondlSite(base,i);
+		int stride = GetCondlStride(i);
+		int nstate = GetNstate(i);
 		for (int j=0; j<GetNrate(i); j++)	{
 			if ((! condalloc) || (ratealloc[i] == j))	{
-				double* tmp = t[i][j];
-				int nstate = GetNstate(i);
+				double* tmp = site + j*stride;
 				for (int k=0; k<nstate; k++)	{
-					(*tmp++) = 1.0;
-					// tmp[k] = 1.0;
+					tmp[k] = 1.0;
 				}
-				*tmp = 0;
-				tmp -= nstate;
-				// tmp[GetNstate(i)] = 0;
+				tmp[nstate] = 0;
 			}
 		}
 	}
@@ -142,51 +287,45 @@ void SubstitutionProcess::Reset(double*** t, bool condalloc)	{
 	
 // initialize the vector according to the data observed at a given leaf of the tree (contained in const int* state)
 // steta[i] == -1 means 'missing data'. in that case, conditional likelihoods are all 1
-void SubstitutionProcess::Initialize(double*** t, const int* state, bool condalloc)	{
-	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
+void SubstitutionProcess::InitializeSites(double*** t, const int* state, bool condalloc, int begin, int end)	{
+	double* base = GetCondlBase(t);
+	for (int i=begin; i<end; i++)	{
+		double* site = GetCondlSite(base,i);
+		int stride = GetCondlStride(i);
+		int nstate = GetNstate(i);
+		double init = (state[i] == -1) ? 1.0 : 0;
 		for (int j=0; j<GetNrate(i); j++)	{
 			if ((! condalloc) || (ratealloc[i] == j))	{
-				double* tmp = t[i][j];
-				int nstate = GetNstate(i);
-				tmp[nstate] = 0;
-				if (state[i] == -1)	{
-					for (int k=0; k<nstate; k++)	{
-						(*tmp++) = 1.0;
-						// tmp[k] = 1.0;
-					}
-					tmp -= nstate;
+				double* tmp = site + j*stride;
+				for (int k=0; k<nstate; k++)	{
+					tmp[k] = init;
 				}
-				else	{
-					for (int k=0; k<nstate; k++)	{
-						(*tmp++) = 0;
-						// tmp[k] = 0;
-					}
-					tmp -= nstate;
+				if (state[i] != -1)	{
 					tmp[state[i]] = 1.0;
 				}
+				tmp[nstate] = 0;
 			}
 		}
 	}
 }
 
 // multiply two conditional likelihood vectors, term by term
-void SubstitutionProcess::Multiply(double*** from, double*** to, bool condalloc)	{
-	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
+void SubstitutionProcess::MultiplySites(double*** from, double*** to, bool condalloc, int begin, int end)	{
+	double* frombase = GetCondlBase(from);
+	double* tobase = GetCondlBase(to);
+	for (int i=begin; i<end; i++)	{
+		double* fromsite = GetCondlSite(frombase,i);
+		double* tosite = GetCondlSite(tobase,i);
+		int stride = GetCondlStride(i);
+		int nstate = GetNstate(i);
 		for (int j=0; j<GetNrate(i); j++)	{
 			if ((! condalloc) || (ratealloc[i] == j))	{
-				double* tmpfrom = from[i][j];
-				double* tmpto = to[i][j];
-				int nstate = GetNstate(i);
-				for (int k=0; k<nstate; k++)	{
-					(*tmpto++) *= (*tmpfrom++);
-					// tmpto[k] *= tmpfrom[k];
-				}
-				*tmpto += *tmpfrom;
-				tmpto -= nstate;
-				tmpfrom -= nstate;
-				// tmpto[GetNstate(i)] += tmpfrom[GetNstate(i)];
+				const double* tmpfrom = fromsite + j*stride;
+				double* tmpto = tosite + j*stride;
+				// offsets (in log) are added
+				double offset = tmpto[nstate] + tmpfrom[nstate];
+				LikelihoodKernel::Multiply(tmpto,tmpfrom,nstate);
+				tmpto[nstate] = offset;
 			}
 		}
 	}
@@ -194,19 +333,15 @@ void SubstitutionProcess::Multiply(double*** from, double*** to, bool condalloc)
 
 // multiply a conditional likelihood vector by the (possibly site-specific) stationary probabilities of the process
 void SubstitutionProcess::MultiplyByStationaries(double*** to, bool condalloc)	{
+	double* base = GetCondlBase(to);
 	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
 		const double* stat = GetStationary(i);
+		double* site = GetCondlSite(base,i);
+		int stride = GetCondlStride(i);
+		int nstate = GetNstate(i);
 		for (int j=0; j<GetNrate(i); j++)	{
 			if ((! condalloc) || (ratealloc[i] == j))	{
-				double* tmpto = to[i][j];
-				int nstate = GetNstate(i);
-				for (int k=0; k<nstate; k++)	{	
-					(*tmpto++) *= (*stat++);
-					// tmpto[k] *= stat[k];
-				}
-				tmpto -= nstate;
-				stat -= nstate;
+				LikelihoodKernel::Multiply(site + j*stride,stat,nstate);
 			}
 		}
 	}
@@ -215,22 +350,21 @@ void SubstitutionProcess::MultiplyByStationaries(double*** to, bool condalloc)	{
 // to avoid numerical errors: all entries for a given site and a given rate
 // are divided by the largest among them
 // and the residual is stored in the last entry of the vector
-void SubstitutionProcess::Offset(double*** t, bool condalloc)	{
-	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
+void SubstitutionProcess::OffsetSites(double*** t, bool condalloc, int begin, int end)	{
+	double* base = GetCondlBase(t);
+	for (int i=begin; i<end; i++)	{
+		double* site = GetCondlSite(base,i);
+		int stride = GetCondlStride(i);
+		int nstate = GetNstate(i);
 		for (int j=0; j<GetNrate(i); j++)	{
 			if ((! condalloc) || (ratealloc[i] == j))	{
-				double* tmp = t[i][j];
+				double* tmp = site + j*stride;
+				double min = 0;
 				double max = 0;
-				for (int k=0; k<GetNstate(i); k++)	{
-					if (tmp[k] <0)	{
-						cerr << "error in pruning: negative prob : " << tmp[k] << "\n";
-						exit(1);
-						tmp[k] = 0;
-					}
-					if (max < tmp[k])	{
-						max = tmp[k];
-					}
+				LikelihoodKernel::Range(tmp,nstate,min,max);
+				if (min < 0)	{
+					cerr << "error in pruning: negative prob : " << min << "\n";
+					exit(1);
 				}
 				if (max == 0)	{
 					max = 1e-12;
@@ -239,10 +373,8 @@ void SubstitutionProcess::Offset(double*** t, bool condalloc)	{
 					exit(1);
 					*/
 				}
-				for (int k=0; k<GetNstate(i); k++)	{
-					tmp[k] /= max;
-				}
-				tmp[GetNstate(i)] += log(max);
+				LikelihoodKernel::Scale(tmp,1.0/max,nstate);
+				tmp[nstate] += log(max);
 			}
 		}
 	}
@@ -253,18 +385,16 @@ void SubstitutionProcess::Offset(double*** t, bool condalloc)	{
 //	(CPU level 2)
 //-------------------------------------------------------------------------
 
-double SubstitutionProcess::ComputeLikelihood(double*** aux, bool condalloc)	{
-	for (int i=sitemin; i<sitemax; i++)	{
-	// for (int i=0; i<GetNsite(); i++)	{
+void SubstitutionProcess::ComputeLikelihoodSites(double*** aux, bool condalloc, int begin, int end)	{
+	double* base = GetCondlBase(aux);
+	for (int i=begin; i<end; i++)	{
+		double* site = GetCondlSite(base,i);
+		int stride = GetCondlStride(i);
+		int nstate = GetNstate(i);
 		if (condalloc)	{
 			int j = ratealloc[i];
-			double* t = aux[i][j];
-			double tot = 0;
-			int nstate = GetNstate(i);
-			for (int k=0; k<nstate; k++)	{
-				tot += (*t++);
-				// tot += t[k];
-			}
+			const double* t = site + j*stride;
+			double tot = LikelihoodKernel::Sum(t,nstate);
 			if (tot == 0)	{
 				// dirty !
 				tot = 1e-12;
@@ -276,21 +406,14 @@ double SubstitutionProcess::ComputeLikelihood(double*** aux, bool condalloc)	{
 				exit(1);
 				*/
 			}
-			sitelogL[i] = log(tot) + (*t);
-			// sitelogL[i] = log(tot) + t[GetNstate(i)];
-			t -= nstate;
+			sitelogL[i] = log(tot) + t[nstate];
 		}
 		else	{
 			double max = 0;
 			double* logl = condsitelogL[i];
 			for (int j=0; j<GetNrate(i); j++)	{
-				double* t = aux[i][j];
-				double tot = 0;
-				int nstate = GetNstate(i);
-				for (int k=0; k<nstate; k++)	{
-					tot += (*t++);
-					// tot += t[k];
-				}
+				const double* t = site + j*stride;
+				double tot = LikelihoodKernel::Sum(t,nstate);
 				if (tot == 0)	{
 					// dirty !
 					tot = 1e-12;
@@ -302,9 +425,7 @@ double SubstitutionProcess::ComputeLikelihood(double*** aux, bool condalloc)	{
 					exit(1);
 					*/
 				}
-				logl[j] = log(tot) + (*t);
-				// logl[j] = log(tot) + t[GetNstate(i)];
-				t -= nstate;
+				logl[j] = log(tot) + t[nstate];
 				if ((!j) || (max < logl[j]))	{
 					max = logl[j];
 				}
@@ -322,6 +443,16 @@ double SubstitutionProcess::ComputeLikelihood(double*** aux, bool condalloc)	{
 		}
 	}
 
+}
+
+double SubstitutionProcess::ComputeLikelihood(double*** aux, bool condalloc)	{
+
+	SiteLoop loop(this,SiteLoop::LIKELIHOOD);
+	loop.to = aux;
+	loop.condalloc = condalloc;
+	RunSiteLoop(loop);
+
+	// summed in site order, whatever the number of threads
 	logL = 0;
 	for (int i=sitemin; i<sitemax; i++)	{
 	// for (int i=0; i<GetNsite(); i++)	{
@@ -21,6 +21,7 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 #include "ProfileProcess.h"
 #include "BranchSitePath.h"
 #include "Chrono.h"
+#include "ThreadPool.h"
 #include <algorithm>
 
 // ----
@@ -63,11 +64,34 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 // about everything that needs to be parallelized is here
 // the only exception is "
 
+class SubstitutionProcess;
+
+// one of the site loops of SubstitutionProcess, together with its arguments
+// run over blocks of sites by the thread pool
+class SiteLoop : public ParallelTask	{
+
+	public:
+
+	enum Method {RESET, INITIALIZE, MULTIPLY, OFFSET, LIKELIHOOD, PROPAGATE};
+
+	SiteLoop(SubstitutionProcess* inprocess, Method inmethod) : process(inprocess), method(inmethod), from(0), to(0), state(0), time(0), condalloc(false) {}
+
+	void Run(int begin, int end, int thread);
+
+	SubstitutionProcess* process;
+	Method method;
+	double*** from;
+	double*** to;
+	const int* state;
+	double time;
+	bool condalloc;
+};
+
 class SubstitutionProcess : public virtual RateProcess, public virtual ProfileProcess {
 
 	public:
 
-	SubstitutionProcess() : condsitelogL(0), sitelogL(0), meansiterate(0), ratealloc(0), infprobcount(0), suboverflowcount(0) {}
+	SubstitutionProcess() : condsitelogL(0), sitelogL(0), meansiterate(0), ratealloc(0), infprobcount(0), suboverflowcount(0), mapsitecount(0), maptrialcount(0), mapunicount(0), sitepattern(0), condloffset(0), condlstride(0), condlsize(0), condlcount(0), workspace(0), workspacesize(0), allocbytes(0) {}
 	virtual ~SubstitutionProcess() {}
 
 	// basic accessors, needed to perform elementary likelihood computations and substitution mappings
@@ -86,6 +110,16 @@ class SubstitutionProcess : public virtual RateProcess, public virtual ProfilePr
 
 	int GetInfProbCount() {return infprobcount;}
 
+	// substitution mapping counters since the last call (counters are reset)
+	// number of site paths sampled, total number of accept-reject trials,
+	// and number of site paths eventually sampled by uniformization
+	void GetMappingCounts(double& nsite, double& ntrial, double& nuni)	{
+		nsite = mapsitecount;
+		ntrial = maptrialcount;
+		nuni = mapunicount;
+		mapsitecount = maptrialcount = mapunicount = 0;
+	}
+
 	protected:
 
 	void Create(int innsite, int indim, int insitemin,int insitemax);
@@ -93,9 +127,46 @@ class SubstitutionProcess : public virtual RateProcess, public virtual ProfilePr
 
 	// basic modules for creating deleting arrays of conditional likelihoods
 	// used by PhyloProcess
+	//
+	// all the entries of a conditional likelihood vector are stored in one single aligned block of memory
+	// laid out site by site, then rate by rate, each (site,rate) row being padded to a multiple of condlpad doubles
+	// the double*** returned is just a table of pointers into this block (so that condl[i][j] still works)
+	// but the CPU intensive methods directly use the index-based view below
 	double*** CreateConditionalLikelihoodVector();
 	void DeleteConditionalLikelihoodVector(double*** condl);
 
+	void MakeConditionalLikelihoodLayout();
+
+	// start of the contiguous block
+	double* GetCondlBase(double*** condl)	{
+		return (sitemax > sitemin) ? condl[sitemin][0] : 0;
+	}
+	// first row of site i (rate category j is at GetCondlSite(...) + j * GetCondlStride(i))
+	double* GetCondlSite(double* base, int site)	{
+		return base + condloffset[site];
+	}
+	int GetCondlStride(int site)	{
+		return condlstride[site];
+	}
+
+	// memory footprint of one conditional likelihood vector, in bytes
+	long GetConditionalLikelihoodVectorSize()	{
+		return condlsize * sizeof(double);
+	}
+
+	// persistent scratch array used by the CPU intensive methods (such as Propagate)
+	// allocated once, and reallocated only if a larger size is requested
+	// one per thread: should be first requested for all threads outside of parallel loops
+	double* GetWorkspace(long size, int thread = 0);
+
+	// number of bytes allocated by conditional likelihood vectors, workspaces and substitution mappings
+	// since the last call (counter is reset)
+	double GetAllocBytes()	{
+		double tmp = allocbytes + pathpool.GetAllocBytes();
+		allocbytes = 0;
+		return tmp;
+	}
+
 	double* CreateProbVector()	{
 		return new double[GetSiteMax() - GetSiteMin()];
 		// return new double[GetNsite()];
@@ -117,6 +188,18 @@ class SubstitutionProcess : public virtual RateProcess, public virtual ProfilePr
 	// bool condalloc = true means that we want to make the computation, for each site,
 	// only for the category specified for that site by double* ratealloc
 
+	// the site loops below are split over the threads of the pool (see ThreadPool)
+	friend class SiteLoop;
+	static const int minsiteblock = 32;
+	int GetSiteBlockSize();
+	void RunSiteLoop(ParallelTask& loop);
+
+	void ResetSites(double*** condl, bool condalloc, int begin, int end);
+	void InitializeSites(double*** condl, const int* leafstates, bool condalloc, int begin, int end);
+	void MultiplySites(double*** from, double*** to, bool condalloc, int begin, int end);
+	void OffsetSites(double*** condl, bool condalloc, int begin, int end);
+	void ComputeLikelihoodSites(double*** aux, bool condalloc, int begin, int end);
+
 	// CPU : level 1
 	void Reset(double*** condl, bool condalloc = false);
 	void Multiply(double*** from, double*** to, bool condalloc = false);
@@ -130,6 +213,9 @@ class SubstitutionProcess : public virtual RateProcess, public virtual ProfilePr
 	// CPU : level 3
 	// implemented in GTR or POisson Substitution process
 	virtual void Propagate(double*** from, double*** to, double time, bool condalloc = false) = 0;
+	// the part of Propagate run by each thread, over a block [begin,end) of the sites
+	// (taken in the order chosen by Propagate)
+	virtual void PropagateSites(double*** from, double*** to, double time, bool condalloc, int begin, int end, int thread) = 0;
 
 	virtual void SimuPropagate(int* stateup, int* statedown, double time) = 0;
 
@@ -165,6 +251,33 @@ class SubstitutionProcess : public virtual RateProcess, public virtual ProfilePr
 
 	int infprobcount;
 	int suboverflowcount;
+
+	double mapsitecount;
+	double maptrialcount;
+	double mapunicount;
+
+	// data pattern of each site of [sitemin,sitemax):
+	// smallest site of [sitemin,sitemax) having the same column in the alignment
+	// (0 if unknown, see PhyloProcess::ComputeSitePatterns)
+	// sites with the same pattern, the same matrix and the same rate share their conditional likelihoods,
+	// which are then computed only once by Propagate
+	int* sitepattern;
+
+	// layout of the conditional likelihood vectors (in doubles)
+	static const int condlpad = 8;
+	long* condloffset;
+	int* condlstride;
+	long condlsize;
+	int condlcount;
+
+	double** workspace;
+	long* workspacesize;
+	double allocbytes;
+
+	// substitution mappings of the current cycle (released at once by PhyloProcess::DeleteMappings)
+	PathPool pathpool;
+	// scratch path used by SamplePaths
+	PathBuilder pathbuilder;
 };
 
 #endif
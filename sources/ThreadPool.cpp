@@ -0,0 +1,142 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#include "ThreadPool.h"
+
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+int ThreadPool::nthread = 1;
+pthread_t* ThreadPool::threads = 0;
+pthread_mutex_t ThreadPool::mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t ThreadPool::startcond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t ThreadPool::donecond = PTHREAD_COND_INITIALIZER;
+int ThreadPool::generation = 0;
+int ThreadPool::nrunning = 0;
+bool ThreadPool::busy = false;
+ParallelTask* ThreadPool::task = 0;
+int ThreadPool::taskbegin = 0;
+int ThreadPool::taskend = 0;
+int ThreadPool::taskblocksize = 1;
+ThreadPool::BlockRange* ThreadPool::range = 0;
+
+void ThreadPool::Init()	{
+
+	if (threads)	{
+		return;
+	}
+	const char* tmp = getenv("PB_NTHREADS");
+	if (tmp)	{
+		nthread = atoi(tmp);
+		if (nthread < 1)	{
+			cerr << "error: PB_NTHREADS should be a positive integer\n";
+			exit(1);
+		}
+	}
+	range = new BlockRange[nthread];
+	threads = new pthread_t[nthread];
+	for (int t=1; t<nthread; t++)	{
+		if (pthread_create(&threads[t],0,Worker,(void*) (long) t))	{
+			cerr << "error in ThreadPool::Init: cannot create thread\n";
+			exit(1);
+		}
+	}
+}
+
+void* ThreadPool::Worker(void* arg)	{
+
+	int thread = (int) (long) arg;
+	// generation is 0 when the pool is started
+	// (a loop may have been launched before this thread gets to wait for it)
+	int current = 0;
+	pthread_mutex_lock(&mutex);
+	while (true)	{
+		while (generation == current)	{
+			pthread_cond_wait(&startcond,&mutex);
+		}
+		current = generation;
+		pthread_mutex_unlock(&mutex);
+
+		Work(thread);
+
+		pthread_mutex_lock(&mutex);
+		nrunning--;
+		if (! nrunning)	{
+			pthread_cond_signal(&donecond);
+		}
+	}
+	return 0;
+}
+
+void ThreadPool::Work(int thread)	{
+
+	// own blocks first, then those left over by the other threads
+	for (int k=0; k<nthread; k++)	{
+		BlockRange& r = range[(thread + k) % nthread];
+		int b = __sync_fetch_and_add(&r.next,1);
+		while (b < r.end)	{
+			int begin = taskbegin + b * taskblocksize;
+			int end = begin + taskblocksize;
+			if (end > taskend)	{
+				end = taskend;
+			}
+			task->Run(begin,end,thread);
+			b = __sync_fetch_and_add(&r.next,1);
+		}
+	}
+}
+
+void ThreadPool::ParallelFor(ParallelTask& intask, int begin, int end, int blocksize)	{
+
+	if (end <= begin)	{
+		return;
+	}
+	if (blocksize < 1)	{
+		blocksize = 1;
+	}
+	int nblock = (end - begin + blocksize - 1) / blocksize;
+	if ((nthread == 1) || busy || (nblock == 1))	{
+		intask.Run(begin,end,0);
+		return;
+	}
+
+	busy = true;
+	for (int t=0; t<nthread; t++)	{
+		range[t].next = (int) (((long) t) * nblock / nthread);
+		range[t].end = (int) (((long) (t+1)) * nblock / nthread);
+	}
+
+	pthread_mutex_lock(&mutex);
+	task = &intask;
+	taskbegin = begin;
+	taskend = end;
+	taskblocksize = blocksize;
+	nrunning = nthread - 1;
+	generation++;
+	pthread_cond_broadcast(&startcond);
+	pthread_mutex_unlock(&mutex);
+
+	Work(0);
+
+	pthread_mutex_lock(&mutex);
+	while (nrunning)	{
+		pthread_cond_wait(&donecond,&mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+	busy = false;
+}
+
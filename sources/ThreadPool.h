@@ -0,0 +1,105 @@
+
+/********************
+
+PhyloBayes MPI. Copyright 2010-2013 Nicolas Lartillot, Nicolas Rodrigue, Daniel Stubbs, Jacques Richer.
+
+PhyloBayes is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+PhyloBayes is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details. You should have received a copy of the GNU General Public License
+along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
+
+**********************/
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+
+// threads working inside each MPI process
+//
+// each process works on its own range of sites (see MPIPartition)
+// the loops over sites of the CPU intensive methods can in addition be split over a pool of threads
+// sharing the memory of the process (tree, substitution matrices, conditional likelihoods)
+// so that one process per socket (or per node) can use all the cores
+//
+// the number of threads (including the calling one) is given by the environment variable PB_NTHREADS (default 1)
+// only the main thread of each process makes MPI calls
+
+// a loop body, applied to the items of [begin,end) by thread number thread (0 is the calling thread)
+// different threads always work on disjoint item ranges
+class ParallelTask	{
+
+	public:
+
+	virtual ~ParallelTask() {}
+	virtual void Run(int begin, int end, int thread) = 0;
+};
+
+// a loop body given by a method of some object, called on each block of items: (object->*method)(begin,end)
+template <class T> class MethodLoop : public ParallelTask	{
+
+	public:
+
+	MethodLoop(T* inobject, void (T::*inmethod)(int,int)) : object(inobject), method(inmethod) {}
+
+	void Run(int begin, int end, int thread)	{
+		(object->*method)(begin,end);
+	}
+
+	private:
+
+	T* object;
+	void (T::*method)(int,int);
+};
+
+class ThreadPool	{
+
+	public:
+
+	// start the pool (once)
+	static void Init();
+
+	static int GetNthread() {return nthread;}
+
+	// runs task over [begin,end), split into blocks of blocksize items
+	// each thread starts with an equal share of the blocks, and steals blocks from the other threads when done with its own
+	// returns once all blocks have been processed
+	// with only one thread (or if called from within a parallel loop), task.Run(begin,end,0) is called directly
+	static void ParallelFor(ParallelTask& task, int begin, int end, int blocksize);
+
+	private:
+
+	static void* Worker(void* arg);
+	static void Work(int thread);
+
+	static int nthread;
+	static pthread_t* threads;
+	static pthread_mutex_t mutex;
+	static pthread_cond_t startcond;
+	static pthread_cond_t donecond;
+	static int generation;
+	static int nrunning;
+	static bool busy;
+
+	// current loop
+	static ParallelTask* task;
+	static int taskbegin;
+	static int taskend;
+	static int taskblocksize;
+
+	// blocks [next,end) remaining in the share of each thread
+	// (one cache line per thread)
+	struct BlockRange	{
+		volatile int next;
+		int end;
+		char pad[64 - 2*sizeof(int)];
+	};
+	static BlockRange* range;
+};
+
+#endif
+
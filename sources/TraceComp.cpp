@@ -15,11 +15,13 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 #include "phylo.h"
 #include "Parallel.h"
+#include "ThreadPool.h"
 MPI_Datatype Propagate_arg;
 
 const int MaxChain = 10;
 
 extern int SamCompare(int nchain, int burnin, int stop, string* ChainName, double& disc, double& overlap, double& effsize, string outname);
+extern int TraceMonitor(int nchain, int burnin, string* ChainName, int interval);
 
 
 int main(int argc, char* argv[])	{
@@ -31,11 +33,14 @@ int main(int argc, char* argv[])	{
 
 	string OutFile = "";
 	int burnin = -1;
+	int interval = 0;
 
 	if (argc == 1)	{
 		cerr << "tracecomp [-ox] ChainName1 ChainName2 ... \n";
 		cerr << "\t-o <output> : detailed output into file\n"; 
 		cerr << "\t-x <burnin> [<every> <until>]. default burnin = 0\n";
+		cerr << "\t-s [<interval>] : monitor running chains, updating batch-means effective sizes\n";
+		cerr << "\t                  every <interval> seconds (default 60) until the chains are stopped\n";
 		cerr << '\n';
 		cerr << "\t measure the effective sizes and overlap between 95% CI of several independent chains\n";
 		cerr << '\n';
@@ -84,6 +89,13 @@ int main(int argc, char* argv[])	{
 			i++;
 			OutFile = argv[i];
 		}
+		else if (s == "-s")	{
+			interval = 60;
+			if ((i+1 < argc) && IsInt(argv[i+1]))	{
+				i++;
+				interval = atoi(argv[i]);
+			}
+		}
 		else	{
 			ChainName[P] = argv[i];
 			P++;
@@ -104,6 +116,11 @@ int main(int argc, char* argv[])	{
 		}
 	}
 
+	if (interval)	{
+		TraceMonitor(P,burnin,ChainName,interval);
+		exit(0);
+	}
+
 	// measure file size
 	int tracesize = 0;
 	for (int p=0; p<P; p++)	{
@@ -131,6 +148,7 @@ int main(int argc, char* argv[])	{
 	if (OutFile == "")	{
 		OutFile = "tracecomp";
 	}
+	ThreadPool::Init();
 	SamCompare(P,burnin,until,ChainName,disc,overlap,effsize,OutFile);
 }
 
@@ -18,6 +18,8 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 #include <getopt.h>
 #include <string>
 #include <stdio.h>
+#include <unistd.h>
+#include <vector>
 #include "correlation.h"
 using namespace std;
 
@@ -208,3 +210,157 @@ int SamCompare(int nchain, int burnin, int stop, string* ChainName, double& disc
 
   return 1;
 }
+
+// live monitoring of the effective sizes of running chains
+//
+// every interval seconds, the lines appended to the trace files since the last update are read
+// and the batch-means effective sizes (see StreamingEffectiveSize) are updated and printed
+// (the cost of an update only depends on the number of new lines)
+// stops once all chains are stopped (their .run file does not contain 1)
+
+struct TraceStream	{
+
+	string filename;
+	string runname;
+	streamoff offset;
+	long int nline;
+	int nbparameter;
+	string* parameterName;
+	StreamingEffectiveSize* ess;
+};
+
+// reads the complete lines appended to the trace since the last call
+// returns false if the header is not yet available
+static bool UpdateTraceStream(TraceStream& trace, int burnin)
+{
+	ifstream is(trace.filename.c_str(), ios::in | ios::binary);
+	if (! is)	{
+		return false;
+	}
+	is.seekg(trace.offset);
+	ostringstream os;
+	os << is.rdbuf();
+	string buffer = os.str();
+	size_t end = buffer.rfind('\n');
+	if (end == string::npos)	{
+		return (trace.ess != 0);
+	}
+	trace.offset += end + 1;
+	istringstream lines(buffer.substr(0,end+1));
+	string line;
+	while (getline(lines,line))	{
+		istringstream iss(line);
+		string strtmp;
+		if (! trace.ess)	{
+			// header: 3 first columns are not parameters
+			iss >> strtmp >> strtmp >> strtmp;
+			vector<string> names;
+			while (iss >> strtmp)	{
+				names.push_back(strtmp);
+			}
+			trace.nbparameter = names.size();
+			trace.parameterName = new string[trace.nbparameter];
+			for (int j=0; j<trace.nbparameter; j++)	{
+				trace.parameterName[j] = names[j];
+			}
+			trace.ess = new StreamingEffectiveSize(trace.nbparameter);
+			continue;
+		}
+		if (trace.nline++ < burnin)	{
+			continue;
+		}
+		double tmp;
+		iss >> tmp >> tmp >> tmp;
+		double x[trace.nbparameter];
+		int j = 0;
+		while ((j<trace.nbparameter) && (iss >> x[j]))	{
+			j++;
+		}
+		if (j == trace.nbparameter)	{
+			trace.ess->addSample(x);
+		}
+	}
+	return true;
+}
+
+int TraceMonitor(int nchain, int burnin, string* ChainName, int interval)
+{
+	if (burnin < 0)	{
+		burnin = 0;
+	}
+	TraceStream* trace = new TraceStream[nchain];
+	for (int chain=0; chain<nchain; chain++)	{
+		trace[chain].filename = ChainName[chain];
+		string base = ChainName[chain];
+		if ((base.size() > 6) && (base.substr(base.size()-6) == ".trace"))	{
+			base = base.substr(0,base.size()-6);
+		}
+		trace[chain].runname = base + ".run";
+		trace[chain].offset = 0;
+		trace[chain].nline = 0;
+		trace[chain].nbparameter = 0;
+		trace[chain].parameterName = 0;
+		trace[chain].ess = 0;
+	}
+
+	bool running = true;
+	while (running)	{
+
+		// chains are checked before reading the traces, so that the last update sees all samples
+		running = false;
+		for (int chain=0; chain<nchain; chain++)	{
+			ifstream ris(trace[chain].runname.c_str());
+			int status = 0;
+			if (ris >> status)	{
+				running |= (status == 1);
+			}
+		}
+
+		bool ready = true;
+		for (int chain=0; chain<nchain; chain++)	{
+			ready &= UpdateTraceStream(trace[chain],burnin);
+		}
+		for (int chain=1; ready && (chain<nchain); chain++)	{
+			if (trace[chain].nbparameter != trace[0].nbparameter)	{
+				cerr << "ERROR in TraceMonitor: the chains have not the same dimensionality\n";
+				exit(1);
+			}
+		}
+
+		if (ready)	{
+			cout << "samples             ";
+			for (int chain=0; chain<nchain; chain++)	{
+				cout << trace[chain].ess->getNbSample() << '\t';
+			}
+			cout << '\n';
+			double minsize = -1;
+			int minparam = 0;
+			for (int j=0; j<trace[0].nbparameter; j++)	{
+				cout << trace[0].parameterName[j];
+				for (unsigned int k=trace[0].parameterName[j].length(); k<20; k++) cout << ' ';
+				for (int chain=0; chain<nchain; chain++)	{
+					double size = trace[chain].ess->getEffectiveSize(j);
+					cout << (int) size << '\t';
+					if ((minsize == -1) || (size < minsize))	{
+						minsize = size;
+						minparam = j;
+					}
+				}
+				cout << '\n';
+			}
+			cout << "min effsize : " << (int) minsize << " (" << trace[0].parameterName[minparam] << ")\n";
+			cout << '\n';
+			cout.flush();
+		}
+		if (running)	{
+			sleep(interval);
+		}
+	}
+
+	for (int chain=0; chain<nchain; chain++)	{
+		delete trace[chain].ess;
+		delete[] trace[chain].parameterName;
+	}
+	delete[] trace;
+	return 1;
+}
@@ -14,6 +14,46 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 **********************/
 
 #include "correlation.h"
+#include "ThreadPool.h"
+
+#include <complex>
+#include <vector>
+
+// in-place radix-2 FFT of x (size n, a power of 2)
+// sign = -1 : forward transform, +1 : inverse transform (not normalized)
+static void FFT(complex<double>* x, int n, int sign)
+{
+  for(int i=1,j=0;i<n;i++)
+    {
+      int bit=n>>1;
+      for(;j&bit;bit>>=1)
+	j^=bit;
+      j^=bit;
+      if(i<j)
+	swap(x[i],x[j]);
+    }
+  for(int len=2;len<=n;len<<=1)
+    {
+      double theta=sign*2*M_PI/len;
+      complex<double> wlen(cos(theta),sin(theta));
+      for(int i=0;i<n;i+=len)
+	{
+	  complex<double> w(1,0);
+	  for(int j=0;j<len/2;j++)
+	    {
+	      complex<double> u=x[i+j];
+	      complex<double> v=x[i+j+len/2]*w;
+	      x[i+j]=u+v;
+	      x[i+j+len/2]=u-v;
+	      // recompute the twiddle factor every 16 steps, to limit the accumulation of rounding errors
+	      if((j&15)==15)
+		w=complex<double>(cos(theta*(j+1)),sin(theta*(j+1)));
+	      else
+		w*=wlen;
+	    }
+	}
+    }
+}
 
 Correlation::Correlation(double ci)
 {
@@ -340,6 +380,40 @@ void Correlation::computeMean()
     }
 }
 
+// lag autocovariances of parameter j, for lags 0 to nbsample/2 - 1
+// sum_{i<nbsample-t} (x_i - mean) (x_{i+t} - mean), computed by FFT in O(N log N):
+// the centered series is padded with zeros up to twice its length (so that the circular correlation is the linear one)
+// and its autocorrelation is the inverse transform of its power spectrum
+// the lag 0 term (the variance) is computed directly
+void Correlation::computeColumnCovariance(int j)
+{
+  // no lag at all with a single sample (covparam[j] is then empty)
+  if((isConstant[j]==Yes) || (nbsample/2==0))
+    return;
+  int n=1;
+  while(n<2*nbsample)
+    n<<=1;
+  vector<complex<double> > x(n,complex<double>(0,0));
+  for(int i=0;i<nbsample;i++)
+    x[i]=parameters[j][i]-meanparam[j];
+  FFT(&x[0],n,-1);
+  for(int k=0;k<n;k++)
+    x[k]=norm(x[k]);
+  FFT(&x[0],n,+1);
+
+  covparam[j][0]=0;
+  for(int i=0;i<nbsample;i++)
+    covparam[j][0]+=(parameters[j][i]-meanparam[j])*(parameters[j][i]-meanparam[j]);
+  for(int t=1;t<nbsample/2;t++)
+    covparam[j][t]=x[t].real()/n;
+}
+
+void Correlation::computeColumnCovariances(int begin, int end)
+{
+  for(int j=begin;j<end;j++)
+    computeColumnCovariance(j);
+}
+
 void Correlation::computeCovariance()
 {
   if(nbsample==0)
@@ -351,35 +425,26 @@ void Correlation::computeCovariance()
       createCovarianceBuffer();
       computeMean();
 
-      for(int t=0;t<nbsample/2;t++)
+      // columns are independent, and are processed in parallel
+      MethodLoop<Correlation> loop(this,&Correlation::computeColumnCovariances);
+      ThreadPool::ParallelFor(loop,0,nbparameter,1);
+
+      for(int j=0;j<nbparameter;j++)
 	{
-	  for(int j=0;j<nbparameter;j++)
+	  if(nbsample/2==0)
+	    continue;
+	  variance[j]=covparam[j][0]/(double)(nbsample-1);
+	  for(int t=0;t<nbsample/2;t++)
+	    covparam[j][t]/=(double)(nbsample);
+	  for(int t=0;t<nbsample/2;t++)
 	    {
-	      for(int i=0;i<nbsample-t;i++)
-		{
-		  covparam[j][t]+=(parameters[j][i]-meanparam[j])*(parameters[j][i+t]-meanparam[j]);
-		}
-	      if(isConstant[j]==Yes)
-		covparam[j][t]=0;
-	    }
-	  if(t==0)
-	    {
-	      for(int j=0;j<nbparameter;j++)
-		{
-		  variance[j]=covparam[j][0]/(double)(nbsample-1);
-		}
-	    } 
-	  for(int j=0;j<nbparameter;j++)
-	    {
-	      covparam[j][t]/=(double)(nbsample);
 	      // normalisation
 	      if(covparam[j][0]!=0)
 		covnorm[j][t]=covparam[j][t]/covparam[j][0];
 	      else
 		covnorm[j][t]=0;
 	    }
-	} // fin for t
-
+	}
     }
 }
 
@@ -482,3 +547,107 @@ double  Correlation::getNbSample()
 {
   return nbsample;
 }
+
+StreamingEffectiveSize::StreamingEffectiveSize(int nbparam, int nbatch)
+{
+  nbparameter=nbparam;
+  nbatchmax=nbatch;
+  nbsample=0;
+  batchsize=1;
+  currentsize=0;
+  nbbatch=0;
+  meanparam=new double[nbparameter];
+  m2=new double[nbparameter];
+  currentsum=new double[nbparameter];
+  batchsum=new double*[nbparameter];
+  for(int j=0;j<nbparameter;j++)
+    {
+      meanparam[j]=0;
+      m2[j]=0;
+      currentsum[j]=0;
+      batchsum[j]=new double[2*nbatchmax];
+    }
+}
+
+StreamingEffectiveSize::~StreamingEffectiveSize()
+{
+  for(int j=0;j<nbparameter;j++)
+    delete[] batchsum[j];
+  delete[] batchsum;
+  delete[] currentsum;
+  delete[] m2;
+  delete[] meanparam;
+}
+
+void StreamingEffectiveSize::addSample(const double* x)
+{
+  nbsample++;
+  for(int j=0;j<nbparameter;j++)
+    {
+      // Welford
+      double delta=x[j]-meanparam[j];
+      meanparam[j]+=delta/nbsample;
+      m2[j]+=delta*(x[j]-meanparam[j]);
+      currentsum[j]+=x[j];
+    }
+  currentsize++;
+  if(currentsize==batchsize)
+    {
+      for(int j=0;j<nbparameter;j++)
+	{
+	  batchsum[j][nbbatch]=currentsum[j];
+	  currentsum[j]=0;
+	}
+      nbbatch++;
+      currentsize=0;
+      if(nbbatch==2*nbatchmax)
+	{
+	  for(int j=0;j<nbparameter;j++)
+	    for(int k=0;k<nbatchmax;k++)
+	      batchsum[j][k]=batchsum[j][2*k]+batchsum[j][2*k+1];
+	  nbbatch=nbatchmax;
+	  batchsize*=2;
+	}
+    }
+}
+
+long int StreamingEffectiveSize::getNbSample()
+{
+  return nbsample;
+}
+
+double StreamingEffectiveSize::getMean(int n)
+{
+  return meanparam[n];
+}
+
+double StreamingEffectiveSize::getVariance(int n)
+{
+  if(nbsample<2)
+    return 0;
+  return m2[n]/(nbsample-1);
+}
+
+double StreamingEffectiveSize::getEffectiveSize(int n)
+{
+  // not enough batches yet
+  if(nbbatch<2)
+    return nbsample;
+  double mean=0;
+  for(int k=0;k<nbbatch;k++)
+    mean+=batchsum[n][k];
+  mean/=nbbatch*batchsize;
+  double var=0;
+  for(int k=0;k<nbbatch;k++)
+    {
+      double tmp=batchsum[n][k]/batchsize-mean;
+      var+=tmp*tmp;
+    }
+  var*=batchsize/(double)(nbbatch-1);
+  if(var<=0)
+    return nbsample;
+  double ess=nbsample*getVariance(n)/var;
+  if(ess>nbsample)
+    ess=nbsample;
+  return ess;
+}
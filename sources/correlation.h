@@ -54,6 +54,8 @@ class Correlation{
 
   void createParameterBuffer();
   void createCovarianceBuffer();
+  void computeColumnCovariance(int j);
+  void computeColumnCovariances(int begin, int end);
   void createWeight();
   void computeMean();
   void init();
@@ -83,4 +85,35 @@ class Correlation{
   double getSupCI(int n);
 
 };
+
+// batch-means effective sizes, updated one sample at a time (e.g. while the trace of a chain grows)
+//
+// for each parameter: running mean and variance, and the sums over at most 2*nbatchmax consecutive batches
+// once there are 2*nbatchmax complete batches, consecutive batches are merged two by two (and the batch size doubles)
+// so that the memory and the time per sample do not depend on the length of the chain
+//
+// effective size = nbsample * variance / (batchsize * variance of the batch means)
+class StreamingEffectiveSize{
+ private:
+
+  int nbparameter;
+  int nbatchmax;
+  long int nbsample;
+  long int batchsize;
+  long int currentsize;
+  int nbbatch;
+  double *meanparam;
+  double *m2;
+  double *currentsum;
+  double **batchsum;
+
+ public:
+  StreamingEffectiveSize(int nbparam, int nbatch=32);
+  ~StreamingEffectiveSize();
+  void addSample(const double* x);
+  long int getNbSample();
+  double getMean(int n);
+  double getVariance(int n);
+  double getEffectiveSize(int n);
+};
 //#endif
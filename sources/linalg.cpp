@@ -23,6 +23,68 @@ along with PhyloBayes. If not, see <http://www.gnu.org/licenses/>.
 
 using namespace std;
 
+#if defined(LINALG_LAPACK)
+int LinAlg::eigensolver = LinAlg::LAPACKSOLVER;
+#elif defined(LINALG_QL)
+int LinAlg::eigensolver = LinAlg::QLSOLVER;
+#else
+int LinAlg::eigensolver = LinAlg::QRSOLVER;
+#endif
+
+#ifdef LINALG_LAPACK
+extern "C" void dsyevr_(const char* jobz, const char* range, const char* uplo, const int* n, double* a, const int* lda,
+		const double* vl, const double* vu, const int* il, const int* iu, const double* abstol, int* m,
+		double* w, double* z, const int* ldz, int* isuppz, double* work, const int* lwork, int* iwork, const int* liwork, int* info);
+#endif
+
+// per-thread workspace of the contiguous eigensolvers
+// grown as needed and kept across calls
+struct EigenWorkspace	{
+	int dim;
+	double* a;
+	double* z;
+	double* e;
+	double* sqrtpi;
+	double* work;
+	int* iwork;
+	int* isuppz;
+};
+
+static __thread EigenWorkspace* eigenworkspace = 0;
+
+static const int lapacklwork = 26;
+static const int lapackliwork = 10;
+
+static EigenWorkspace* GetEigenWorkspace(int dim)	{
+
+	EigenWorkspace* w = eigenworkspace;
+	if (w && (w->dim >= dim))	{
+		return w;
+	}
+	if (w)	{
+		delete[] w->a;
+		delete[] w->z;
+		delete[] w->e;
+		delete[] w->sqrtpi;
+		delete[] w->work;
+		delete[] w->iwork;
+		delete[] w->isuppz;
+	}
+	else	{
+		w = new EigenWorkspace;
+		eigenworkspace = w;
+	}
+	w->dim = dim;
+	w->a = new double[dim*dim];
+	w->z = new double[dim*dim];
+	w->e = new double[dim];
+	w->sqrtpi = new double[dim];
+	w->work = new double[lapacklwork*dim];
+	w->iwork = new int[lapackliwork*dim];
+	w->isuppz = new int[2*dim];
+	return w;
+}
+
 void LinAlg::QR(double** u, int dim, double** ql, double** r)	{
 
 	double* v = new double[dim];
@@ -463,6 +525,10 @@ int LinAlg::DiagonalizeSymmetricMatrix(double** u, int dim, int nmax, double eps
 // then use Householder's algorithm, com
 int LinAlg::DiagonalizeRateMatrix(double** u, double* pi, int dim, double* eigenval, double** eigenvect, double** inveigenvect, int nmax, double epsilon)	{
 
+	if (eigensolver != QRSOLVER)	{
+		return DiagonalizeRateMatrixContiguous(u,pi,dim,eigenval,eigenvect,inveigenvect,nmax);
+	}
+
 	double** a = new double*[dim];
 	for (int i=0; i<dim; i++)	{
 		a[i] = new double[dim];
@@ -501,6 +567,278 @@ int LinAlg::DiagonalizeRateMatrix(double** u, double* pi, int dim, double* eigen
 	return n;
 }
 
+int LinAlg::DiagonalizeRateMatrixContiguous(double** u, double* pi, int dim, double* eigenval, double** eigenvect, double** inveigenvect, int nmax)	{
+
+	EigenWorkspace* w = GetEigenWorkspace(dim);
+	double* a = w->a;
+	double* sqrtpi = w->sqrtpi;
+
+	for (int i=0; i<dim; i++)	{
+		sqrtpi[i] = sqrt(pi[i]);
+	}
+	// symmetric matrix (symmetrized, so as to absorb rounding errors)
+	for (int j=0; j<dim; j++)	{
+		for (int i=j; i<dim; i++)	{
+			double tmp = 0.5 * (u[i][j] * sqrtpi[i] / sqrtpi[j] + u[j][i] * sqrtpi[j] / sqrtpi[i]);
+			a[j*dim + i] = tmp;
+			a[i*dim + j] = tmp;
+		}
+	}
+
+	int n = 0;
+	double* z = 0;
+	if (eigensolver == LAPACKSOLVER)	{
+		n = DiagonalizeSymmetricMatrixLapack(a,dim,nmax,eigenval,w->z);
+		z = w->z;
+	}
+	else	{
+		n = DiagonalizeSymmetricMatrixQL(a,dim,nmax,eigenval);
+		z = a;
+	}
+
+	for (int k=0; k<dim; k++)	{
+		const double* zk = z + k*dim;
+		for (int i=0; i<dim; i++)	{
+			eigenvect[i][k] = zk[i] / sqrtpi[i];
+			inveigenvect[k][i] = zk[i] * sqrtpi[i];
+		}
+	}
+	return n;
+}
+
+// Householder tridiagonalization and implicit QL iterations
+// (after the tred2 and tql2 routines of EISPACK)
+// a[j*dim+i] : entry (i,j)
+int LinAlg::DiagonalizeSymmetricMatrixQL(double* a, int dim, int nmax, double* eigenval)	{
+
+	double* d = eigenval;
+	double* e = GetEigenWorkspace(dim)->e;
+	int n = dim;
+
+	// tridiagonalization
+	// accumulating the orthogonal transformation in a
+
+	for (int j=0; j<n; j++)	{
+		d[j] = a[j*n + n-1];
+	}
+
+	for (int i=n-1; i>0; i--)	{
+
+		double* ai = a + i*n;
+		double scale = 0;
+		double h = 0;
+		for (int k=0; k<i; k++)	{
+			scale += fabs(d[k]);
+		}
+		if (scale == 0)	{
+			e[i] = d[i-1];
+			for (int j=0; j<i; j++)	{
+				d[j] = a[j*n + i-1];
+				a[j*n + i] = 0;
+				ai[j] = 0;
+			}
+		}
+		else	{
+			for (int k=0; k<i; k++)	{
+				d[k] /= scale;
+				h += d[k] * d[k];
+			}
+			double f = d[i-1];
+			double g = sqrt(h);
+			if (f > 0)	{
+				g = -g;
+			}
+			e[i] = scale * g;
+			h -= f * g;
+			d[i-1] = f - g;
+			for (int j=0; j<i; j++)	{
+				e[j] = 0;
+			}
+			for (int j=0; j<i; j++)	{
+				double* aj = a + j*n;
+				f = d[j];
+				ai[j] = f;
+				g = e[j] + aj[j] * f;
+				for (int k=j+1; k<i; k++)	{
+					g += aj[k] * d[k];
+					e[k] += aj[k] * f;
+				}
+				e[j] = g;
+			}
+			f = 0;
+			for (int j=0; j<i; j++)	{
+				e[j] /= h;
+				f += e[j] * d[j];
+			}
+			double hh = f / (h + h);
+			for (int j=0; j<i; j++)	{
+				e[j] -= hh * d[j];
+			}
+			for (int j=0; j<i; j++)	{
+				double* aj = a + j*n;
+				f = d[j];
+				g = e[j];
+				for (int k=j; k<i; k++)	{
+					aj[k] -= (f * e[k] + g * d[k]);
+				}
+				d[j] = aj[i-1];
+				aj[i] = 0;
+			}
+		}
+		d[i] = h;
+	}
+
+	for (int i=0; i<n-1; i++)	{
+		double* ai = a + i*n;
+		double* ai1 = a + (i+1)*n;
+		ai[n-1] = ai[i];
+		ai[i] = 1.0;
+		double h = d[i+1];
+		if (h != 0)	{
+			for (int k=0; k<=i; k++)	{
+				d[k] = ai1[k] / h;
+			}
+			for (int j=0; j<=i; j++)	{
+				double* aj = a + j*n;
+				double g = 0;
+				for (int k=0; k<=i; k++)	{
+					g += ai1[k] * aj[k];
+				}
+				for (int k=0; k<=i; k++)	{
+					aj[k] -= g * d[k];
+				}
+			}
+		}
+		for (int k=0; k<=i; k++)	{
+			ai1[k] = 0;
+		}
+	}
+	for (int j=0; j<n; j++)	{
+		d[j] = a[j*n + n-1];
+		a[j*n + n-1] = 0;
+	}
+	a[(n-1)*n + n-1] = 1.0;
+	e[0] = 0;
+
+	// implicit QL iterations on the tridiagonal matrix
+
+	for (int i=1; i<n; i++)	{
+		e[i-1] = e[i];
+	}
+	e[n-1] = 0;
+
+	double f = 0;
+	double tst1 = 0;
+	double eps = pow(2.0,-52.0);
+	int maxiter = 0;
+	for (int l=0; l<n; l++)	{
+
+		// find small subdiagonal element
+		if (tst1 < fabs(d[l]) + fabs(e[l]))	{
+			tst1 = fabs(d[l]) + fabs(e[l]);
+		}
+		int m = l;
+		while (m < n-1)	{
+			if (fabs(e[m]) <= eps * tst1)	{
+				break;
+			}
+			m++;
+		}
+
+		if (m > l)	{
+			int iter = 0;
+			do	{
+				iter++;
+				if (iter == nmax)	{
+					return nmax;
+				}
+
+				// compute implicit shift
+				double g = d[l];
+				double p = (d[l+1] - g) / (2.0 * e[l]);
+				double r = hypot(p,1.0);
+				if (p < 0)	{
+					r = -r;
+				}
+				d[l] = e[l] / (p + r);
+				d[l+1] = e[l] * (p + r);
+				double dl1 = d[l+1];
+				double h = g - d[l];
+				for (int i=l+2; i<n; i++)	{
+					d[i] -= h;
+				}
+				f += h;
+
+				// implicit QL transformation
+				p = d[m];
+				double c = 1.0;
+				double c2 = c;
+				double c3 = c;
+				double el1 = e[l+1];
+				double s = 0;
+				double s2 = 0;
+				for (int i=m-1; i>=l; i--)	{
+					c3 = c2;
+					c2 = c;
+					s2 = s;
+					g = c * e[i];
+					h = c * p;
+					r = hypot(p,e[i]);
+					e[i+1] = s * r;
+					s = e[i] / r;
+					c = p / r;
+					p = c * d[i] - s * g;
+					d[i+1] = h + s * (c * g + s * d[i]);
+
+					// accumulate transformation
+					double* ai = a + i*n;
+					double* ai1 = a + (i+1)*n;
+					for (int k=0; k<n; k++)	{
+						h = ai1[k];
+						ai1[k] = s * ai[k] + c * h;
+						ai[k] = c * ai[k] - s * h;
+					}
+				}
+				p = -s * s2 * c3 * el1 * e[l] / dl1;
+				e[l] = s * p;
+				d[l] = c * p;
+
+			} while (fabs(e[l]) > eps * tst1);
+			if (maxiter < iter)	{
+				maxiter = iter;
+			}
+		}
+		d[l] += f;
+		e[l] = 0;
+	}
+	return maxiter;
+}
+
+int LinAlg::DiagonalizeSymmetricMatrixLapack(double* a, int dim, int nmax, double* eigenval, double* eigenvect)	{
+
+#ifdef LINALG_LAPACK
+	EigenWorkspace* w = GetEigenWorkspace(dim);
+	double vl = 0;
+	double vu = 0;
+	int il = 0;
+	int iu = 0;
+	double abstol = 0;
+	int m = 0;
+	int lwork = lapacklwork * w->dim;
+	int liwork = lapackliwork * w->dim;
+	int info = 0;
+	dsyevr_("V","A","L",&dim,a,&dim,&vl,&vu,&il,&iu,&abstol,&m,eigenval,eigenvect,&dim,w->isuppz,w->work,&lwork,w->iwork,&liwork,&info);
+	if (info || (m != dim))	{
+		return nmax;
+	}
+	return 0;
+#else
+	cerr << "error in LinAlg: LAPACK eigensolver not available (compile with -DLINALG_LAPACK)\n";
+	exit(1);
+	return nmax;
+#endif
+}
+
 // computes inverse of matrix given as an input (a)
 // store inverse in invu
 // does not corrupt matrix a
@@ -26,6 +26,15 @@ class LinAlg {
 	// then calls DiagonalizeSymmetricMatrix
 	static int DiagonalizeRateMatrix(double** u, double* pi, int dim, double* eigenval, double** eigenvect, double** inveigenvect, int nmax=1000, double epsilon = 1e-10);
 
+	// symmetric eigensolver used by DiagonalizeRateMatrix
+	// QRSOLVER : DiagonalizeSymmetricMatrix (see below)
+	// QLSOLVER : Householder tridiagonalization followed by implicit QL iterations,
+	//            on contiguous (column-major) storage, with workspaces reused across calls
+	// LAPACKSOLVER : LAPACK dsyevr (only if compiled with -DLINALG_LAPACK)
+	// default is QRSOLVER, unless compiled with -DLINALG_QL or -DLINALG_LAPACK (see Makefile)
+	enum EigenSolver {QRSOLVER, QLSOLVER, LAPACKSOLVER};
+	static int eigensolver;
+
 	// diagonalize a symmetric matrix
 	// first applying Householder transformation (tri-diagonal)
 	// then using QR reduction
@@ -45,6 +54,15 @@ class LinAlg {
 
 	private:
 
+	// QLSOLVER and LAPACKSOLVER versions of DiagonalizeRateMatrix
+	static int DiagonalizeRateMatrixContiguous(double** u, double* pi, int dim, double* eigenval, double** eigenvect, double** inveigenvect, int nmax);
+
+	// a : symmetric matrix of size dim*dim, column-major
+	// on output, eigenvectors are stored in the columns of a (QL) or of eigenvect (LAPACK)
+	// return nmax upon failure
+	static int DiagonalizeSymmetricMatrixQL(double* a, int dim, int nmax, double* eigenval);
+	static int DiagonalizeSymmetricMatrixLapack(double* a, int dim, int nmax, double* eigenval, double* eigenvect);
+
 	static void QR(double** u, int dim, double** ql, double** r);
 	static void HouseHolder(double** u, int dim, double** a, double** ql);
 